@@ -0,0 +1,148 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_ASYNCFILEWRITER_H
+#define SOFTFM_ASYNCFILEWRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef USE_IO_URING
+#include <liburing.h>
+#endif // USE_IO_URING
+
+/**
+ * Append a byte stream to a regular file in the background.
+ *
+ * Data is collected in two page-aligned batch buffers: one is filled
+ * by the caller while the other one is being written, so the caller only
+ * waits for the disk if a whole batch is still pending when the next one
+ * is full. Writes are submitted to io_uring when compiled with
+ * USE_IO_URING and supported by the kernel, otherwise they are done by
+ * a writer thread.
+ *
+ * Write errors are reported by the first call after they occur.
+ */
+class AsyncFileWriter {
+public:
+  /** Alignment of buffers, file offsets and sizes for O_DIRECT. */
+  static constexpr std::size_t alignment = 4096;
+
+  /** Default batch size in bytes. */
+  static constexpr std::size_t default_batch_size = 1 << 20;
+
+  /**
+   * Construct writer.
+   *
+   * fd         :: regular file open for writing at offset 0; it is not
+   *               closed by the writer
+   * direct     :: true to bypass the page cache with O_DIRECT if the
+   *               file system supports it
+   * batch_size :: size of each batch buffer in bytes
+   *               (rounded up to a multiple of alignment)
+   */
+  AsyncFileWriter(int fd, bool direct = false,
+                  std::size_t batch_size = default_batch_size);
+
+  /** Destructor; calls finish() if it has not been called. */
+  ~AsyncFileWriter();
+
+  /** Append data to the file. Return false if an error occurred. */
+  bool write(const std::uint8_t *data, std::size_t n);
+
+  /**
+   * Overwrite the start of the file, e.g. to update a header.
+   * Return false if an error occurred.
+   *
+   * data :: new contents of the first n bytes
+   * n    :: number of bytes, at most alignment and at most size()
+   */
+  bool write_head(const std::uint8_t *data, std::size_t n);
+
+  /**
+   * Write all remaining data and wait until all writes are complete.
+   * No data can be written afterwards. Return false if an error occurred.
+   */
+  bool finish();
+
+  /** Return the number of bytes appended to the file. */
+  std::uint64_t size() const { return m_offset + m_buf[m_cur].len; }
+
+  /** Return true if the file is written with O_DIRECT. */
+  bool is_direct() const { return m_direct; }
+
+  /** Return the errno value of the first error, or 0 if there is none. */
+  int error() const { return m_error.load(); }
+
+private:
+  /** Buffer for one write request. */
+  struct Buffer {
+    std::uint8_t *data;
+    std::size_t len;
+    std::uint64_t offset;
+    std::size_t done;
+    bool busy;
+  };
+
+  /** Index of the buffer holding a copy of the first page. */
+  static constexpr unsigned int head_buffer = 2;
+
+  /** Start writing a buffer at the given file offset. */
+  void submit(unsigned int index, std::uint64_t offset);
+
+  /** Wait until a buffer is no longer being written. */
+  void wait_idle(unsigned int index);
+
+  /** Record the first error. */
+  void set_error(int err);
+
+  /** Writer thread. */
+  void run();
+
+#ifdef USE_IO_URING
+  /** Queue a write of the unwritten part of a buffer to the ring. */
+  void ring_submit(Buffer &b);
+
+  /** Process completions; wait for one if wait is true. */
+  void ring_reap(bool wait);
+
+  struct io_uring m_ring;
+#endif // USE_IO_URING
+
+  const int m_fd;
+  const std::size_t m_batch_size;
+  bool m_direct;
+  bool m_use_ring;
+  bool m_finished;
+  Buffer m_buf[3];
+  unsigned int m_cur;
+  std::uint64_t m_offset;
+  std::size_t m_head_len;
+  std::atomic<int> m_error;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::deque<unsigned int> m_queue;
+  bool m_stop;
+  std::thread m_thread;
+};
+
+#endif
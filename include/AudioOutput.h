@@ -20,14 +20,34 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "AsyncFileWriter.h"
 #include "SoftFM.h"
 
 /** Base class for writing audio data to file or playback. */
 class AudioOutput {
 public:
+  /** Dither modes for conversion to integer samples. */
+  enum DitherMode {
+    DITHER_NONE,  // plain rounding
+    DITHER_TPDF,  // triangular PDF dither of +/- 1 LSB
+    DITHER_SHAPED // TPDF dither with first-order noise shaping
+  };
+
+  /** Sample formats of the output stream. */
+  enum SampleFormat {
+    FORMAT_S16_LE,  // signed 16-bit little-endian integer
+    FORMAT_S24_3LE, // signed 24-bit little-endian integer in 3 bytes
+    FORMAT_S32_LE,  // signed 32-bit little-endian integer
+    FORMAT_FLOAT_LE // IEEE 754 32-bit little-endian float
+  };
+
+  /** Return the number of bytes per sample of a sample format. */
+  static unsigned int bytes_per_sample(SampleFormat format);
+
   /** Destructor. */
   virtual ~AudioOutput() {}
 
@@ -37,7 +57,26 @@ public:
    * Return true on success.
    * Return false if an error occurs.
    */
-  virtual bool write(const SampleVector &samples) = 0;
+  virtual bool write(const SampleVector &samples);
+
+  /**
+   * Write audio data encoded in the sample format of the stream,
+   * e.g. by samplesToBytes() of another output with the same format.
+   *
+   * Return true on success.
+   * Return false if an error occurs.
+   */
+  virtual bool write_bytes(const std::uint8_t *data, std::size_t n) = 0;
+
+  /** Return the sample format of the stream. */
+  SampleFormat format() const { return m_format; }
+
+  /**
+   * Encode a list of samples in the sample format of the stream,
+   * with the dither mode of this output.
+   */
+  void samplesToBytes(const SampleVector &samples,
+                      std::vector<std::uint8_t> &bytes);
 
   /** Return the last error, or return an empty string if there is no error. */
   std::string error() {
@@ -49,59 +88,113 @@ public:
   /** Return true if the stream is OK, return false if there is an error. */
   operator bool() const { return (!m_zombie) && m_error.empty(); }
 
+  /**
+   * Set dither mode for conversion to integer samples.
+   *
+   * mode      :: Dither mode.
+   * nchannels :: Number of interleaved channels in the sample stream
+   *              (noise shaping keeps its error feedback per channel).
+   */
+  virtual void set_dither(DitherMode mode, unsigned int nchannels);
+
 protected:
   /** Constructor. */
-  AudioOutput() : m_zombie(false) {}
+  AudioOutput(SampleFormat format = FORMAT_S16_LE)
+      : m_zombie(false), m_format(format), m_dither(DITHER_NONE) {}
+
+  /**
+   * Encode a list of samples as signed 16-bit little-endian integers.
+   * This is the only format to which dither is applied.
+   */
+  void samplesToInt16(const SampleVector &samples,
+                      std::vector<std::uint8_t> &bytes);
 
-  /** Encode a list of samples as signed 16-bit little-endian integers. */
-  static void samplesToInt16(const SampleVector &samples,
+  /** Encode a list of samples as signed 24-bit little-endian integers. */
+  static void samplesToInt24(const SampleVector &samples,
                              std::vector<std::uint8_t> &bytes);
 
+  /** Encode a list of samples as signed 32-bit little-endian integers. */
+  static void samplesToInt32(const SampleVector &samples,
+                             std::vector<std::uint8_t> &bytes);
+
+  /** Encode a list of samples as 32-bit little-endian floats. */
+  static void samplesToFloat32(const SampleVector &samples,
+                               std::vector<std::uint8_t> &bytes);
+
   std::string m_error;
   bool m_zombie;
+  const SampleFormat m_format;
 
 private:
   AudioOutput(const AudioOutput &);            // no copy constructor
   AudioOutput &operator=(const AudioOutput &); // no assignment operator
+
+  DitherMode m_dither;
+  SampleVector m_shape_error;
+  std::vector<std::uint8_t> m_bytebuf;
 };
 
-/** Write audio data as raw signed 16-bit little-endian data. */
+/**
+ * Write audio data as raw little-endian samples.
+ *
+ * Regular files are written in the background by an AsyncFileWriter.
+ */
 class RawAudioOutput : public AudioOutput {
 public:
   /**
    * Construct raw audio writer.
    *
-   * filename :: file name (including path) or "-" to write to stdout
+   * filename  :: file name (including path) or "-" to write to stdout
+   * format    :: sample format
+   * direct_io :: true to write a regular file with O_DIRECT
    */
-  RawAudioOutput(const std::string &filename);
+  RawAudioOutput(const std::string &filename,
+                 SampleFormat format = FORMAT_S16_LE, bool direct_io = false);
 
   ~RawAudioOutput();
-  bool write(const SampleVector &samples);
+  bool write_bytes(const std::uint8_t *data, std::size_t n);
 
 private:
   int m_fd;
-  std::vector<std::uint8_t> m_bytebuf;
+  std::unique_ptr<AsyncFileWriter> m_writer;
 };
 
-/** Write audio data as .WAV file. */
+/**
+ * Write audio data as .WAV file.
+ *
+ * Regular files start with a RIFF header that reserves space for a ds64
+ * chunk, and the header is rewritten periodically while recording so that
+ * an interrupted recording remains playable. When the file grows beyond
+ * 4 GB, the header is converted to RF64 format. Regular files are written
+ * in the background by an AsyncFileWriter.
+ *
+ * Pipes and other non-seekable outputs get a streaming header with
+ * unknown (0xFFFFFFFF) chunk sizes, which is never rewritten.
+ */
 class WavAudioOutput : public AudioOutput {
 public:
+  /** Interval in seconds between header updates of a regular file. */
+  static constexpr unsigned int header_update_interval = 10;
+
   /**
    * Construct .WAV writer.
    *
    * filename     :: file name (including path) or "-" to write to stdout
    * samplerate   :: audio sample rate in Hz
    * stereo       :: true if the output stream contains stereo data
+   * format       :: sample format (FORMAT_FLOAT_LE writes an IEEE float file)
+   * direct_io    :: true to write a regular file with O_DIRECT
    */
   WavAudioOutput(const std::string &filename, unsigned int samplerate,
-                 bool stereo);
+                 bool stereo, SampleFormat format = FORMAT_S16_LE,
+                 bool direct_io = false);
 
   ~WavAudioOutput();
-  bool write(const SampleVector &samples);
+  bool write_bytes(const std::uint8_t *data, std::size_t n);
 
 private:
-  /** (Re-)Write .WAV header. */
-  bool write_header(unsigned int nsamples);
+  /** (Re-)Write .WAV header for the given number of data bytes. */
+  bool write_header(std::uint64_t data_bytes);
 
   static void encode_chunk_id(std::uint8_t *ptr, const char *chunkname);
 
@@ -109,8 +202,12 @@ private:
 
   const unsigned numberOfChannels;
   const unsigned sampleRate;
-  std::FILE *m_stream;
-  std::vector<std::uint8_t> m_bytebuf;
+  const unsigned headerSize;
+  int m_fd;
+  bool m_seekable;
+  std::uint64_t m_data_bytes;
+  std::uint64_t m_header_update_bytes;
+  std::unique_ptr<AsyncFileWriter> m_writer;
 };
 
 #ifdef USE_ALSA
@@ -123,17 +220,17 @@ public:
    * dename       :: ALSA PCM device
    * samplerate   :: audio sample rate in Hz
    * stereo       :: true if the output stream contains stereo data
+   * format       :: sample format
    */
   AlsaAudioOutput(const std::string &devname, unsigned int samplerate,
-                  bool stereo);
+                  bool stereo, SampleFormat format = FORMAT_S16_LE);
 
   ~AlsaAudioOutput();
-  bool write(const SampleVector &samples);
+  bool write_bytes(const std::uint8_t *data, std::size_t n);
 
 private:
   unsigned int m_nchannels;
   struct _snd_pcm *m_pcm;
-  std::vector<std::uint8_t> m_bytebuf;
 };
 #endif // USE_ALSA
 
@@ -0,0 +1,116 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_BANDSCANNER_H
+#define SOFTFM_BANDSCANNER_H
+
+#include <vector>
+
+#include "Fft.h"
+#include "SoftFM.h"
+
+/**
+ * Find FM broadcast stations in wideband IQ captures.
+ *
+ * The power spectrum of a capture is the average of Hann-windowed FFT
+ * frames. A channel on the frequency raster is a station if its mean
+ * power exceeds the noise floor of the capture (the lower quartile of
+ * all bins) by the threshold and is not weaker than its neighbours.
+ * Each station is then demodulated briefly to measure its IF level and
+ * to look for a 19 kHz stereo pilot with PilotPhaseLock.
+ */
+class BandScanner {
+public:
+  static constexpr unsigned int default_fft_size = 2048;
+  static constexpr double default_channel_step = 100000;
+  static constexpr double default_threshold_db = 10;
+
+  /** Duration of the capture to pass to process() in seconds. */
+  static constexpr double burst_seconds = 0.25;
+
+  /** Station found in a capture. */
+  struct Station {
+    double freq;        // frequency in Hz
+    double if_level;    // RMS IF level (where full scale IQ signal is 1.0)
+    double snr;         // channel power over noise floor in dB
+    bool stereo;        // true if the pilot PLL locked
+    double pilot_level; // amplitude of stereo pilot (nominal level is 0.1)
+  };
+
+  /**
+   * Construct band scanner.
+   *
+   * sample_rate  :: IQ sample rate in Hz
+   * channel_step :: frequency raster of the stations in Hz
+   * threshold_db :: minimum channel power over noise floor in dB
+   * fft_size     :: FFT size, must be a power of two
+   */
+  BandScanner(double sample_rate, double channel_step = default_channel_step,
+              double threshold_db = default_threshold_db,
+              unsigned int fft_size = default_fft_size);
+
+  /**
+   * Return half the width of the band around the center frequency in
+   * which process() finds stations, or 0 if the sample rate is too low.
+   */
+  double usable_halfwidth() const { return m_usable_halfwidth; }
+
+  /**
+   * Find the stations in a capture and append them to a list.
+   *
+   * samples     :: IQ samples, preferably burst_seconds long
+   * center_freq :: center frequency of the capture in Hz
+   * lo_freq     :: lowest station frequency to report in Hz
+   * hi_freq     :: report stations below this frequency
+   * stations    :: list to append the stations to, in order of frequency
+   */
+  void process(const IQSampleVector &samples, double center_freq,
+               double lo_freq, double hi_freq,
+               std::vector<Station> &stations);
+
+private:
+  /**
+   * Bandwidth of the pilot PLL in Hz; wider than in FmDecoder, so that
+   * it locks within a burst.
+   */
+  static constexpr double pilot_bandwidth = 200;
+
+  /** Average the power spectra of the FFT frames of a capture. */
+  void power_spectrum(const IQSampleVector &samples);
+
+  /** Return mean power density of the channel at an offset from center. */
+  double channel_power(double offset) const;
+
+  /** Measure IF level and look for the pilot of a station. */
+  void check_station(const IQSampleVector &samples, double offset,
+                     Station &station);
+
+  const double m_sample_rate;
+  const double m_channel_step;
+  const double m_threshold;
+  const unsigned int m_downsample;
+  double m_usable_halfwidth;
+  double m_noise_floor;
+
+  Fft<IQSample::value_type> m_fft;
+  std::vector<IQSample::value_type> m_window;
+  IQSampleVector m_frame;
+  std::vector<double> m_spectrum;
+  std::vector<double> m_sorted;
+};
+
+#endif
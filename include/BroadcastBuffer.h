@@ -0,0 +1,219 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_BROADCASTBUFFER_H
+#define SOFTFM_BROADCASTBUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "WaitCondition.h"
+
+/**
+ * Buffer to hand every block from one producer to several consumers.
+ *
+ * Unlike DataBuffer, where each block goes to exactly one consumer, every
+ * consumer sees every block in order through its own read cursor. The
+ * blocks are kept in a ring of fixed capacity and shared read-only; a
+ * block is released when the producer reuses its slot, which happens only
+ * after the slowest consumer has passed it, or when a dropping consumer
+ * lets go of it.
+ *
+ * The cursors and the write position are atomics; push() and pull() only
+ * take a mutex to sleep or to wake a sleeping thread. Each slot holds the
+ * sequence number of its block and a count of consumers copying the block
+ * out. Before reusing a slot, the producer invalidates the sequence number
+ * and, with LAG_DROP, may have to yield while a consumer finishes its copy.
+ */
+template <class Element> class BroadcastBuffer {
+public:
+  typedef std::shared_ptr<const std::vector<Element>> Block;
+
+  /** What to do when a consumer falls a full ring behind. */
+  enum LagPolicy {
+    LAG_WAIT, // the producer waits for the slowest consumer
+    LAG_DROP  // the producer goes on; the consumer skips the lost blocks
+  };
+
+  /**
+   * Construct buffer.
+   *
+   * capacity :: number of blocks in the ring
+   * policy   :: handling of consumers which fall behind
+   */
+  BroadcastBuffer(std::size_t capacity, LagPolicy policy)
+      : m_slots(std::max(std::size_t(1), capacity)), m_policy(policy),
+        m_head(0), m_end(false) {}
+
+  /**
+   * Add a consumer and return its index.
+   *
+   * Consumers must be added before the first push(), and before any
+   * consumer calls pull(); they start with the first block.
+   */
+  unsigned int add_consumer() {
+    m_cursors.emplace_back(new Cursor);
+    return m_cursors.size() - 1;
+  }
+
+  /** Return number of consumers. */
+  unsigned int num_consumers() const { return m_cursors.size(); }
+
+  /** Add a block; with LAG_WAIT, wait while the ring is full. */
+  void push(std::vector<Element> &&samples) {
+    if (!samples.empty()) {
+      push(std::make_shared<const std::vector<Element>>(std::move(samples)));
+    }
+  }
+
+  /** Add a block which may also be shared with others. */
+  void push(const Block &block) {
+    std::uint64_t seq = m_head.load(std::memory_order_relaxed);
+
+    if (m_policy == LAG_WAIT) {
+      m_wait.wait_for(
+          [this, seq] { return seq - min_cursor() < m_slots.size(); });
+    }
+
+    // A consumer either sees the invalid sequence number or is seen here
+    // as a reader, which then finishes copying the old block.
+    Slot &slot = m_slots[seq % m_slots.size()];
+    slot.seq.store(no_seq);
+    while (slot.readers.load() > 0) {
+      std::this_thread::yield();
+    }
+    slot.block = block;
+    slot.seq.store(seq);
+
+    m_head.store(seq + 1);
+    m_wait.notify();
+  }
+
+  /** Mark the end of the data stream. */
+  void push_end() {
+    m_end.store(true);
+    m_wait.notify();
+  }
+
+  /**
+   * Return the next block for a consumer, waiting until one is pushed.
+   * Return an empty pointer at the end of the stream.
+   */
+  Block pull(unsigned int consumer) {
+    Cursor &cur = *m_cursors[consumer];
+
+    for (;;) {
+      std::uint64_t next = cur.next.load(std::memory_order_relaxed);
+      bool end = m_end.load();
+      std::uint64_t head = m_head.load();
+
+      if (next < head) {
+        // Skip blocks which the producer has already overwritten.
+        std::uint64_t skipped = 0;
+        if (head - next > m_slots.size()) {
+          skipped = head - m_slots.size() - next;
+          next += skipped;
+        }
+
+        Slot &slot = m_slots[next % m_slots.size()];
+        Block block;
+        bool valid;
+        slot.readers.fetch_add(1);
+        valid = (slot.seq.load() == next);
+        if (valid) {
+          block = slot.block;
+        }
+        slot.readers.fetch_sub(1);
+        if (!valid) {
+          // Overwritten after reading head; the next round skips it.
+          continue;
+        }
+
+        if (skipped > 0) {
+          cur.dropped.fetch_add(skipped, std::memory_order_relaxed);
+        }
+        cur.next.store(next + 1);
+        if (m_policy == LAG_WAIT) {
+          m_wait.notify();
+        }
+        return block;
+      }
+
+      if (end) {
+        return Block();
+      }
+
+      m_wait.wait_for(
+          [this, next] { return m_end.load() || m_head.load() > next; });
+    }
+  }
+
+  /** Return number of blocks a consumer has skipped (LAG_DROP). */
+  std::uint64_t dropped(unsigned int consumer) const {
+    return m_cursors[consumer]->dropped.load(std::memory_order_relaxed);
+  }
+
+  /** Return number of blocks pushed but not yet pulled by a consumer. */
+  std::size_t queued_blocks(unsigned int consumer) const {
+    std::uint64_t head = m_head.load(std::memory_order_relaxed);
+    std::uint64_t next = m_cursors[consumer]->next.load();
+    return (head > next) ? std::min<std::uint64_t>(head - next, m_slots.size())
+                         : 0;
+  }
+
+private:
+  /** Sequence number of a slot which holds no valid block. */
+  static constexpr std::uint64_t no_seq = ~std::uint64_t(0);
+
+  struct Slot {
+    Slot() : seq(no_seq), readers(0) {}
+    std::atomic<std::uint64_t> seq;
+    std::atomic<int> readers;
+    Block block;
+  };
+
+  struct Cursor {
+    Cursor() : next(0), dropped(0) {}
+    std::atomic<std::uint64_t> next;
+    std::atomic<std::uint64_t> dropped;
+  };
+
+  /** Return the position of the slowest consumer. */
+  std::uint64_t min_cursor() const {
+    std::uint64_t pos = m_head.load(std::memory_order_relaxed);
+    for (const std::unique_ptr<Cursor> &cur : m_cursors) {
+      pos = std::min(pos, std::uint64_t(cur->next.load()));
+    }
+    return pos;
+  }
+
+  std::vector<Slot> m_slots;
+  const LagPolicy m_policy;
+  std::vector<std::unique_ptr<Cursor>> m_cursors;
+  std::atomic<std::uint64_t> m_head;
+  std::atomic<bool> m_end;
+  WaitCondition m_wait;
+};
+
+template <class Element>
+constexpr std::uint64_t BroadcastBuffer<Element>::no_seq;
+
+#endif
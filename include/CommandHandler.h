@@ -0,0 +1,86 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_COMMANDHANDLER_H
+#define SOFTFM_COMMANDHANDLER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "DataBuffer.h"
+#include "FmDecode.h"
+#include "MetricsServer.h"
+#include "SoftFM.h"
+#include "Source.h"
+
+/**
+ * Run the commands which change the reception while streaming.
+ *
+ * A command is given as its words, e.g. "freq" "100.2M":
+ *  - freq <Hz>: retune the source and the decoder
+ *  - gain <dB>|auto: set the tuner gain
+ *  - mute on|off: silence the audio output
+ *  - stereo on|off: switch stereo output
+ *
+ * Commands must be run by the thread which calls the decoder, between
+ * blocks.
+ */
+class CommandHandler {
+public:
+  /**
+   * Construct handler.
+   *
+   * source        :: streaming source
+   * source_buffer :: buffer filled by the source, flushed when retuning
+   * decoder       :: FM decoder, or NULL if there is none to control
+   * metrics       :: metrics server to update, or NULL
+   * stereo        :: false if decoding in mono
+   */
+  CommandHandler(Source *source, DataBuffer<IQSample> *source_buffer,
+                 FmDecoder *decoder, MetricsServer *metrics, bool stereo);
+
+  /**
+   * Run a command.
+   *
+   * Return false on error; msg describes the result or the error.
+   */
+  bool run(const std::vector<std::string> &words, std::string &msg);
+
+  /** Return true if the audio output is muted. */
+  bool muted() const { return m_muted; }
+
+  /** Return number of samples discarded by retuning. */
+  std::uint64_t dropped_samples() const { return m_dropped_samples; }
+
+private:
+  /** Retune the source and the decoder. */
+  bool retune(const std::string &arg, std::string &msg);
+
+  /** Set the tuner gain. */
+  bool set_gain(const std::string &arg, std::string &msg);
+
+  Source *m_source;
+  DataBuffer<IQSample> *m_source_buffer;
+  FmDecoder *m_decoder;
+  MetricsServer *m_metrics;
+  const bool m_stereo;
+  bool m_muted;
+  std::uint64_t m_dropped_samples;
+};
+
+#endif
@@ -0,0 +1,145 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_CONTROLSERVER_H
+#define SOFTFM_CONTROLSERVER_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ListenSocket.h"
+
+/**
+ * Control and telemetry interface on a Unix domain socket.
+ *
+ * Clients send commands as lines of words and receive one line of JSON
+ * for each command, in the order of the commands. "status" is answered
+ * by the server thread from the telemetry most recently published by the
+ * decoder, so polling never waits for the decoder. All other commands are
+ * queued for the decoder loop, which runs them between blocks and sends
+ * the reply with reply(). A "status" sent before the replies to earlier
+ * commands is queued behind them and answered by the next publish().
+ */
+class ControlServer {
+public:
+  /** Decoder state reported by "status". */
+  struct Telemetry {
+    std::uint64_t block;           // blocks processed
+    double freq;                   // station frequency in Hz
+    double tuner_freq;             // device center frequency in Hz
+    double ppm;                    // frequency correction to make in ppm
+    double if_level;               // RMS IF level in dB
+    double baseband_level;         // RMS baseband level in dB
+    double audio_level;            // RMS audio level in dB
+    double pilot_level;            // stereo pilot amplitude
+    bool stereo_detected;          // pilot PLL locked
+    bool stereo_output;            // stereo output enabled
+    bool muted;                    // audio output muted
+    double input_buffer;           // IQ data queued in seconds
+    double output_buffer;          // audio queued in seconds, -1 if none
+    std::uint64_t dropped_samples; // IQ samples discarded at retuning
+    double cpu_if;                 // CPU time of IF stages in seconds
+    double cpu_baseband;           // CPU time of baseband stages in seconds
+    double cpu_total;              // CPU time of the process in seconds
+  };
+
+  /** Command from a client. */
+  struct Command {
+    std::uint64_t client;           // client to send the reply to
+    std::vector<std::string> words; // command and arguments
+  };
+
+  /**
+   * Construct server and start listening.
+   *
+   * path :: path of the Unix domain socket, "unix:" prefix optional
+   */
+  explicit ControlServer(const std::string &path);
+
+  ~ControlServer();
+
+  /** Publish the decoder state for "status". */
+  void publish(const Telemetry &telemetry);
+
+  /** Take the next queued command; return false if there is none. */
+  bool next_command(Command &command);
+
+  /**
+   * Send the result of a command to the client if it is still connected.
+   *
+   * ok  :: true if the command succeeded
+   * msg :: description of the result or the error
+   */
+  void reply(std::uint64_t client, bool ok, const std::string &msg);
+
+  /** Return true if the server is listening. */
+  operator bool() const { return m_error.empty(); }
+
+  /** Return the last error, or return an empty string if there is no error. */
+  std::string error() const { return m_error; }
+
+private:
+  /** Maximum length of a command line. */
+  static const std::size_t max_line = 256;
+
+  /** Maximum number of unsent reply bytes per client. */
+  static const std::size_t max_output = 1 << 16;
+
+  struct Client {
+    std::uint64_t id;
+    int fd;
+    std::string input;    // partial command line
+    std::string output;   // replies not yet sent
+    unsigned int pending; // queued commands not yet replied to
+    bool eof;             // the client will send no more commands
+    bool closed;
+  };
+
+  /** Handle a command line; return the reply, or empty if queued. */
+  std::string handle_line(Client &client, const std::string &line);
+
+  /** Format the telemetry as JSON. */
+  static std::string status_json(const Telemetry &t);
+
+  /** Read commands from a client; return false if it must be closed. */
+  bool receive(Client &client);
+
+  /** Send queued replies to a client; return false if it must be closed. */
+  bool send_output(Client &client);
+
+  /** Server thread. */
+  void run();
+
+  ListenSocket m_listen;
+  std::string m_error;
+  std::uint64_t m_next_id;
+
+  std::mutex m_mutex;
+  Telemetry m_telemetry;
+  bool m_have_telemetry;
+  std::deque<Command> m_commands;
+  std::vector<std::unique_ptr<Client>> m_clients;
+  bool m_stop;
+  std::thread m_thread;
+};
+
+#endif
@@ -21,19 +21,47 @@
 #include <condition_variable>
 #include <mutex>
 #include <queue>
+#include <vector>
 
-/** Buffer to move sample data between threads. */
+#include "SoftFM.h"
+
+/**
+ * Buffer to move sample data between threads.
+ *
+ * Each block carries a time stamp of the monotonic clock, by default the
+ * time it was pushed, so that the consumer can measure the latency.
+ *
+ * The consumer may hand pulled vectors back with recycle(), so that the
+ * producer can refill them with get_spare() instead of allocating.
+ */
 template <class Element> class DataBuffer {
 public:
+  /** Maximum number of vectors kept for reuse. */
+  static const std::size_t max_spare = 16;
+
   /** Constructor. */
   DataBuffer() : m_qlen(0), m_end_marked(false) {}
 
-  /** Add samples to the queue. */
+  /** Add samples to the queue, stamped with the current time. */
   void push(std::vector<Element> &&samples) {
+    if (!samples.empty()) {
+      push(move(samples), monotonic_time());
+    }
+  }
+
+  /**
+   * Add samples to the queue with a time stamp.
+   *
+   * samples   :: samples to add
+   * timestamp :: time of the samples according to monotonic_time()
+   */
+  void push(std::vector<Element> &&samples, double timestamp) {
     if (!samples.empty()) {
       std::unique_lock<std::mutex> lock(m_mutex);
       m_qlen += samples.size();
-      m_queue.push(move(samples));
+      m_queue.push(Block());
+      m_queue.back().samples = move(samples);
+      m_queue.back().timestamp = timestamp;
       lock.unlock();
       m_cond.notify_all();
     }
@@ -60,24 +88,73 @@ public:
    * or until the end marker is pushed.
    */
   std::vector<Element> pull() {
+    double timestamp;
+    return pull(timestamp);
+  }
+
+  /** Like pull(), and return the time stamp of the block. */
+  std::vector<Element> pull(double &timestamp) {
     std::vector<Element> ret;
+    timestamp = 0;
     std::unique_lock<std::mutex> lock(m_mutex);
     while (m_queue.empty() && !m_end_marked)
       m_cond.wait(lock);
     if (!m_queue.empty()) {
-      m_qlen -= m_queue.front().size();
-      swap(ret, m_queue.front());
+      m_qlen -= m_queue.front().samples.size();
+      swap(ret, m_queue.front().samples);
+      timestamp = m_queue.front().timestamp;
       m_queue.pop();
     }
     return ret;
   }
 
+  /**
+   * Discard all queued blocks, keeping their vectors for reuse.
+   * Return the number of samples discarded.
+   */
+  std::size_t flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::size_t n = m_qlen;
+    while (!m_queue.empty()) {
+      if (m_spare.size() < max_spare) {
+        m_spare.push_back(move(m_queue.front().samples));
+      }
+      m_queue.pop();
+    }
+    m_qlen = 0;
+    return n;
+  }
+
   /** Return true if the end has been reached at the Pull side. */
   bool pull_end_reached() {
     std::unique_lock<std::mutex> lock(m_mutex);
     return m_qlen == 0 && m_end_marked;
   }
 
+  /** Keep a vector which is no longer needed for reuse. */
+  void recycle(std::vector<Element> &&samples) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_spare.size() < max_spare && samples.capacity() > 0) {
+      m_spare.push_back(move(samples));
+    }
+  }
+
+  /**
+   * Return an empty vector, with the capacity of a recycled vector if
+   * there is one.
+   */
+  std::vector<Element> get_spare() {
+    std::vector<Element> ret;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_spare.empty()) {
+      swap(ret, m_spare.back());
+      m_spare.pop_back();
+      lock.unlock();
+      ret.clear();
+    }
+    return ret;
+  }
+
   /** Wait until the buffer contains minfill samples or an end marker. */
   void wait_buffer_fill(std::size_t minfill) {
     std::unique_lock<std::mutex> lock(m_mutex);
@@ -86,9 +163,15 @@ public:
   }
 
 private:
+  struct Block {
+    std::vector<Element> samples;
+    double timestamp;
+  };
+
   std::size_t m_qlen;
   bool m_end_marked;
-  std::queue<std::vector<Element>> m_queue;
+  std::queue<Block> m_queue;
+  std::vector<std::vector<Element>> m_spare;
   std::mutex m_mutex;
   std::condition_variable m_cond;
 };
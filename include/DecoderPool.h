@@ -0,0 +1,183 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_DECODERPOOL_H
+#define SOFTFM_DECODERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BroadcastBuffer.h"
+#include "DataBuffer.h"
+#include "FmDecode.h"
+#include "SoftFM.h"
+#include "WorkStealingScheduler.h"
+
+/**
+ * Run the decoders of several stations in parallel.
+ *
+ * A block holds one IQ vector per station, e.g. the channel outputs of a
+ * PolyphaseChannelizer. The same block is shared by reference between
+ * all stations and freed when the last station has decoded it. Decoded
+ * audio is pushed to a separate output buffer per station.
+ *
+ * By default each station has its own thread, reading the blocks from a
+ * BroadcastBuffer. When a station falls queue_blocks behind, either
+ * process() waits for it, holding back the caller, or the station skips
+ * the blocks it missed so that the other stations keep up.
+ *
+ * Alternatively the blocks of all stations are decoded by a fixed number
+ * of workers of a WorkStealingScheduler, which keeps the blocks of each
+ * station in order and balances stations of different cost across the
+ * workers. process() then always waits for a station which falls behind.
+ */
+class DecoderPool {
+public:
+  /** IQ samples of all stations for one block, shared read-only. */
+  typedef BroadcastBuffer<IQSampleVector>::Block Block;
+
+  /** Handling of a station thread which falls behind. */
+  typedef BroadcastBuffer<IQSampleVector>::LagPolicy LagPolicy;
+
+  /** Default input queue length of each station in blocks. */
+  static constexpr unsigned int default_queue_blocks = 8;
+
+  /**
+   * Construct pool without stations.
+   *
+   * skip_blocks  :: number of initial audio blocks to discard while
+   *                 the decoder filters start up
+   * nworkers     :: number of scheduler workers, or 0 for one thread
+   *                 per station
+   * lag_policy   :: LAG_WAIT to hold back process() for a station thread
+   *                 which falls behind, LAG_DROP to let it skip blocks
+   * queue_blocks :: maximum number of queued blocks per station
+   */
+  explicit DecoderPool(
+      unsigned int skip_blocks, unsigned int nworkers = 0,
+      LagPolicy lag_policy = BroadcastBuffer<IQSampleVector>::LAG_WAIT,
+      unsigned int queue_blocks = default_queue_blocks);
+
+  /** Destructor; decodes all queued blocks before returning. */
+  ~DecoderPool();
+
+  /**
+   * Add a station and start its thread.
+   *
+   * Station i decodes element i of each block. All stations must be
+   * added before the first process(); the station threads only start
+   * reading blocks from then on.
+   *
+   * decoder :: FM decoder of the station; the pool takes ownership
+   * cpu     :: CPU to run the thread on, or -1 for any CPU
+   *            (ignored with scheduler workers, see bind_worker())
+   *
+   * Return false if the thread could not be bound to the CPU; the
+   * station is added and runs on any CPU in that case.
+   */
+  bool add_station(FmDecoder *decoder, int cpu = -1);
+
+  /**
+   * Bind a scheduler worker to a CPU.
+   *
+   * Return false if that fails or the pool has no scheduler.
+   */
+  bool bind_worker(unsigned int worker, int cpu);
+
+  /** Return the scheduler, or NULL with one thread per station. */
+  WorkStealingScheduler *scheduler() { return m_scheduler.get(); }
+
+  /** Return number of stations. */
+  std::size_t num_stations() const { return m_stations.size(); }
+
+  /** Queue a block for all stations. */
+  void process(const Block &block);
+
+  /**
+   * Decode all queued blocks, stop the threads and mark the end of the
+   * output buffers.
+   */
+  void finish();
+
+  /** Return the output buffer of a station. */
+  DataBuffer<Sample> &output(std::size_t station) {
+    return m_stations[station]->output;
+  }
+
+  /** Return IF level of the last block decoded by a station. */
+  double get_if_level(std::size_t station) const {
+    return m_stations[station]->if_level.load(std::memory_order_relaxed);
+  }
+
+  /** Return true if a station detected a stereo signal in its last block. */
+  bool stereo_detected(std::size_t station) const {
+    return m_stations[station]->stereo.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Return number of blocks a station thread skipped (LAG_DROP); always
+   * 0 with scheduler workers, which never skip blocks.
+   */
+  std::uint64_t dropped_blocks(std::size_t station) const {
+    return m_scheduler ? 0 : m_blocks.dropped(m_stations[station]->consumer);
+  }
+
+  /** Return the last error, or an empty string. */
+  const std::string &error() const { return m_error; }
+
+private:
+  struct Station {
+    std::size_t index;
+    std::unique_ptr<FmDecoder> decoder;
+    unsigned int consumer;
+    std::uint64_t blocks;
+    std::atomic<double> if_level;
+    std::atomic<bool> stereo;
+    SampleVector audio;
+    DataBuffer<Sample> output;
+    std::thread thread;
+    std::size_t strand;
+  };
+
+  /** Decode one block of a station. */
+  void decode(Station *st, const Block &block);
+
+  /** Let the station threads start reading blocks. */
+  void start();
+
+  /** Station thread. */
+  void run(Station *st);
+
+  const unsigned int m_skip_blocks;
+  const unsigned int m_queue_blocks;
+  BroadcastBuffer<IQSampleVector> m_blocks;
+  std::unique_ptr<WorkStealingScheduler> m_scheduler;
+  std::vector<std::unique_ptr<Station>> m_stations;
+  std::string m_error;
+
+  std::mutex m_start_mutex;
+  std::condition_variable m_start_cond;
+  bool m_started;
+};
+
+#endif
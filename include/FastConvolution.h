@@ -0,0 +1,93 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_FASTCONVOLUTION_H
+#define SOFTFM_FASTCONVOLUTION_H
+
+#include <complex>
+#include <vector>
+
+#include "Fft.h"
+#include "SoftFM.h"
+
+/**
+ * Minimum number of FIR taps per computed output sample for which
+ * the FIR filters switch from direct convolution to FFT convolution.
+ *
+ * The overlap-save engine always computes the filter output at the full
+ * input rate, so a decimating filter only benefits if its number of taps
+ * divided by its decimation factor reaches this threshold.
+ */
+static constexpr unsigned int fast_convolution_min_taps = 96;
+
+/**
+ * Overlap-save FFT convolution of IQ samples with real FIR coefficients.
+ *
+ * Computes out[i] = sum(taps[k] * in[i-k]) over a continuous stream,
+ * keeping the filter history between calls. Output length and latency
+ * are identical to the direct form, so it can replace a direct-form FIR
+ * loop one-for-one.
+ */
+class FastConvolutionIQ {
+public:
+  /**
+   * Construct FFT convolution engine.
+   *
+   * taps :: FIR filter coefficients.
+   */
+  FastConvolutionIQ(const std::vector<IQSample::value_type> &taps);
+
+  /** Process n samples from in, write n samples to out. */
+  void process(const IQSample *in, unsigned int n, IQSample *out);
+
+private:
+  unsigned int m_ntaps;
+  unsigned int m_block;
+  Fft<IQSample::value_type> m_fft;
+  IQSampleVector m_kernel;
+  IQSampleVector m_input;
+  IQSampleVector m_work;
+};
+
+/**
+ * Overlap-save FFT convolution of real-valued samples.
+ *
+ * Same semantics as FastConvolutionIQ, using a real-valued FFT.
+ */
+class FastConvolution {
+public:
+  /**
+   * Construct FFT convolution engine.
+   *
+   * taps :: FIR filter coefficients.
+   */
+  FastConvolution(const SampleVector &taps);
+
+  /** Process n samples from in, write n samples to out. */
+  void process(const Sample *in, unsigned int n, Sample *out);
+
+private:
+  unsigned int m_ntaps;
+  unsigned int m_block;
+  RealFft<Sample> m_fft;
+  std::vector<std::complex<Sample>> m_kernel;
+  std::vector<std::complex<Sample>> m_spectrum;
+  SampleVector m_input;
+  SampleVector m_work;
+};
+
+#endif
@@ -0,0 +1,122 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_FFT_H
+#define SOFTFM_FFT_H
+
+#include <complex>
+#include <vector>
+
+/**
+ * Complex FFT for power-of-two sizes.
+ *
+ * Iterative decimation-in-time transform built from radix-4 butterflies,
+ * preceded by a single radix-2 pass when log2(size) is odd.
+ * Both directions are unnormalized: a forward transform followed by
+ * an inverse transform scales the data by size().
+ *
+ * Instantiated for float and double.
+ */
+template <class T> class Fft {
+public:
+  typedef std::complex<T> Complex;
+
+  /**
+   * Construct FFT.
+   *
+   * size :: Transform size, must be a power of two.
+   */
+  Fft(unsigned int size);
+
+  /** Return transform size. */
+  unsigned int size() const { return m_size; }
+
+  /** Forward transform in-place (size() elements). */
+  void forward(Complex *data) const;
+
+  /** Inverse transform in-place (size() elements). */
+  void inverse(Complex *data) const;
+
+  /** Return true if n is a power of two. */
+  static bool is_power_of_two(unsigned int n) {
+    return n != 0 && (n & (n - 1)) == 0;
+  }
+
+  /** Return the smallest power of two >= n. */
+  static unsigned int next_power_of_two(unsigned int n) {
+    unsigned int p = 1;
+    while (p < n) {
+      p <<= 1;
+    }
+    return p;
+  }
+
+private:
+  template <bool inverse> void transform(Complex *data) const;
+
+  unsigned int m_size;
+  std::vector<unsigned int> m_bitrev;
+  std::vector<Complex> m_twiddle;
+  std::vector<Complex> m_twiddle_inv;
+};
+
+/**
+ * FFT of real-valued signals for power-of-two sizes.
+ *
+ * A real transform of size N is computed by packing the even and odd
+ * samples into one complex transform of size N/2.
+ * The spectrum is represented by its N/2+1 non-negative frequency bins.
+ * Both directions are unnormalized, as for Fft.
+ */
+template <class T> class RealFft {
+public:
+  typedef std::complex<T> Complex;
+
+  /**
+   * Construct real FFT.
+   *
+   * size :: Transform size, must be a power of two >= 2.
+   */
+  RealFft(unsigned int size);
+
+  /** Return transform size. */
+  unsigned int size() const { return m_size; }
+
+  /**
+   * Forward transform.
+   *
+   * in  :: size() real samples.
+   * out :: size()/2+1 complex bins.
+   */
+  void forward(const T *in, Complex *out);
+
+  /**
+   * Inverse transform.
+   *
+   * in  :: size()/2+1 complex bins.
+   * out :: size() real samples.
+   */
+  void inverse(const Complex *in, T *out);
+
+private:
+  unsigned int m_size;
+  Fft<T> m_fft;
+  std::vector<Complex> m_twiddle;
+  std::vector<Complex> m_work;
+};
+
+#endif
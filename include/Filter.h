@@ -18,7 +18,9 @@
 #ifndef SOFTFM_FILTER_H
 #define SOFTFM_FILTER_H
 
+#include "FastConvolution.h"
 #include "SoftFM.h"
+#include <memory>
 #include <vector>
 
 /** Fine tuner which shifts the frequency of an IQ signal by a fixed offset. */
@@ -43,7 +45,12 @@ private:
   IQSampleVector m_table;
 };
 
-/** Low-pass filter for IQ samples, based on Lanczos FIR filter. */
+/**
+ * Low-pass filter for IQ samples, based on Lanczos FIR filter.
+ *
+ * Filters with at least fast_convolution_min_taps coefficients
+ * are computed by FFT convolution (FastConvolutionIQ).
+ */
 class LowPassFilterFirIQ {
 public:
   /**
@@ -58,9 +65,21 @@ public:
   /** Process samples. */
   void process(const IQSampleVector &samples_in, IQSampleVector &samples_out);
 
+  /**
+   * FIR kernel computing n outputs:
+   * out[i] = sum(inp[i+j] * coeff[j]), j = 0 .. ntaps-1.
+   * The coefficients must be symmetric.
+   */
+  typedef void (*Kernel)(const IQSample *inp,
+                         const IQSample::value_type *coeff,
+                         unsigned int ntaps, IQSample *out, unsigned int n);
+
 private:
   std::vector<IQSample::value_type> m_coeff;
   IQSampleVector m_state;
+  IQSampleVector m_headbuf;
+  std::unique_ptr<FastConvolutionIQ> m_fastconv;
+  Kernel m_kernel;
 };
 
 /**
@@ -68,6 +87,10 @@ private:
  *
  *  Step 1: Low-pass filter based on Lanczos FIR filter
  *  Step 2: (optional) Decimation by an arbitrary factor (integer or float)
+ *
+ *  If (filter_order / downsample) reaches fast_convolution_min_taps,
+ *  step 1 is computed at the full input rate by FFT convolution
+ *  (FastConvolution) and step 2 picks or interpolates its output.
  */
 class DownsampleFilter {
 public:
@@ -89,6 +112,16 @@ public:
   /** Process samples. */
   void process(const SampleVector &samples_in, SampleVector &samples_out);
 
+  /**
+   * Decimating FIR kernel for integer downsample factors, computing
+   * n outputs:
+   * out[i] = sum(inp[i*step+j] * coeff[j]), j = 0 .. ntaps-1.
+   * The coefficients must be symmetric.
+   */
+  typedef void (*Kernel)(const Sample *inp, const Sample *coeff,
+                         unsigned int ntaps, unsigned int step, Sample *out,
+                         unsigned int n);
+
 private:
   double m_downsample;
   unsigned int m_downsample_int;
@@ -96,6 +129,10 @@ private:
   Sample m_pos_frac;
   SampleVector m_coeff;
   SampleVector m_state;
+  SampleVector m_histbuf;
+  std::unique_ptr<FastConvolution> m_fastconv;
+  SampleVector m_fastbuf;
+  Kernel m_kernel;
 };
 
 /** First order low-pass IIR filter for real-valued signals. */
@@ -121,12 +158,29 @@ public:
   /** Process interleaved samples in-place. */
   void process_interleaved_inplace(SampleVector &samples);
 
+  /**
+   * Process n samples from in to out (in may be equal to out).
+   * Four outputs are computed per step from the last output of the
+   * previous step, which shortens the serial dependency chain.
+   */
+  void process_block(const Sample *in, Sample *out, unsigned int n);
+
+  /**
+   * Process n interleaved sample pairs from in to out
+   * (in may be equal to out), filtering both channels in parallel.
+   */
+  void process_pairs(const Sample *in, Sample *out, unsigned int n);
+
 private:
   double m_timeconst;
   Sample m_a1;
   Sample m_b0;
   Sample m_y0_1;
   Sample m_y1_1;
+
+  // Look-ahead coefficients: y[k] = sum(m_g[k-m] * x[m]) + m_p[k] * y[-1].
+  Sample m_g[4];
+  Sample m_p[4];
 };
 
 /** Low-pass filter for real-valued signals based on Butterworth IIR filter. */
@@ -165,9 +219,35 @@ public:
   /** Process samples in-place. */
   void process_inplace(SampleVector &samples);
 
+  /**
+   * Process n samples from in to out (in may be equal to out).
+   * Uses a block state-space form computing four outputs per step
+   * directly from the filter state, which shortens the serial
+   * dependency chain.
+   */
+  void process_block(const Sample *in, Sample *out, unsigned int n);
+
+  /**
+   * Process n samples of two streams, running both filters in parallel.
+   * Each in may be equal to its out.
+   *
+   * f0, in0, out0 :: First filter and its samples.
+   * f1, in1, out1 :: Second filter and its samples.
+   */
+  static void process_pair(HighPassFilterIir &f0, const Sample *in0,
+                           Sample *out0, HighPassFilterIir &f1,
+                           const Sample *in1, Sample *out1, unsigned int n);
+
 private:
   Sample b0, b1, b2, a1, a2;
   Sample x1, x2, y1, y2;
+
+  // Block coefficients:
+  //   y[k] = sum(h[k-m] * v[m]) + c1[k] * y[-1] + c2[k] * y[-2]
+  // where v = b0 * x[k] + b1 * x[k-1] + b2 * x[k-2].
+  Sample h[4];
+  Sample c1[4];
+  Sample c2[4];
 };
 
 #endif
@@ -20,11 +20,13 @@
 #define SOFTFM_FMDECODE_H
 
 #include <cstdint>
+#include <thread>
 #include <vector>
 
 #include "EqParameters.h"
 #include "Filter.h"
 #include "SoftFM.h"
+#include "SpscQueue.h"
 
 /* Detect frequency by phase discrimination between successive samples. */
 class PhaseDiscriminator {
@@ -47,6 +49,11 @@ public:
 private:
   const Sample m_freq_scale_factor;
   IQSample m_last1_sample;
+
+  // Work buffers, kept to avoid allocating for each block.
+  SampleVector m_temp;
+  std::vector<IQSample::value_type> m_temp_dq;
+  std::vector<IQSample::value_type> m_temp_di;
 };
 
 class DiscriminatorEqualizer {
@@ -134,6 +141,9 @@ public:
   static constexpr unsigned int finetuner_table_size = 256;
   static constexpr double default_deemphasis_eu = 50; // Europe and Japan
   static constexpr double default_deemphasis_na = 75; // USA/Canada
+  static constexpr double default_audio_gain = 0.5;
+  static constexpr double pilot_pll_bandwidth = 50;
+  static constexpr double pilot_pll_minsignal = 0.01; // was 0.04
 
   /**
    * Construct FM decoder.
@@ -157,13 +167,42 @@ public:
    * pilot_shift      :: True to shift pilot signal phase
    *                  :: (use cos(2*x) instead of sin (2*x))
    *                  :: (for multipath distortion detection)
+   * audio_gain       :: Linear gain applied to the audio output.
    */
   FmDecoder(double sample_rate_if, double tuning_offset, double sample_rate_pcm,
             bool stereo = true, double deemphasis = 50,
             double bandwidth_if = default_bandwidth_if,
             double freq_dev = default_freq_dev,
             double bandwidth_pcm = default_bandwidth_pcm,
-            unsigned int downsample = 1, bool pilot_shift = false);
+            unsigned int downsample = 1, bool pilot_shift = false,
+            double audio_gain = default_audio_gain);
+
+  /** Stop the baseband thread if pipelined. */
+  ~FmDecoder();
+
+  /**
+   * Run the baseband stages (pilot PLL, stereo demodulation, audio
+   * resampling, de-emphasis) in a separate thread, in parallel with
+   * the IF stages of the next block.
+   *
+   * From then on process() returns the audio of the previous block, so
+   * the audio is delayed by one block. stereo_detected(), the audio and
+   * pilot levels and the PPS events refer to the returned audio.
+   */
+  void start_pipeline();
+
+  /** Return true if the baseband stages run in a separate thread. */
+  bool pipelined() const { return m_pipeline_thread.joinable(); }
+
+  /**
+   * Retune to a station at another offset from the receiver LO.
+   *
+   * Only the fine tuner depends on the offset. The pilot PLL and the
+   * level and offset estimates restart with the next block, so that
+   * they do not carry over from the previous station; the filters clear
+   * within a few milliseconds. Call from the thread which calls process().
+   */
+  void retune(double tuning_offset);
 
   /**
    * Process IQ samples and return audio samples.
@@ -172,8 +211,18 @@ public:
    * channels are interleaved in the output vector (even if no stereo
    * signal is detected). If the decoder is set in mono mode, the output
    * vector only contains samples for one channel.
+   *
+   * capture_time :: time stamp of the IQ samples, which comes back with
+   *                 their audio from get_capture_time()
    */
-  void process(const IQSampleVector &samples_in, SampleVector &audio);
+  void process(const IQSampleVector &samples_in, SampleVector &audio,
+               double capture_time = 0);
+
+  /**
+   * Return the time stamp passed to process() with the IQ samples of the
+   * audio returned most recently, or 0 if no audio was returned.
+   */
+  double get_capture_time() const { return m_capture_time; }
 
   /** Return true if a stereo signal is detected. */
   bool stereo_detected() const { return m_stereo_detected; }
@@ -191,46 +240,106 @@ public:
   /** Return RMS baseband signal level (where nominal level is 0.707). */
   double get_baseband_level() const { return m_baseband_level; }
 
+  /**
+   * Return RMS audio level before audio gain
+   * (where nominal level is 0.707).
+   */
+  double get_audio_level() const { return m_audio_level; }
+
   /** Return amplitude of stereo pilot (nominal level is 0.1). */
-  double get_pilot_level() const { return m_pilotpll.get_pilot_level(); }
+  double get_pilot_level() const { return m_pilot_level; }
 
   /** Return PPS events from the most recently processed block. */
   std::vector<PilotPhaseLock::PpsEvent> get_pps_events() const {
-    return m_pilotpll.get_pps_events();
+    return m_pps_events;
   }
 
+  /**
+   * Switch the output of a stereo decoder between stereo and mono audio;
+   * mono audio is duplicated in both channels. The pilot is still
+   * detected. No effect on a mono decoder.
+   */
+  void set_stereo_output(bool enable) { m_stereo_output = enable; }
+
+  /** Return true if a stereo decoder outputs stereo audio when detected. */
+  bool stereo_output() const { return m_stereo_output; }
+
+  /** Return thread CPU time spent in the IF stages in seconds. */
+  double get_if_cpu_time() const { return m_if_cpu_time; }
+
+  /**
+   * Return thread CPU time spent in the baseband stages in seconds,
+   * up to the block returned most recently.
+   */
+  double get_baseband_cpu_time() const { return m_baseband_cpu_time; }
+
 private:
+  /** Baseband signal of one block and the results of the baseband stages. */
+  struct BasebandBlock {
+    SampleVector baseband;
+    SampleVector audio;
+    bool retuned;
+    bool stereo_output;
+    bool stereo_detected;
+    double capture_time;
+    double cpu_time;
+    double audio_level;
+    double pilot_level;
+    std::vector<PilotPhaseLock::PpsEvent> pps_events;
+  };
+
+  /** Run the IF stages, from fine tuning to baseband downsampling. */
+  void process_if(const IQSampleVector &samples_in, SampleVector &baseband);
+
+  /** Run the baseband stages, from the pilot PLL to the audio output. */
+  void process_baseband(BasebandBlock &block);
+
+  /** Baseband thread of the pipelined decoder. */
+  void run_pipeline();
+
   /** Demodulate stereo L-R signal. */
   void demod_stereo(const SampleVector &samples_baseband,
                     SampleVector &samples_stereo);
 
-  /** Duplicate mono signal in left/right channels. */
-  void mono_to_left_right(const SampleVector &samples_mono,
-                          SampleVector &audio);
-
-  /** Extract left/right channels from mono/stereo signals. */
-  void stereo_to_left_right(const SampleVector &samples_mono,
-                            const SampleVector &samples_stereo,
-                            SampleVector &audio);
-
-  // Fill zero signal in left/right channels.
-  // (samples_mono used for the size determination only)
-  void zero_to_left_right(const SampleVector &samples_mono,
-                          SampleVector &audio);
+  /**
+   * Run DC blocking, stereo matrix, de-emphasis, audio gain and
+   * audio level measurement on the resampled mono/stereo signals
+   * in a single pass, writing the final audio samples.
+   */
+  void process_audio(bool stereo_detected, SampleVector &audio);
 
   // Data members.
   const double m_sample_rate_if;
   const double m_sample_rate_baseband;
   const int m_tuning_table_size;
-  const int m_tuning_shift;
+  int m_tuning_shift;
   const double m_freq_dev;
   const unsigned int m_downsample;
   const bool m_pilot_shift;
   const bool m_stereo_enabled;
+  bool m_stereo_output;
+  bool m_retuned;
   bool m_stereo_detected;
   double m_if_level;
   double m_baseband_mean;
   double m_baseband_level;
+  const double m_audio_gain;
+  double m_audio_level;
+  double m_pilot_level;
+  std::vector<PilotPhaseLock::PpsEvent> m_pps_events;
+  double m_if_cpu_time;
+  double m_baseband_cpu_time;
+  double m_capture_time;
+
+  // Audio level of the baseband stages; m_audio_level follows the output.
+  double m_baseband_audio_level;
+
+  // Pipelined mode: blocks travel to the baseband thread and back.
+  BasebandBlock m_block;
+  SpscQueue<BasebandBlock> m_pipeline_in;
+  SpscQueue<BasebandBlock> m_pipeline_out;
+  unsigned int m_pipeline_pending;
+  std::thread m_pipeline_thread;
 
   IQSampleVector m_buf_iftuned;
   IQSampleVector m_buf_iffiltered;
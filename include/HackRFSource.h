@@ -49,6 +49,9 @@ public:
   virtual bool start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag);
   virtual bool stop();
 
+  /** Retune while streaming. */
+  virtual bool retune(std::uint32_t frequency, std::string &error);
+
   /** Return true if the device is OK, return false if there is an error. */
   virtual operator bool() const { return m_dev && m_error.empty(); }
 
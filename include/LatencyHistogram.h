@@ -0,0 +1,95 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_LATENCYHISTOGRAM_H
+#define SOFTFM_LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * Histogram of latencies with a bounded relative error, in the manner of
+ * HdrHistogram.
+ *
+ * Latencies are counted in microseconds. Values below sub_buckets are
+ * counted exactly; above, each power of two is split into sub_buckets / 2
+ * linear buckets, so that percentiles are within 1/64 of the true value
+ * over the whole range, up to max_value microseconds (about 19 hours).
+ *
+ * record() uses relaxed atomic operations only, so that one thread can
+ * record while other threads report.
+ */
+class LatencyHistogram {
+public:
+  /** Number of exact buckets; twice the buckets per power of two. */
+  static const unsigned int sub_buckets = 128;
+
+  /** Largest latency in microseconds; larger values are clamped. */
+  static const std::uint64_t max_value = (std::uint64_t(1) << 36) - 1;
+
+  /** Construct empty histogram. */
+  LatencyHistogram();
+
+  /**
+   * Add a latency in seconds; negative values count as zero.
+   * Only one thread may record.
+   */
+  void record(double seconds);
+
+  /** Return number of recorded latencies. */
+  std::uint64_t count() const;
+
+  /**
+   * Return the latency in seconds below which a percentage of the
+   * recorded latencies lie, or 0 if there are none.
+   */
+  double percentile(double percent) const;
+
+  /** Return the mean latency in seconds. */
+  double mean() const;
+
+  /** Return the standard deviation (jitter) of the latency in seconds. */
+  double stddev() const;
+
+  /** Return the largest recorded latency in seconds. */
+  double max() const;
+
+  /** Return one line with count, percentiles, max and jitter. */
+  std::string summary() const;
+
+private:
+  /** Number of powers of two above the exact buckets. */
+  static const unsigned int num_ranges = 36 - 7;
+
+  static const unsigned int num_buckets =
+      sub_buckets + num_ranges * (sub_buckets / 2);
+
+  /** Return the bucket of a value in microseconds. */
+  static unsigned int bucket_index(std::uint64_t value);
+
+  /** Return the highest value in microseconds counted in a bucket. */
+  static std::uint64_t bucket_value(unsigned int index);
+
+  std::atomic<std::uint64_t> m_counts[num_buckets];
+  std::atomic<std::uint64_t> m_count;
+  std::atomic<std::uint64_t> m_max;
+  std::atomic<double> m_sum;
+  std::atomic<double> m_sumsq;
+};
+
+#endif
@@ -0,0 +1,87 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_LISTENSOCKET_H
+#define SOFTFM_LISTENSOCKET_H
+
+#include <poll.h>
+#include <string>
+#include <vector>
+
+/**
+ * Listening socket of a server thread which polls its clients.
+ *
+ * Besides the client sockets, the server thread must wake up when a
+ * client connects and when another thread has queued data for it or
+ * asks it to stop. The listening socket and a wakeup pipe are added to
+ * each poll(), and new connections are accepted without blocking.
+ */
+class ListenSocket {
+public:
+  /**
+   * Construct socket and start listening.
+   *
+   * address :: "unix:PATH" or a path containing '/' for a Unix domain
+   *            socket, or "[HOST:]PORT" for TCP (HOST defaults to
+   *            127.0.0.1)
+   *
+   * A stale Unix domain socket at PATH is replaced, and the socket is
+   * removed again by the destructor.
+   */
+  explicit ListenSocket(const std::string &address);
+
+  ~ListenSocket();
+
+  ListenSocket(const ListenSocket &) = delete;
+  ListenSocket &operator=(const ListenSocket &) = delete;
+
+  /**
+   * Wait until a client socket in pfds has an event, a client connects
+   * or wakeup() is called. Return false if interrupted by a signal.
+   */
+  bool poll(std::vector<struct pollfd> &pfds);
+
+  /**
+   * Accept a connection found by the last poll(); return the new
+   * non-blocking socket, or -1 if there are no more connections.
+   */
+  int accept();
+
+  /** Wake up the thread in poll(); may be called from any thread. */
+  void wakeup();
+
+  /** Return true if the socket is listening. */
+  operator bool() const { return m_listen_fd >= 0 && m_error.empty(); }
+
+  /** Return the last error, or return an empty string if there is no error. */
+  const std::string &error() const { return m_error; }
+
+private:
+  /** Bind to a Unix domain socket; return the socket or -1 on error. */
+  int bind_unix(const std::string &path);
+
+  /** Bind to a TCP port; return the socket or -1 on error. */
+  int bind_tcp(const std::string &address);
+
+  int m_listen_fd;
+  int m_wakeup_fd[2];
+  std::string m_unix_path;
+  bool m_connecting;
+  std::string m_error;
+};
+
+#endif
@@ -0,0 +1,148 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_METRICSSERVER_H
+#define SOFTFM_METRICSSERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ListenSocket.h"
+
+/**
+ * Serve decoder metrics over HTTP in the Prometheus text format.
+ *
+ * The decoder updates the metrics with relaxed atomic operations only;
+ * a single server thread accepts connections without blocking, reads
+ * the request and answers every request with the current metrics. The
+ * values of one scrape are therefore not a consistent snapshot, which
+ * Prometheus does not expect anyway.
+ */
+class MetricsServer {
+public:
+  /** Number of buckets of the decode time histogram, without +Inf. */
+  static const unsigned int num_buckets = 12;
+
+  /** Upper bounds of the decode time buckets in seconds. */
+  static const double bucket_bounds[num_buckets];
+
+  /**
+   * Construct server and start listening.
+   *
+   * address :: "[HOST:]PORT" (HOST defaults to 127.0.0.1)
+   */
+  explicit MetricsServer(const std::string &address);
+
+  ~MetricsServer();
+
+  /**
+   * Count a decoded block.
+   *
+   * samples     :: number of IQ samples in the block
+   * decode_time :: time spent decoding the block in seconds
+   */
+  void add_block(std::size_t samples, double decode_time) {
+    m_samples.fetch_add(samples, std::memory_order_relaxed);
+    unsigned int b = 0;
+    while (b < num_buckets && decode_time > bucket_bounds[b]) {
+      b++;
+    }
+    m_buckets[b].fetch_add(1, std::memory_order_relaxed);
+    m_decode_ns.fetch_add(std::uint64_t(decode_time * 1.0e9),
+                          std::memory_order_relaxed);
+  }
+
+  /** Count IQ samples discarded without decoding. */
+  void add_dropped(std::uint64_t samples) {
+    m_dropped.fetch_add(samples, std::memory_order_relaxed);
+  }
+
+  /** Set the number of IQ samples waiting for the decoder. */
+  void set_input_queue(std::size_t samples) {
+    m_input_queue.store(samples, std::memory_order_relaxed);
+  }
+
+  /** Set the number of audio samples waiting for the output. */
+  void set_output_queue(std::size_t samples) {
+    m_output_queue.store(samples, std::memory_order_relaxed);
+  }
+
+  /** Set the station frequency in Hz. */
+  void set_frequency(double freq) {
+    m_frequency.store(freq, std::memory_order_relaxed);
+  }
+
+  /** Set the RMS IF level (where full scale IQ signal is 1.0). */
+  void set_if_level(double level) {
+    m_if_level.store(level, std::memory_order_relaxed);
+  }
+
+  /** Set whether the stereo pilot is locked. */
+  void set_pilot_locked(bool locked) {
+    m_pilot_locked.store(locked, std::memory_order_relaxed);
+  }
+
+  /** Return true if the server is listening. */
+  operator bool() const { return m_error.empty(); }
+
+  /** Return the last error, or return an empty string if there is no error. */
+  std::string error() const { return m_error; }
+
+private:
+  /** Maximum size of a request. */
+  static const std::size_t max_request = 8192;
+
+  struct Client {
+    int fd;
+    std::string request;  // request received so far
+    std::string response; // response not yet sent
+  };
+
+  /** Format the metrics. */
+  std::string format_metrics() const;
+
+  /**
+   * Read the request of a client and prepare the response once it is
+   * complete. Return false if the client must be closed.
+   */
+  bool receive(Client &client);
+
+  /** Server thread. */
+  void run();
+
+  ListenSocket m_listen;
+  std::string m_error;
+  std::vector<std::unique_ptr<Client>> m_clients;
+  std::atomic_bool m_stop;
+  std::thread m_thread;
+
+  std::atomic<std::uint64_t> m_samples;
+  std::atomic<std::uint64_t> m_dropped;
+  std::atomic<std::uint64_t> m_buckets[num_buckets + 1];
+  std::atomic<std::uint64_t> m_decode_ns;
+  std::atomic<std::uint64_t> m_input_queue;
+  std::atomic<std::uint64_t> m_output_queue;
+  std::atomic<double> m_frequency;
+  std::atomic<double> m_if_level;
+  std::atomic<bool> m_pilot_locked;
+};
+
+#endif
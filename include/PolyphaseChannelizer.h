@@ -0,0 +1,141 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_POLYPHASECHANNELIZER_H
+#define SOFTFM_POLYPHASECHANNELIZER_H
+
+#include <vector>
+
+#include "Fft.h"
+#include "SoftFM.h"
+
+/**
+ * Polyphase filter bank splitting an IQ stream into equally spaced
+ * channels.
+ *
+ * The band is divided into M channels (M a power of two) centered at
+ * k * sample_rate / M, k = 0 .. M-1, where channels above M/2 are at
+ * negative frequencies. Each channel is mixed to zero frequency, low-pass
+ * filtered by a common prototype filter and decimated by D = M/2, so the
+ * channel outputs are sampled at twice the channel spacing. All channels
+ * are computed together by folding the input through the M branches of
+ * the prototype filter and one FFT of size M per output sample.
+ *
+ * The output of a channel is free of aliasing within +/- passband times
+ * the channel spacing around its center.
+ */
+class PolyphaseChannelizer {
+public:
+  /** Filter taps per polyphase branch. */
+  static constexpr unsigned int default_taps_per_branch = 16;
+
+  /** Alias-free half bandwidth relative to the channel spacing. */
+  static constexpr double passband = 0.8;
+
+  /**
+   * Construct channelizer.
+   *
+   * nchannels       :: number of channels M, must be a power of two >= 2
+   * channels        :: channel indices to output (may repeat)
+   * taps_per_branch :: length of the prototype filter divided by M
+   */
+  PolyphaseChannelizer(unsigned int nchannels,
+                       const std::vector<unsigned int> &channels,
+                       unsigned int taps_per_branch = default_taps_per_branch);
+
+  /** Return number of channels. */
+  unsigned int num_channels() const { return m_nchannels; }
+
+  /** Return decimation factor. */
+  unsigned int decimation() const { return m_decimation; }
+
+  /**
+   * Process samples.
+   *
+   * samples_out[i] receives the output of channel channels[i].
+   */
+  void process(const IQSampleVector &samples_in,
+               std::vector<IQSampleVector> &samples_out);
+
+  /**
+   * Return the channel containing a frequency.
+   *
+   * offset      :: frequency relative to the center of the input in Hz
+   * sample_rate :: input sample rate in Hz
+   * nchannels   :: number of channels
+   */
+  static unsigned int channel_index(double offset, double sample_rate,
+                                    unsigned int nchannels);
+
+  /**
+   * Return the center frequency of a channel relative to the center of
+   * the input in Hz.
+   */
+  static double channel_offset(unsigned int channel, double sample_rate,
+                               unsigned int nchannels);
+
+  /**
+   * Return a frequency relative to the center of the channel containing
+   * it, in the range (-sample_rate / 2, sample_rate / 2].
+   *
+   * offset      :: frequency relative to the center of the input in Hz
+   * sample_rate :: input sample rate in Hz
+   * nchannels   :: number of channels
+   */
+  static double channel_residual(double offset, double sample_rate,
+                                 unsigned int nchannels);
+
+  /**
+   * Return the largest number of channels for which every signal fits
+   * into the alias-free band of its channel, or 0 if there is none or a
+   * signal does not lie within the input band.
+   *
+   * sample_rate :: input sample rate in Hz
+   * offsets     :: signal frequencies relative to the center of the input
+   * bandwidth   :: half bandwidth of the signals in Hz
+   * min_spacing :: smallest channel spacing to consider in Hz
+   */
+  static unsigned int choose_num_channels(double sample_rate,
+                                          const std::vector<double> &offsets,
+                                          double bandwidth,
+                                          double min_spacing);
+
+private:
+  const unsigned int m_nchannels;
+  const unsigned int m_decimation;
+  const std::vector<unsigned int> m_channels;
+
+  // Prototype filter, time-reversed, each coefficient repeated for I and Q.
+  std::vector<IQSample::value_type> m_coeff_rev;
+
+  // Phase correction of the selected channels.
+  IQSampleVector m_rotation;
+
+  // Filter history followed by the current input block.
+  IQSampleVector m_buf;
+
+  // Position of the next output sample in m_buf.
+  unsigned int m_pos;
+
+  // Parity of the output sample index, for the (-1)^(k*n) phase correction.
+  bool m_odd;
+
+  Fft<IQSample::value_type> m_fft;
+  IQSampleVector m_work;
+};
+
+#endif
@@ -0,0 +1,136 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_ROTATINGAUDIOOUTPUT_H
+#define SOFTFM_ROTATINGAUDIOOUTPUT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioOutput.h"
+#include "SoftFM.h"
+
+/**
+ * Write audio data as a sequence of time-segmented files.
+ *
+ * The stream is split at exact sample frame counts, so that consecutive
+ * files join without gaps or overlaps. Segment boundaries lie on a grid
+ * of segment_secs, optionally aligned to the wall clock (e.g. on the hour),
+ * which starts at the first written sample frame.
+ * If sync points are supplied, a boundary is moved to the nearest sync
+ * point within half a second, such as a pilot-derived PPS event.
+ *
+ * Files are opened ahead of the boundary, and closed and synced to disk
+ * afterwards, by a background thread; write() does not wait for file
+ * system operations unless the next file is not ready in time. A file
+ * which already exists is not touched ahead of time; it is opened (and
+ * overwritten) at the boundary instead. If the next file can not be
+ * opened, a warning is printed and writing continues in the current file
+ * until the following boundary.
+ *
+ * Samples are encoded (and dithered) once by this object, and the segment
+ * writers receive the encoded data.
+ */
+class RotatingAudioOutput : public AudioOutput {
+public:
+  /** Function creating the writer for one segment file. */
+  typedef std::function<AudioOutput *(const std::string &filename)> Factory;
+
+  /**
+   * Construct rotating writer and open the first segment file.
+   *
+   * pattern      :: file name pattern; strftime() conversions are replaced
+   *                 by the local start time of the segment, otherwise
+   *                 a 4-digit segment index is inserted before the extension
+   * samplerate   :: audio sample rate in Hz
+   * nchannels    :: number of interleaved channels
+   * format       :: sample format, which must match the segment writers
+   * segment_secs :: segment length in seconds
+   * align        :: true to align segment boundaries to the wall clock
+   * factory      :: function creating the writer for a segment file
+   */
+  RotatingAudioOutput(const std::string &pattern, unsigned int samplerate,
+                      unsigned int nchannels, SampleFormat format,
+                      double segment_secs, bool align, Factory factory);
+
+  ~RotatingAudioOutput();
+  bool write_bytes(const std::uint8_t *data, std::size_t n);
+
+  /**
+   * Add a preferred position for a segment boundary.
+   * May be called from any thread.
+   *
+   * frame :: index of the sample frame in the stream (0 = first frame)
+   */
+  void add_sync_point(std::uint64_t frame);
+
+private:
+  /** Anchor the segment grid at the first written frame. */
+  void start();
+
+  /** Return the file name of a segment. */
+  std::string segment_filename(std::uint64_t index, double start_time) const;
+
+  /** Request the background thread to open the next segment file. */
+  void prepare_next();
+
+  /** Switch to the next segment file, closing the current one. */
+  bool rotate();
+
+  /** Return the boundary frame for the nominal boundary m_boundary. */
+  std::uint64_t choose_cut();
+
+  /** Queue a job for the background thread. */
+  void post(std::function<void()> job);
+
+  /** Background thread. */
+  void run();
+
+  const std::string m_pattern;
+  const unsigned int m_samplerate;
+  const unsigned int m_nchannels;
+  const std::uint64_t m_segment_frames;
+  const bool m_align;
+  const Factory m_factory;
+
+  bool m_started;
+  double m_start_time;
+  std::uint64_t m_frames;
+  std::uint64_t m_boundary;
+  std::uint64_t m_index;
+  std::unique_ptr<AudioOutput> m_current;
+  std::string m_current_name;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::deque<std::function<void()>> m_jobs;
+  std::unique_ptr<AudioOutput> m_next;
+  std::string m_next_name;
+  bool m_next_ready;
+  std::vector<std::uint64_t> m_sync_points;
+  bool m_stop;
+  std::thread m_thread;
+};
+
+#endif
@@ -28,6 +28,7 @@
 class RtlSdrSource : public Source {
 public:
   static const int default_block_length = 65536;
+  static const int default_buf_num = 15;
 
   /** Open RTL-SDR device. */
   RtlSdrSource(int dev_index);
@@ -48,8 +49,16 @@ public:
 
   virtual bool start(DataBuffer<IQSample> *samples,
                      std::atomic_bool *stop_flag);
+
+  /** Stop streaming and report short reads. */
   virtual bool stop();
 
+  /** Retune while streaming. */
+  virtual bool retune(std::uint32_t frequency, std::string &error);
+
+  /** Change tuner gain while streaming; the gain must be supported. */
+  virtual bool set_tuner_gain(int gain, std::string &error);
+
   /** Return true if the device is OK, return false if there is an error. */
   virtual operator bool() const { return m_dev && m_error.empty(); }
 
@@ -85,6 +94,9 @@ private:
    */
   static bool get_samples(IQSampleVector *samples);
 
+  /** Receive a transfer in asynchronous mode. */
+  static void rx_callback(unsigned char *buf, std::uint32_t len, void *ctx);
+
   static void run();
 
   struct rtlsdr_dev *m_dev;
@@ -92,6 +104,9 @@ private:
   std::vector<int> m_gains;
   std::string m_gainsStr;
   bool m_confAgc;
+  bool m_async;
+  int m_buf_num;
+  std::uint64_t m_short_reads;
   std::thread *m_thread;
   static RtlSdrSource *m_this;
 };
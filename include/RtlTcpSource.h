@@ -0,0 +1,109 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_RTLTCPSOURCE_H
+#define SOFTFM_RTLTCPSOURCE_H
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Source.h"
+
+/**
+ * Receive IQ samples from an rtl_tcp server.
+ *
+ * The server sends a 12-byte header ("RTL0", tuner type, number of gain
+ * steps) followed by a stream of unsigned 8-bit I/Q pairs. The receiver is
+ * controlled with 5-byte commands (command byte and a big-endian 32-bit
+ * parameter).
+ */
+class RtlTcpSource : public Source {
+public:
+  static const int default_block_length = 65536;
+  static const int default_port = 1234;
+
+  /** Construct unconnected source; configure() connects to the server. */
+  RtlTcpSource(int dev_index);
+
+  /** Close connection. */
+  virtual ~RtlTcpSource();
+
+  virtual bool configure(std::string configuration);
+
+  /** Return current sample frequency in Hz. */
+  virtual std::uint32_t get_sample_rate();
+
+  /** Return device current center frequency in Hz. */
+  virtual std::uint32_t get_frequency();
+
+  /** Print current parameters specific to device type */
+  virtual void print_specific_parms();
+
+  virtual bool start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag);
+  virtual bool stop();
+
+  /** Retune while streaming by sending a command to the server. */
+  virtual bool retune(std::uint32_t frequency, std::string &error);
+
+  /**
+   * Change tuner gain while streaming; the server selects the nearest
+   * gain the tuner supports.
+   */
+  virtual bool set_tuner_gain(int gain, std::string &error);
+
+  /** Return true if the device is OK, return false if there is an error. */
+  virtual operator bool() const { return m_error.empty(); }
+
+  /** Return a list of supported devices. */
+  static void get_device_names(std::vector<std::string> &devices);
+
+private:
+  /** rtl_tcp command codes. */
+  enum Command {
+    CMD_SET_FREQ = 0x01,
+    CMD_SET_SAMPLE_RATE = 0x02,
+    CMD_SET_GAIN_MODE = 0x03,
+    CMD_SET_GAIN = 0x04,
+    CMD_SET_FREQ_CORRECTION = 0x05,
+    CMD_SET_AGC_MODE = 0x08
+  };
+
+  /** Connect to the server and read the header. */
+  bool connect_server(const std::string &host, const std::string &port);
+
+  /** Send a command; return false and set error on failure. */
+  bool send_command(Command cmd, std::uint32_t param, std::string &error);
+
+  /** Receive thread. */
+  void run();
+
+  int m_fd;
+  std::string m_server;
+  std::uint32_t m_tuner_type;
+  std::uint32_t m_tuner_gain_count;
+  std::uint32_t m_sample_rate;
+  std::uint32_t m_frequency;
+  int m_tuner_gain;
+  int m_ppm;
+  bool m_agc;
+  int m_block_length;
+  std::thread *m_thread;
+};
+
+#endif
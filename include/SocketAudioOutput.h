@@ -0,0 +1,99 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_SOCKETAUDIOOUTPUT_H
+#define SOFTFM_SOCKETAUDIOOUTPUT_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioOutput.h"
+#include "ListenSocket.h"
+#include "SoftFM.h"
+
+/**
+ * Serve audio data as a raw sample stream to local clients.
+ *
+ * Clients connect to a Unix domain socket or a TCP port, and receive the
+ * stream from the next block onwards, always starting on a frame boundary.
+ * Each block is encoded once; every client keeps a queue of references to
+ * the shared blocks, which a server thread sends with sendmsg() directly
+ * from the shared buffers. A client that falls behind by more than the
+ * queue limit is disconnected, so it can never stall the decoder.
+ */
+class SocketAudioOutput : public AudioOutput {
+public:
+  /** Default limit of queued data per client in bytes. */
+  static constexpr std::size_t default_max_queue_bytes = 1 << 20;
+
+  /**
+   * Construct socket server and start listening.
+   *
+   * address         :: "unix:PATH" or a path containing '/' for a Unix
+   *                    domain socket, or "[HOST:]PORT" for TCP
+   *                    (HOST defaults to 127.0.0.1)
+   * format          :: sample format
+   * max_queue_bytes :: limit of queued data per client
+   */
+  SocketAudioOutput(const std::string &address,
+                    SampleFormat format = FORMAT_S16_LE,
+                    std::size_t max_queue_bytes = default_max_queue_bytes);
+
+  ~SocketAudioOutput();
+  bool write(const SampleVector &samples);
+  bool write_bytes(const std::uint8_t *data, std::size_t n);
+
+  /** Return the number of connected clients. */
+  std::size_t num_clients();
+
+private:
+  typedef std::shared_ptr<const std::vector<std::uint8_t>> Block;
+
+  struct Client {
+    int fd;
+    std::deque<Block> queue;
+    std::size_t offset;       // bytes of the first block already sent
+    std::size_t queued_bytes; // bytes not yet sent
+    bool evicted;
+  };
+
+  /** Add a block to the queues of all clients. */
+  bool enqueue(const Block &block);
+
+  /** Send queued data to a client; return false if it must be closed. */
+  bool send_queued(Client &client);
+
+  /** Server thread. */
+  void run();
+
+  const std::size_t m_max_queue_bytes;
+  ListenSocket m_listen;
+  std::uint64_t m_evictions;
+  std::uint64_t m_evictions_reported;
+
+  std::mutex m_mutex;
+  std::vector<std::unique_ptr<Client>> m_clients;
+  bool m_stop;
+  std::thread m_thread;
+};
+
+#endif
@@ -19,6 +19,8 @@
 #define SOFTFM_H
 
 #include <complex>
+#include <cstdint>
+#include <ctime>
 #include <vector>
 
 typedef std::complex<float> IQSample;
@@ -27,6 +29,13 @@ typedef std::vector<IQSample> IQSampleVector;
 typedef double Sample;
 typedef std::vector<Sample> SampleVector;
 
+/** Return time of the monotonic clock in seconds, for time stamps. */
+inline double monotonic_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
 /** Compute mean and RMS over a sample vector. */
 inline void samples_mean_rms(const SampleVector &samples, double &mean,
                              double &rms) {
@@ -44,4 +53,25 @@ inline void samples_mean_rms(const SampleVector &samples, double &mean,
   rms = sqrt(vsumsq / n);
 }
 
+/**
+ * Convert unsigned 8-bit I/Q pairs as delivered by RTL-SDR devices.
+ *
+ * in      :: interleaved I/Q bytes
+ * nsample :: number of I/Q pairs
+ * out     :: output samples (resized to nsample)
+ */
+inline void iq_samples_from_u8(const std::uint8_t *in, std::size_t nsample,
+                               IQSampleVector &out) {
+  out.resize(nsample);
+
+  // Convert the interleaved values as a flat float array (the layout of
+  // std::complex is guaranteed), so that the loop is vectorized.
+  IQSample::value_type *p =
+      reinterpret_cast<IQSample::value_type *>(out.data());
+  const IQSample::value_type scale = 1 / IQSample::value_type(128);
+  for (std::size_t i = 0; i < 2 * nsample; i++) {
+    p[i] = (int(in[i]) - 128) * scale;
+  }
+}
+
 #endif
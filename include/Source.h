@@ -55,6 +55,33 @@ public:
   /** stop device after sampling loop */
   virtual bool stop() = 0;
 
+  /**
+   * Tune to a new station frequency while streaming, keeping the other
+   * parameters from configure(). Samples received before and shortly
+   * after the call may still be from the previous frequency.
+   *
+   * Return false and set error if the frequency is invalid or the device
+   * can not be retuned; the device itself stays OK.
+   */
+  virtual bool retune(std::uint32_t frequency, std::string &error) {
+    error = "Retuning not supported by this device";
+    return false;
+  }
+
+  /**
+   * Change the tuner gain while streaming.
+   *
+   * gain  :: tuner gain in units of 0.1 dB, or INT_MIN for automatic gain
+   * error :: set to the reason on failure
+   *
+   * Return false if the gain is invalid or can not be changed; the device
+   * itself stays OK.
+   */
+  virtual bool set_tuner_gain(int gain, std::string &error) {
+    error = "Changing the gain not supported by this device";
+    return false;
+  }
+
   /** Return true if the device is OK, return false if there is an error. */
   virtual operator bool() const = 0;
 
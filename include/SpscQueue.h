@@ -0,0 +1,98 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_SPSCQUEUE_H
+#define SOFTFM_SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "WaitCondition.h"
+
+/**
+ * Bounded queue between exactly one producer and one consumer thread.
+ *
+ * The ring indices are atomic, so push and pop do not take a lock while
+ * the queue is neither full nor empty. A thread which has to wait sleeps
+ * in a WaitCondition, and the other side takes its mutex only if it sees
+ * a sleeping thread.
+ */
+template <class Element> class SpscQueue {
+public:
+  /** Construct queue holding at most capacity elements. */
+  explicit SpscQueue(std::size_t capacity)
+      : m_ring(capacity + 1), m_head(0), m_tail(0), m_closed(false) {}
+
+  /**
+   * Add an element, waiting while the queue is full.
+   *
+   * Return false if the queue has been closed.
+   */
+  bool push(Element &&element) {
+    std::size_t tail = m_tail.load(std::memory_order_relaxed);
+    std::size_t next = (tail + 1) % m_ring.size();
+    if (next == m_head.load(std::memory_order_acquire)) {
+      m_wait.wait_for([this, next] {
+        return next != m_head.load() || m_closed.load();
+      });
+    }
+    if (m_closed.load()) {
+      return false;
+    }
+    m_ring[tail] = std::move(element);
+    m_tail.store(next);
+    m_wait.notify();
+    return true;
+  }
+
+  /**
+   * Remove the oldest element, waiting while the queue is empty.
+   *
+   * Return false if the queue is empty and has been closed.
+   */
+  bool pop(Element &element) {
+    std::size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+      m_wait.wait_for([this, head] {
+        return head != m_tail.load() || m_closed.load();
+      });
+      if (head == m_tail.load()) {
+        return false;
+      }
+    }
+    element = std::move(m_ring[head]);
+    m_head.store((head + 1) % m_ring.size());
+    m_wait.notify();
+    return true;
+  }
+
+  /** Wake up both sides; pop() still returns the remaining elements. */
+  void close() {
+    m_closed.store(true);
+    m_wait.notify();
+  }
+
+private:
+  std::vector<Element> m_ring;
+  std::atomic<std::size_t> m_head;
+  std::atomic<std::size_t> m_tail;
+  std::atomic<bool> m_closed;
+  WaitCondition m_wait;
+};
+
+#endif
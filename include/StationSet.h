@@ -0,0 +1,110 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_STATIONSET_H
+#define SOFTFM_STATIONSET_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DataBuffer.h"
+#include "DecoderPool.h"
+#include "PolyphaseChannelizer.h"
+#include "SoftFM.h"
+
+/**
+ * Decode several stations from one capture.
+ *
+ * The band is split by a PolyphaseChannelizer into the largest number of
+ * channels into which all stations fit, which gives the lowest channel
+ * sample rate for the decoders. The stations are decoded in parallel by a
+ * DecoderPool, and the audio of each station goes to its own buffer.
+ */
+class StationSet {
+public:
+  /**
+   * Construct the channelizer and a decoder for each station.
+   *
+   * sample_rate_if  :: IQ sample rate of the capture in Hz
+   * tuner_freq      :: center frequency of the capture in Hz
+   * station_freqs   :: frequencies of the stations in Hz
+   * sample_rate_pcm :: audio sample rate in Hz
+   * stereo          :: true to enable stereo decoding
+   * deemphasis      :: time constant of de-emphasis filter in microseconds
+   * bandwidth_pcm   :: half bandwidth of audio signal in Hz
+   * pilot_shift     :: true to shift pilot phase
+   * pipeline        :: true to run the baseband stages of each decoder in
+   *                    a second thread
+   * nworkers        :: number of scheduler workers, or 0 for one thread
+   *                    per station
+   * lag_policy      :: handling of a station thread which falls behind
+   * cpus            :: CPUs assigned in turn to the station threads, or to
+   *                    the workers; empty to run on any CPU
+   *
+   * Check operator bool afterwards; all stations must lie within the
+   * capture, away from its edges.
+   */
+  StationSet(double sample_rate_if, double tuner_freq,
+             const std::vector<double> &station_freqs,
+             unsigned int sample_rate_pcm, bool stereo, double deemphasis,
+             double bandwidth_pcm, bool pilot_shift, bool pipeline,
+             unsigned int nworkers, DecoderPool::LagPolicy lag_policy,
+             const std::vector<int> &cpus);
+
+  /** Print the channel of each station. */
+  void print_parms() const;
+
+  /** Return number of stations. */
+  std::size_t num_stations() const { return m_freqs.size(); }
+
+  /** Split a block into the station channels and queue it for decoding. */
+  void process(const IQSampleVector &samples_in);
+
+  /** Return the audio buffer of a station. */
+  DataBuffer<Sample> &output(std::size_t station) {
+    return m_pool->output(station);
+  }
+
+  /** Return a one-line status with the IF level of each station. */
+  std::string status() const;
+
+  /**
+   * Decode all queued blocks, mark the end of the audio buffers and
+   * print the statistics of the pool.
+   */
+  void finish();
+
+  /** Return true if the set is OK, return false if there is an error. */
+  operator bool() const { return m_error.empty(); }
+
+  /** Return the last error, or return an empty string. */
+  const std::string &error() const { return m_error; }
+
+private:
+  const double m_sample_rate_if;
+  const std::vector<double> m_freqs;
+  unsigned int m_nchannels;
+  unsigned int m_downsample;
+  std::vector<unsigned int> m_channels;
+  std::vector<double> m_residuals;
+  std::unique_ptr<PolyphaseChannelizer> m_channelizer;
+  std::unique_ptr<DecoderPool> m_pool;
+  std::string m_error;
+};
+
+#endif
@@ -0,0 +1,106 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_TEEAUDIOOUTPUT_H
+#define SOFTFM_TEEAUDIOOUTPUT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioOutput.h"
+#include "SoftFM.h"
+
+/**
+ * Write audio data to several outputs (sinks) at once.
+ *
+ * Each sink has its own bounded queue and thread, so that a slow or
+ * blocked sink stalls neither the caller nor the other sinks. When the
+ * queue of a sink is full, blocks for that sink are dropped, and a warning
+ * is printed at most every drop_report_interval seconds and at the end.
+ * write() returns false if a sink failed since the previous call, and
+ * error() then describes only these new failures.
+ *
+ * Samples are encoded once per distinct sample format, with the dither
+ * state of the first sink of that format, and the encoded data is shared
+ * between the sinks.
+ */
+class TeeAudioOutput : public AudioOutput {
+public:
+  /** Default queue length of each sink in blocks. */
+  static constexpr unsigned int default_queue_blocks = 64;
+
+  /** Minimum time between warnings about dropped blocks in seconds. */
+  static constexpr double drop_report_interval = 10.0;
+
+  /**
+   * Construct tee without sinks.
+   *
+   * queue_blocks :: maximum number of queued blocks per sink
+   */
+  explicit TeeAudioOutput(unsigned int queue_blocks = default_queue_blocks);
+
+  /** Destructor; writes all queued data before returning. */
+  ~TeeAudioOutput();
+
+  /**
+   * Add a sink and start its thread.
+   *
+   * sink :: output stream; the tee takes ownership
+   * name :: name of the sink in error messages
+   */
+  void add_sink(AudioOutput *sink, const std::string &name);
+
+  bool write(const SampleVector &samples);
+
+  /** Not supported; the sinks may have different sample formats. */
+  bool write_bytes(const std::uint8_t *data, std::size_t n);
+
+  void set_dither(DitherMode mode, unsigned int nchannels);
+
+private:
+  typedef std::shared_ptr<const std::vector<std::uint8_t>> Block;
+
+  struct Sink {
+    std::unique_ptr<AudioOutput> output;
+    std::string name;
+    std::size_t encoder;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Block> queue;
+    std::uint64_t dropped;
+    std::uint64_t dropped_reported;
+    double drop_report_time;
+    std::string error;
+    bool stop;
+    std::thread thread;
+  };
+
+  /** Sink thread. */
+  static void run(Sink *sink);
+
+  const unsigned int m_queue_blocks;
+  std::vector<std::unique_ptr<Sink>> m_sinks;
+  std::vector<Block> m_blocks;
+};
+
+#endif
@@ -0,0 +1,155 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_UDPSOURCE_H
+#define SOFTFM_UDPSOURCE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Source.h"
+
+/**
+ * Receive IQ samples as sequenced UDP datagrams, unicast or multicast.
+ *
+ * Each datagram starts with a 32-bit big-endian sequence number, followed
+ * by interleaved I/Q samples in the configured format. All datagrams of a
+ * stream carry the same number of samples. Datagrams arriving out of order
+ * are put back in order within a window; missing datagrams are replaced by
+ * the same number of concealment samples, so that the decoder timing stays
+ * consistent.
+ */
+class UdpSource : public Source {
+public:
+  static const int default_block_length = 65536;
+  static const int default_port = 5004;
+  static const int default_reorder_window = 16;
+
+  /** Sample format of the datagram payload. */
+  enum PayloadFormat { PAYLOAD_U8, PAYLOAD_S16_LE, PAYLOAD_F32_LE };
+
+  /** Replacement of missing datagrams. */
+  enum ConcealMode { CONCEAL_ZERO, CONCEAL_INTERP };
+
+  /** Datagram statistics. */
+  struct Stats {
+    std::uint64_t received;   // datagrams delivered in order
+    std::uint64_t reordered;  // datagrams held back in the window
+    std::uint64_t lost;       // datagrams replaced by concealment
+    std::uint64_t late;       // datagrams arriving after concealment
+    std::uint64_t duplicates; // datagrams received twice
+    std::uint64_t invalid;    // datagrams with a bad length
+    std::uint64_t resyncs;    // jumps of the sequence number
+  };
+
+  /** Construct unbound source; configure() opens the socket. */
+  UdpSource(int dev_index);
+
+  /** Close socket. */
+  virtual ~UdpSource();
+
+  virtual bool configure(std::string configuration);
+
+  /** Return current sample frequency in Hz. */
+  virtual std::uint32_t get_sample_rate();
+
+  /** Return device current center frequency in Hz. */
+  virtual std::uint32_t get_frequency();
+
+  /** Print current parameters specific to device type */
+  virtual void print_specific_parms();
+
+  virtual bool start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag);
+
+  /** Stop receiving and print statistics. */
+  virtual bool stop();
+
+  /**
+   * Tune to another station within the stream; the center frequency
+   * of the stream does not change.
+   */
+  virtual bool retune(std::uint32_t frequency, std::string &error);
+
+  /** Return true if the device is OK, return false if there is an error. */
+  virtual operator bool() const { return m_error.empty(); }
+
+  /** Return datagram statistics (valid after stop()). */
+  const Stats &stats() const { return m_stats; }
+
+  /** Return a list of supported devices. */
+  static void get_device_names(std::vector<std::string> &devices);
+
+private:
+  /** Open and bind the socket, join a multicast group if needed. */
+  bool open_socket(const std::string &addr, const std::string &port,
+                   const std::string &iface, int rcvbuf);
+
+  /** Return the size of one I/Q pair in the payload in bytes. */
+  std::size_t sample_bytes() const;
+
+  /** Handle one datagram. */
+  void receive_datagram(const std::uint8_t *data, std::size_t len);
+
+  /** Deliver queued datagrams up to (not including) sequence number end. */
+  void deliver_until(std::uint32_t end);
+
+  /** Append the payload of a datagram to the output block. */
+  void append_payload(const std::uint8_t *data, std::size_t nsample);
+
+  /**
+   * Append concealment for missing datagrams.
+   *
+   * ndatagram :: number of missing datagrams
+   * next      :: first sample after the gap, or NULL if unknown
+   */
+  void append_concealment(std::uint32_t ndatagram, const IQSample *next);
+
+  /** Return the first sample of a queued datagram. */
+  IQSample first_sample(const std::vector<std::uint8_t> &payload) const;
+
+  /** Push the output block to the buffer. */
+  void flush_output();
+
+  /** Receive thread. */
+  void run();
+
+  int m_fd;
+  std::string m_addr;
+  bool m_multicast;
+  int m_rcvbuf;
+  std::uint32_t m_sample_rate;
+  std::uint32_t m_frequency;
+  PayloadFormat m_format;
+  ConcealMode m_conceal;
+  unsigned int m_window;
+  int m_block_length;
+  std::thread *m_thread;
+
+  // Receive thread state.
+  bool m_started;
+  std::uint32_t m_next_seq;
+  std::size_t m_datagram_samples;
+  std::map<std::uint32_t, std::vector<std::uint8_t>> m_pending;
+  IQSample m_last_sample;
+  IQSampleVector m_output;
+  Stats m_stats;
+};
+
+#endif
@@ -0,0 +1,71 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_WAITCONDITION_H
+#define SOFTFM_WAITCONDITION_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+/**
+ * Sleep and wake-up for buffers with lock-free positions.
+ *
+ * A thread which can not go on sleeps in wait_for() until its predicate
+ * holds; the other side calls notify() after each change of a position.
+ * notify() only takes the mutex if a thread is sleeping, so it costs a
+ * single atomic load as long as nobody waits.
+ *
+ * The predicate must only depend on atomics which are stored with
+ * sequentially consistent ordering before notify() is called.
+ */
+class WaitCondition {
+public:
+  WaitCondition() : m_waiters(0) {}
+
+  /** Sleep until ready() returns true. */
+  template <class Predicate> void wait_for(Predicate ready) {
+    if (ready()) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_waiters.fetch_add(1);
+    while (!ready()) {
+      m_cond.wait(lock);
+    }
+    m_waiters.fetch_sub(1);
+  }
+
+  /** Wake up sleeping threads, if any. */
+  void notify() {
+    // The position stores and m_waiters are sequentially consistent, so
+    // either the sleeper sees the new position or we see the sleeper.
+    // Taking the mutex then orders the notification after it went to
+    // sleep.
+    if (m_waiters.load() > 0) {
+      { std::lock_guard<std::mutex> lock(m_mutex); }
+      m_cond.notify_all();
+    }
+  }
+
+private:
+  std::atomic<int> m_waiters;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+};
+
+#endif
@@ -0,0 +1,135 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_WORKSTEALINGSCHEDULER_H
+#define SOFTFM_WORKSTEALINGSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Run tasks on a fixed number of worker threads with work stealing.
+ *
+ * Tasks are submitted to strands. The tasks of one strand run one at a
+ * time in submission order, possibly on different workers; tasks of
+ * different strands run in parallel. A strand with pending tasks is
+ * queued on the deque of its home worker, which takes strands from the
+ * front, runs one task and queues the strand again at the back if it has
+ * more tasks. An idle worker steals a strand from the back of the deque
+ * of another worker, and keeps it until the strand runs out of tasks.
+ *
+ * Each deque and each strand has its own lock; the scheduler lock is
+ * only taken to put idle workers to sleep and to wake them up.
+ */
+class WorkStealingScheduler {
+public:
+  typedef std::function<void()> Task;
+
+  /** Statistics of one worker. */
+  struct WorkerStats {
+    std::uint64_t tasks;       // tasks run
+    std::uint64_t steals;      // strands taken from other workers
+    std::uint64_t idle_waits;  // times the worker went to sleep
+    std::uint64_t depth_sum;   // sum of the own deque length at each task
+    std::size_t depth_max;     // maximum own deque length
+  };
+
+  /**
+   * Construct scheduler and start the workers.
+   *
+   * nworkers     :: number of worker threads (at least 1)
+   * strand_limit :: maximum number of pending tasks per strand;
+   *                 submit() waits while a strand has this many
+   */
+  WorkStealingScheduler(unsigned int nworkers, unsigned int strand_limit);
+
+  /** Destructor; runs all pending tasks before returning. */
+  ~WorkStealingScheduler();
+
+  /** Return number of workers. */
+  unsigned int num_workers() const { return m_workers.size(); }
+
+  /**
+   * Bind a worker thread to a CPU.
+   *
+   * Return false and set the error message if that fails.
+   */
+  bool bind_worker(unsigned int worker, int cpu);
+
+  /** Add a strand and return its index. */
+  std::size_t add_strand();
+
+  /** Queue a task on a strand. */
+  void submit(std::size_t strand, Task &&task);
+
+  /** Run all pending tasks and stop the workers. */
+  void finish();
+
+  /** Return statistics of a worker (consistent after finish()). */
+  WorkerStats stats(unsigned int worker);
+
+  /** Return the largest number of pending tasks seen on any strand. */
+  std::size_t max_strand_depth();
+
+  /** Return the last error, or an empty string. */
+  const std::string &error() const { return m_error; }
+
+private:
+  struct Strand {
+    unsigned int home;
+    std::mutex mutex;
+    std::condition_variable space;
+    std::deque<Task> tasks;
+    bool queued; // on a worker deque or running
+    std::size_t depth_max;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Strand *> deque;
+    WorkerStats stats;
+    std::thread thread;
+  };
+
+  /** Queue a strand on a worker deque and wake up an idle worker. */
+  void push_strand(unsigned int worker, Strand *strand);
+
+  /** Take a strand from the own deque or steal one; NULL if none. */
+  Strand *take_strand(unsigned int self);
+
+  /** Worker thread. */
+  void run(unsigned int self);
+
+  const unsigned int m_strand_limit;
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::vector<std::unique_ptr<Strand>> m_strands;
+  std::atomic<std::size_t> m_queued; // strands on all deques
+  bool m_stop;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::string m_error;
+};
+
+#endif
@@ -72,7 +72,7 @@ struct key_value_sequence : qi::grammar<Iterator, pairs_type()> {
     query = pair >> *((qi::lit(',') | '&') >> pair);
     pair = key >> -('=' >> value);
     key = qi::char_("a-zA-Z_") >> *qi::char_("a-zA-Z_0-9");
-    value = +qi::char_("a-zA-Z_0-9.");
+    value = +(qi::char_("a-zA-Z_0-9.:") | qi::char_('-'));
   }
 
   qi::rule<Iterator, pairs_type()> query;
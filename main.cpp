@@ -19,6 +19,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <climits>
 #include <cmath>
 #include <csignal>
@@ -27,40 +28,53 @@
 #include <cstring>
 #include <getopt.h>
 #include <memory>
+#include <sched.h>
+#include <sstream>
 #include <sys/time.h>
 #include <thread>
+#include <time.h>
 #include <unistd.h>
 
 #include "AudioOutput.h"
+#include "BandScanner.h"
+#include "CommandHandler.h"
+#include "ControlServer.h"
 #include "DataBuffer.h"
+#include "DecoderPool.h"
 #include "FmDecode.h"
+#include "LatencyHistogram.h"
+#include "MetricsServer.h"
 #include "MovingAverage.h"
+#include "RotatingAudioOutput.h"
+#include "SocketAudioOutput.h"
 #include "SoftFM.h"
+#include "StationSet.h"
+#include "TeeAudioOutput.h"
 #include "util.h"
 
 #include "AirspySource.h"
 #include "HackRFSource.h"
 #include "RtlSdrSource.h"
+#include "RtlTcpSource.h"
+#include "UdpSource.h"
 
 #define NGSOFTFM_VERSION "0.1.14"
 
 /** Flag is set on SIGINT / SIGTERM. */
 static std::atomic_bool stop_flag(false);
 
-/** Simple linear gain adjustment. */
-void adjust_gain(SampleVector &samples, double gain) {
-  for (unsigned int i = 0, n = samples.size(); i < n; i++) {
-    samples[i] *= gain;
-  }
-}
+/** Flag is set on SIGUSR1 to request a latency report. */
+static std::atomic_bool report_flag(false);
 
 /**
  * Get data from output buffer and write to output stream.
+ * If latency is not NULL, record the time from the time stamp of each
+ * block until it is written.
  *
  * This code runs in a separate thread.
  */
 void write_output_data(AudioOutput *output, DataBuffer<Sample> *buf,
-                       unsigned int buf_minfill) {
+                       unsigned int buf_minfill, LatencyHistogram *latency) {
   while (!stop_flag.load()) {
 
     if (buf->queued_samples() == 0) {
@@ -77,12 +91,36 @@ void write_output_data(AudioOutput *output, DataBuffer<Sample> *buf,
     }
 
     // Get samples from buffer and write to output.
-    SampleVector samples = buf->pull();
+    double timestamp;
+    SampleVector samples = buf->pull(timestamp);
     output->write(samples);
     if (!(*output)) {
       fprintf(stderr, "ERROR: AudioOutput: %s\n", output->error().c_str());
     }
+    if (latency != NULL && timestamp > 0) {
+      latency->record(monotonic_time() - timestamp);
+    }
+  }
+}
+
+/**
+ * Read commands from stdin, one per line, and queue the words of each
+ * command for the main loop.
+ *
+ * This code runs in a separate thread.
+ */
+static void read_commands(std::shared_ptr<DataBuffer<std::string>> commands) {
+  char line[256];
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    std::vector<std::string> words;
+    std::istringstream ss(line);
+    std::string word;
+    while (ss >> word) {
+      words.push_back(word);
+    }
+    commands->push(std::move(words));
   }
+  commands->push_end();
 }
 
 /** Handle Ctrl-C and SIGTERM. */
@@ -98,6 +136,9 @@ static void handle_sigterm(int sig) {
   size++; // dummy
 }
 
+/** Handle SIGUSR1. */
+static void handle_sigusr1(int) { report_flag.store(true); }
+
 void usage() {
   fprintf(
       stderr,
@@ -106,22 +147,79 @@ void usage() {
       "                   - rtlsdr: RTL-SDR devices\n"
       "                   - hackrf: HackRF One or Jawbreaker\n"
       "                   - airspy: Airspy\n"
+      "                   - rtltcp: rtl_tcp server on the network\n"
+      "                   - udp: sequenced UDP IQ stream (unicast or "
+      "multicast)\n"
       "  -c config      Comma separated key=value configuration pairs or just "
       "key for switches\n"
       "                 See below for valid values per device type\n"
       "  -d devidx      Device index, 'list' to show device list (default 0)\n"
       "  -r pcmrate     Audio sample rate in Hz (default 48000 Hz)\n"
       "  -M             Disable stereo decoding\n"
-      "  -R filename    Write audio data as raw S16_LE samples\n"
+      "  -R filename    Write audio data as raw samples (see -F)\n"
       "                 use filename '-' to write to stdout\n"
-      "  -W filename    Write audio data to .WAV file\n"
+      "                 (-R, -W, -P and -N can be combined and repeated\n"
+      "                 to write to several outputs at once)\n"
+      "  -W filename    Write audio data to .WAV file (RF64 beyond 4 GB)\n"
+      "                 use filename '-' to write a streaming .WAV to stdout\n"
+      "  -S seconds     Split -R/-W output into files of this length,\n"
+      "                 aligned to the wall clock; strftime() conversions\n"
+      "                 in the filename are replaced by the start time,\n"
+      "                 otherwise a segment number is appended\n"
+      "  -A             Move -S file boundaries to the nearest pilot PPS\n"
+      "  -O             Write -R/-W files with O_DIRECT (bypass page cache)\n"
       "  -P [device]    Play audio via ALSA device (default 'default')\n"
+      "  -N address     Serve raw samples (see -F) to local clients on\n"
+      "                 a Unix socket ('unix:path' or a path with '/')\n"
+      "                 or on a TCP port ('[host:]port', default host\n"
+      "                 127.0.0.1); clients falling behind are dropped\n"
+      "  -m freqs       Decode several stations from one capture, given as\n"
+      "                 comma separated frequencies in Hz (k/M/G suffixes\n"
+      "                 allowed); -c freq= sets the center of the band.\n"
+      "                 Each -R/-W filename gets the station frequency\n"
+      "                 inserted before its extension\n"
+      "  -C             Read commands from stdin, one per line:\n"
+      "                   - freq <Hz>: retune to another station\n"
+      "                   - gain <dB>|auto: set the tuner gain\n"
+      "                     (RTL-SDR and rtl_tcp only)\n"
+      "                   - mute on|off: silence the audio output\n"
+      "                   - stereo on|off: switch stereo output\n"
+      "  -k path        Accept the commands of -C on a Unix socket, and\n"
+      "                 answer 'status' with the decoder state; every\n"
+      "                 command gets one line of JSON in reply\n"
+      "  -e address     Serve metrics in Prometheus format over HTTP on\n"
+      "                 '[host:]port' (default host 127.0.0.1)\n"
+      "  -s [lo,hi]     Scan the band from lo to hi Hz (k/M/G suffixes\n"
+      "                 allowed, default 76M,108M) and print the stations\n"
+      "                 found instead of decoding; -c sets the device\n"
+      "                 parameters except freq\n"
+      "  -p             Run the baseband stages of each decoder in a\n"
+      "                 second thread (adds one block of audio delay)\n"
+      "  -K cpus        Run the decoder of each -m station in a thread on\n"
+      "                 its own CPU, given as comma separated CPU numbers\n"
+      "                 assigned to the stations in turn (to the workers\n"
+      "                 with -j)\n"
+      "  -j workers     Decode the -m stations on this many worker threads\n"
+      "                 with work stealing instead of one thread each\n"
+      "  -L policy      What the thread of a -m station does when it falls\n"
+      "                 8 blocks behind the capture (not with -j):\n"
+      "                   - wait: hold back the capture (default)\n"
+      "                   - drop: skip the blocks it missed\n"
       "  -T filename    Write pulse-per-second timestamps\n"
       "                 use filename '-' to write to stdout\n"
       "  -b seconds     Set audio buffer size in seconds\n"
       "  -X             Shift pilot phase (for Quadrature Multipath Monitor)\n"
       "                 (-X is ignored under mono mode (-M))\n"
       "  -U             Set deemphasis to 75 microseconds (default: 50)\n"
+      "  -F format      Audio sample format:\n"
+      "                   - s16: signed 16-bit integer (default)\n"
+      "                   - s24: signed 24-bit integer, 3 bytes\n"
+      "                   - s32: signed 32-bit integer\n"
+      "                   - float: 32-bit IEEE float\n"
+      "  -D dither      Dither mode for 16-bit output:\n"
+      "                   - none: plain rounding (default)\n"
+      "                   - tpdf: triangular PDF dither\n"
+      "                   - shaped: TPDF dither with noise shaping\n"
       "\n"
       "Configuration options for RTL-SDR devices\n"
       "  freq=<int>     Frequency of radio station in Hz (default 100000000)\n"
@@ -135,6 +233,9 @@ void usage() {
       "  blklen=<int>   Set audio buffer size in seconds (default RTL-SDR "
       "default)\n"
       "  agc            Enable RTL AGC mode (default disabled)\n"
+      "  async          Stream with queued USB transfers of blklen samples\n"
+      "                 (default one synchronous read at a time)\n"
+      "  bufnum=<int>   Number of queued transfers in async mode (default 15)\n"
       "\n"
       "Configuration options for HackRF devices\n"
       "  freq=<int>     Frequency of radio station in Hz (default 100000000)\n"
@@ -166,6 +267,33 @@ void usage() {
       "  antbias        Enable antemma bias (default disabled)\n"
       "  lagc           Enable LNA AGC (default disabled)\n"
       "  magc           Enable mixer AGC (default disabled)\n"
+      "\n"
+      "Configuration options for rtl_tcp servers\n"
+      "  host=<str>     Server host name or address (default 127.0.0.1)\n"
+      "  port=<int>     Server TCP port (default 1234)\n"
+      "  freq=<int>     Frequency of radio station in Hz (default 100000000)\n"
+      "                 valid values: 10M to 2.2G\n"
+      "  srate=<int>    IF sample rate in Hz (default 1000000)\n"
+      "                 (valid ranges: [225001, 300000], [900001, 3200000]))\n"
+      "  gain=<float>   Set LNA gain in dB, or 'auto' (default auto)\n"
+      "  ppm=<int>      Frequency correction in ppm (default 0)\n"
+      "  blklen=<int>   Samples per block, multiple of 4096 (default 65536)\n"
+      "  agc            Enable RTL AGC mode (default disabled)\n"
+      "\n"
+      "Configuration options for UDP IQ streams\n"
+      "  (each datagram: 32-bit big-endian sequence number, then I/Q pairs)\n"
+      "  addr=<str>     Local or multicast group address (default 0.0.0.0)\n"
+      "  port=<int>     UDP port (default 5004)\n"
+      "  iface=<str>    Network interface for multicast (default any)\n"
+      "  freq=<int>     Frequency of radio station in Hz (default 100000000)\n"
+      "  center=<int>   Center frequency of the stream in Hz (default freq)\n"
+      "  srate=<int>    IF sample rate in Hz (default 1000000)\n"
+      "  fmt=<str>      Sample format: u8, s16 or f32 (default s16)\n"
+      "  window=<int>   Reorder window in datagrams (default 16)\n"
+      "  conceal=<str>  Replace lost datagrams with 'zero' or 'interp'olated\n"
+      "                 samples (default interp)\n"
+      "  rcvbuf=<int>   Socket receive buffer in bytes (default 8388608)\n"
+      "  blklen=<int>   Samples per block (default 65536)\n"
       "\n");
 }
 
@@ -192,6 +320,58 @@ bool parse_int(const char *s, int &v, bool allow_unit = false) {
   return true;
 }
 
+/** Parse a comma separated list of frequencies. */
+static bool parse_freq_list(const char *s, std::vector<double> &freqs) {
+  std::string list(s);
+  std::size_t pos = 0;
+  for (;;) {
+    std::size_t comma = list.find(',', pos);
+    std::string item = list.substr(pos, comma - pos);
+    double f;
+    if (!parse_dbl(item.c_str(), f) || f <= 0) {
+      return false;
+    }
+    freqs.push_back(f);
+    if (comma == std::string::npos) {
+      return true;
+    }
+    pos = comma + 1;
+  }
+}
+
+/** Parse a comma separated list of CPU numbers. */
+static bool parse_cpu_list(const char *s, std::vector<int> &cpus) {
+  std::string list(s);
+  std::size_t pos = 0;
+  for (;;) {
+    std::size_t comma = list.find(',', pos);
+    std::string item = list.substr(pos, comma - pos);
+    int cpu;
+    if (!parse_int(item.c_str(), cpu) || cpu < 0 || cpu >= CPU_SETSIZE) {
+      return false;
+    }
+    cpus.push_back(cpu);
+    if (comma == std::string::npos) {
+      return true;
+    }
+    pos = comma + 1;
+  }
+}
+
+/** Return filename with a station frequency inserted before the extension. */
+static std::string station_filename(const std::string &name, double freq) {
+  char tag[32];
+  snprintf(tag, sizeof(tag), "-%.3fMHz", freq * 1.0e-6);
+
+  std::size_t slash = name.rfind('/');
+  std::size_t base = (slash == std::string::npos) ? 0 : slash + 1;
+  std::size_t dot = name.rfind('.');
+  if (dot == std::string::npos || dot <= base) {
+    return name + tag;
+  }
+  return name.substr(0, dot) + tag + name.substr(dot);
+}
+
 /** Return Unix time stamp in seconds. */
 double get_time() {
   struct timeval tv;
@@ -199,6 +379,15 @@ double get_time() {
   return tv.tv_sec + 1.0e-6 * tv.tv_usec;
 }
 
+/** Return CPU time used by all threads of the process in seconds. */
+static double get_process_cpu_time() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) {
+    return 0;
+  }
+  return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
 static bool get_device(std::vector<std::string> &devnames, std::string &devtype,
                        Source **srcsdr, int devidx) {
   if (strcasecmp(devtype.c_str(), "rtlsdr") == 0) {
@@ -207,11 +396,15 @@ static bool get_device(std::vector<std::string> &devnames, std::string &devtype,
     HackRFSource::get_device_names(devnames);
   } else if (strcasecmp(devtype.c_str(), "airspy") == 0) {
     AirspySource::get_device_names(devnames);
+  } else if (strcasecmp(devtype.c_str(), "rtltcp") == 0) {
+    RtlTcpSource::get_device_names(devnames);
+  } else if (strcasecmp(devtype.c_str(), "udp") == 0) {
+    UdpSource::get_device_names(devnames);
   } else {
     fprintf(
         stderr,
         "ERROR: wrong device type (-t option) must be one of the following:\n");
-    fprintf(stderr, "       rtlsdr, hackrf, airspy\n");
+    fprintf(stderr, "       rtlsdr, hackrf, airspy, rtltcp, udp\n");
     return false;
   }
 
@@ -240,11 +433,138 @@ static bool get_device(std::vector<std::string> &devnames, std::string &devtype,
   } else if (strcasecmp(devtype.c_str(), "airspy") == 0) {
     // Open Airspy device.
     *srcsdr = new AirspySource(devidx);
+  } else if (strcasecmp(devtype.c_str(), "rtltcp") == 0) {
+    // Connect to rtl_tcp server when configured.
+    *srcsdr = new RtlTcpSource(devidx);
+  } else if (strcasecmp(devtype.c_str(), "udp") == 0) {
+    // Open UDP socket when configured.
+    *srcsdr = new UdpSource(devidx);
   }
 
   return true;
 }
 
+/** Return source configuration with the freq key set to a frequency. */
+static std::string config_with_freq(const std::string &config, double freq) {
+  std::string result;
+  std::size_t pos = 0;
+  for (;;) {
+    std::size_t comma = config.find(',', pos);
+    std::string item = config.substr(pos, comma - pos);
+    if (!item.empty() && item != "freq" && item.compare(0, 5, "freq=") != 0) {
+      result += item + ",";
+    }
+    if (comma == std::string::npos) {
+      break;
+    }
+    pos = comma + 1;
+  }
+  return result + "freq=" + std::to_string(lrint(freq));
+}
+
+/**
+ * Step the source across a band and print the stations found to stdout.
+ *
+ * Each step captures BandScanner::burst_seconds of samples, after
+ * discarding those received while the tuner settles.
+ * Return false on error.
+ */
+static bool scan_band(Source *srcsdr, const std::string &config_str,
+                      double lo_freq, double hi_freq, bool quietmode) {
+  // Learn the sample rate and the offset at which the device tunes.
+  if (!srcsdr->configure(config_with_freq(config_str, lo_freq))) {
+    fprintf(stderr, "ERROR: configuration: %s\n", srcsdr->error().c_str());
+    return false;
+  }
+  double ifrate = srcsdr->get_sample_rate();
+  double tuner_shift = double(srcsdr->get_frequency()) -
+                       double(srcsdr->get_configured_frequency());
+
+  BandScanner scanner(ifrate);
+  double halfwidth = scanner.usable_halfwidth();
+  if (halfwidth <= 0) {
+    fprintf(stderr, "ERROR: IF sample rate too low for scanning\n");
+    return false;
+  }
+
+  std::size_t burst_samples = lrint(BandScanner::burst_seconds * ifrate);
+  std::size_t settle_samples = lrint(0.05 * ifrate);
+  fprintf(stderr, "scanning %.3f - %.3f MHz in steps of %.3f MHz\n",
+          lo_freq * 1.0e-6, hi_freq * 1.0e-6, 2 * halfwidth * 1.0e-6);
+
+  std::vector<BandScanner::Station> stations;
+  double t0 = get_time();
+  double step_lo = lo_freq;
+
+  while (step_lo < hi_freq && !stop_flag.load()) {
+    // Tune such that the usable band starts at step_lo.
+    double freq = step_lo + halfwidth - tuner_shift;
+    if (!srcsdr->configure(config_with_freq(config_str, freq))) {
+      fprintf(stderr, "ERROR: configuration: %s\n", srcsdr->error().c_str());
+      return false;
+    }
+    double center = srcsdr->get_frequency();
+    double step_hi = std::min(center + halfwidth, hi_freq);
+    if (step_hi <= step_lo || center - halfwidth > step_lo + 1) {
+      fprintf(stderr, "ERROR: source can not be tuned to %.3f MHz\n",
+              (step_lo + halfwidth) * 1.0e-6);
+      return false;
+    }
+
+    // Capture a burst.
+    DataBuffer<IQSample> buf;
+    std::atomic_bool step_stop(false);
+    if (!srcsdr->start(&buf, &step_stop)) {
+      fprintf(stderr, "ERROR: source: %s\n", srcsdr->error().c_str());
+      return false;
+    }
+
+    IQSampleVector samples;
+    std::size_t skipped = 0;
+    while (samples.size() < burst_samples && !stop_flag.load()) {
+      IQSampleVector block = buf.pull();
+      if (block.empty()) {
+        break;
+      }
+      std::size_t skip = std::min(settle_samples - skipped, block.size());
+      skipped += skip;
+      samples.insert(samples.end(), block.begin() + skip, block.end());
+    }
+
+    step_stop.store(true);
+    srcsdr->stop();
+
+    if (samples.size() < burst_samples && !stop_flag.load()) {
+      fprintf(stderr, "ERROR: source: stream ended at %.3f MHz\n",
+              center * 1.0e-6);
+      return false;
+    }
+
+    std::size_t nfound = stations.size();
+    scanner.process(samples, center, step_lo, step_hi, stations);
+
+    if (!quietmode) {
+      fprintf(stderr, "%.3f - %.3f MHz: %zu stations\n", step_lo * 1.0e-6,
+              step_hi * 1.0e-6, stations.size() - nfound);
+    }
+
+    step_lo = step_hi;
+  }
+
+  fprintf(stderr, "found %zu stations in %.1f seconds\n", stations.size(),
+          get_time() - t0);
+
+  printf("#freq_MHz  if_level_dB  snr_dB  mode    pilot\n");
+  for (const BandScanner::Station &st : stations) {
+    printf("%9.3f  %11.1f  %6.1f  %-6s  %5.3f\n", st.freq * 1.0e-6,
+           20 * log10(st.if_level), st.snr, st.stereo ? "stereo" : "mono",
+           std::max(0.0, st.pilot_level));
+  }
+  fflush(stdout);
+
+  return true;
+}
+
 // static constants in FmDecoder must be declared here
 // See
 // https://gcc.gnu.org/wiki/VerboseDiagnostics#missing_static_const_definition
@@ -262,21 +582,34 @@ int main(int argc, char **argv) {
   int devidx = 0;
   int pcmrate = 48000;
   bool stereo = true;
-  enum OutputMode { MODE_RAW, MODE_WAV, MODE_ALSA };
-#ifdef USE_ALSA
-  OutputMode outmode = MODE_ALSA;
-  std::string filename;
-#else  // !USE_ALSA
-  OutputMode outmode = MODE_RAW;
-  std::string filename("-");
-#endif // USE_ALSA
-  std::string alsadev("default");
+  enum OutputMode { MODE_RAW, MODE_WAV, MODE_ALSA, MODE_SOCKET };
+  struct OutputSpec {
+    OutputMode mode;
+    std::string name; // file name, ALSA device or socket address
+  };
+  std::vector<OutputSpec> outputs;
+  std::vector<double> station_freqs;
+  std::vector<int> station_cpus;
+  int station_workers = 0;
+  bool station_drop = false;
+  bool scan = false;
+  bool command_input = false;
+  std::string control_path;
+  std::string metrics_address;
+  double scan_lo = 76.0e6;
+  double scan_hi = 108.0e6;
   bool quietmode = false;
   std::string ppsfilename;
   FILE *ppsfile = NULL;
   double bufsecs = -1;
   bool pilot_shift = false;
   bool deemphasis_na = false;
+  AudioOutput::SampleFormat sample_format = AudioOutput::FORMAT_S16_LE;
+  AudioOutput::DitherMode dither = AudioOutput::DITHER_NONE;
+  double segment_secs = 0;
+  bool pps_align = false;
+  bool direct_io = false;
+  bool pipeline = false;
   std::string config_str;
   std::string devtype_str;
   std::vector<std::string> devnames;
@@ -292,11 +625,20 @@ int main(int argc, char **argv) {
       {"wav", 1, NULL, 'W'},     {"play", 2, NULL, 'P'},
       {"pps", 1, NULL, 'T'},     {"buffer", 1, NULL, 'b'},
       {"quiet", 1, NULL, 'q'},   {"pilotshift", 0, NULL, 'X'},
-      {"usa", 0, NULL, 'U'},     {NULL, 0, NULL, 0}};
+      {"usa", 0, NULL, 'U'},     {"dither", 1, NULL, 'D'},
+      {"format", 1, NULL, 'F'},  {"segment", 1, NULL, 'S'},
+      {"ppsalign", 0, NULL, 'A'}, {"direct", 0, NULL, 'O'},
+      {"serve", 1, NULL, 'N'},    {"stations", 1, NULL, 'm'},
+      {"affinity", 1, NULL, 'K'}, {"pipeline", 0, NULL, 'p'},
+      {"workers", 1, NULL, 'j'},  {"lag", 1, NULL, 'L'},
+      {"scan", 2, NULL, 's'},     {"commands", 0, NULL, 'C'},
+      {"control", 1, NULL, 'k'},  {"metrics", 1, NULL, 'e'},
+      {NULL, 0, NULL, 0}};
 
   int c, longindex;
-  while ((c = getopt_long(argc, argv, "t:c:d:r:MR:W:P::T:b:qXU", longopts,
-                          &longindex)) >= 0) {
+  while ((c = getopt_long(argc, argv,
+                          "t:c:d:r:MR:W:P::N:m:K:j:L:s::Ck:e:pT:b:qXUD:F:S:AO",
+                          longopts, &longindex)) >= 0) {
     switch (c) {
     case 't':
       devtype_str.assign(optarg);
@@ -318,17 +660,63 @@ int main(int argc, char **argv) {
       stereo = false;
       break;
     case 'R':
-      outmode = MODE_RAW;
-      filename = optarg;
+      outputs.push_back({MODE_RAW, optarg});
       break;
     case 'W':
-      outmode = MODE_WAV;
-      filename = optarg;
+      outputs.push_back({MODE_WAV, optarg});
       break;
     case 'P':
-      outmode = MODE_ALSA;
+      outputs.push_back({MODE_ALSA, (optarg != NULL) ? optarg : "default"});
+      break;
+    case 'N':
+      outputs.push_back({MODE_SOCKET, optarg});
+      break;
+    case 'm':
+      if (!parse_freq_list(optarg, station_freqs)) {
+        badarg("-m");
+      }
+      break;
+    case 's':
+      scan = true;
       if (optarg != NULL) {
-        alsadev = optarg;
+        std::vector<double> range;
+        if (!parse_freq_list(optarg, range) || range.size() != 2 ||
+            range[0] >= range[1]) {
+          badarg("-s");
+        }
+        scan_lo = range[0];
+        scan_hi = range[1];
+      }
+      break;
+    case 'C':
+      command_input = true;
+      break;
+    case 'k':
+      control_path = optarg;
+      break;
+    case 'e':
+      metrics_address = optarg;
+      break;
+    case 'p':
+      pipeline = true;
+      break;
+    case 'j':
+      if (!parse_int(optarg, station_workers) || station_workers < 1) {
+        badarg("-j");
+      }
+      break;
+    case 'L':
+      if (strcasecmp(optarg, "wait") == 0) {
+        station_drop = false;
+      } else if (strcasecmp(optarg, "drop") == 0) {
+        station_drop = true;
+      } else {
+        badarg("-L");
+      }
+      break;
+    case 'K':
+      if (!parse_cpu_list(optarg, station_cpus)) {
+        badarg("-K");
       }
       break;
     case 'T':
@@ -348,6 +736,41 @@ int main(int argc, char **argv) {
     case 'U':
       deemphasis_na = true;
       break;
+    case 'F':
+      if (strcasecmp(optarg, "s16") == 0) {
+        sample_format = AudioOutput::FORMAT_S16_LE;
+      } else if (strcasecmp(optarg, "s24") == 0) {
+        sample_format = AudioOutput::FORMAT_S24_3LE;
+      } else if (strcasecmp(optarg, "s32") == 0) {
+        sample_format = AudioOutput::FORMAT_S32_LE;
+      } else if (strcasecmp(optarg, "float") == 0) {
+        sample_format = AudioOutput::FORMAT_FLOAT_LE;
+      } else {
+        badarg("-F");
+      }
+      break;
+    case 'D':
+      if (strcasecmp(optarg, "none") == 0) {
+        dither = AudioOutput::DITHER_NONE;
+      } else if (strcasecmp(optarg, "tpdf") == 0) {
+        dither = AudioOutput::DITHER_TPDF;
+      } else if (strcasecmp(optarg, "shaped") == 0) {
+        dither = AudioOutput::DITHER_SHAPED;
+      } else {
+        badarg("-D");
+      }
+      break;
+    case 'S':
+      if (!parse_dbl(optarg, segment_secs) || segment_secs < 1) {
+        badarg("-S");
+      }
+      break;
+    case 'A':
+      pps_align = true;
+      break;
+    case 'O':
+      direct_io = true;
+      break;
     default:
       usage();
       fprintf(stderr, "ERROR: Invalid command line options\n");
@@ -361,6 +784,66 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
+  if (outputs.empty()) {
+#ifdef USE_ALSA
+    outputs.push_back({MODE_ALSA, "default"});
+#else  // !USE_ALSA
+    outputs.push_back({MODE_RAW, "-"});
+#endif // USE_ALSA
+  }
+
+  // Interactive output streams need a buffer; -S needs a file to split.
+  bool interactive_output = false;
+  bool file_output = false;
+  for (const OutputSpec &spec : outputs) {
+    if (spec.mode == MODE_ALSA ||
+        (spec.mode == MODE_RAW && spec.name == "-")) {
+      interactive_output = true;
+    }
+    if ((spec.mode == MODE_RAW || spec.mode == MODE_WAV) &&
+        spec.name != "-") {
+      file_output = true;
+    }
+  }
+
+  if (segment_secs > 0 && !file_output) {
+    usage();
+    fprintf(stderr, "ERROR: -S requires -R or -W with a filename\n");
+    exit(1);
+  }
+
+  // Every station of -m writes its own files.
+  if (!station_freqs.empty()) {
+    for (const OutputSpec &spec : outputs) {
+      if ((spec.mode != MODE_RAW && spec.mode != MODE_WAV) ||
+          spec.name == "-") {
+        usage();
+        fprintf(stderr, "ERROR: -m requires -R or -W with a filename\n");
+        exit(1);
+      }
+    }
+    if (!ppsfilename.empty() || pps_align) {
+      usage();
+      fprintf(stderr, "ERROR: -T and -A can not be used with -m\n");
+      exit(1);
+    }
+    if (scan || command_input || !control_path.empty() ||
+        !metrics_address.empty()) {
+      usage();
+      fprintf(stderr, "ERROR: -s, -C, -k and -e can not be used with -m\n");
+      exit(1);
+    }
+    if (station_drop && station_workers > 0) {
+      usage();
+      fprintf(stderr, "ERROR: -L drop can not be used with -j\n");
+      exit(1);
+    }
+  } else if (!station_cpus.empty() || station_workers > 0 || station_drop) {
+    usage();
+    fprintf(stderr, "ERROR: -K, -j and -L require -m\n");
+    exit(1);
+  }
+
   // Catch Ctrl-C and SIGTERM
   struct sigaction sigact;
   sigact.sa_handler = handle_sigterm;
@@ -377,6 +860,27 @@ int main(int argc, char **argv) {
             strerror(errno));
   }
 
+  // Report latencies on SIGUSR1.
+  sigact.sa_handler = handle_sigusr1;
+  sigact.sa_flags = SA_RESTART;
+  if (sigaction(SIGUSR1, &sigact, NULL) < 0) {
+    fprintf(stderr, "WARNING: can not install SIGUSR1 handler (%s)\n",
+            strerror(errno));
+  }
+
+  // Scan the band instead of decoding.
+  if (scan) {
+    if (!get_device(devnames, devtype_str, &srcsdr, devidx)) {
+      exit(1);
+    }
+    std::unique_ptr<Source> up_srcsdr(srcsdr);
+    if (!(*srcsdr)) {
+      fprintf(stderr, "ERROR source: %s\n", srcsdr->error().c_str());
+      exit(1);
+    }
+    exit(scan_band(srcsdr, config_str, scan_lo, scan_hi, quietmode) ? 0 : 1);
+  }
+
   // Open PPS file.
   if (!ppsfilename.empty()) {
     if (ppsfilename == "-") {
@@ -401,8 +905,7 @@ int main(int argc, char **argv) {
   // Calculate number of samples in audio buffer.
   unsigned int outputbuf_samples = 0;
 
-  if (bufsecs < 0 &&
-      (outmode == MODE_ALSA || (outmode == MODE_RAW && filename == "-"))) {
+  if (bufsecs < 0 && interactive_output) {
     // Set default buffer to 1 second for interactive output streams.
     outputbuf_samples = pcmrate;
   } else if (bufsecs > 0) {
@@ -415,33 +918,98 @@ int main(int argc, char **argv) {
             outputbuf_samples / double(pcmrate));
   }
 
-  // Prepare output writer.
-  std::unique_ptr<AudioOutput> audio_output;
+  // Prepare output writers.
+  std::vector<RotatingAudioOutput *> rotating_outputs;
 
-  switch (outmode) {
-  case MODE_RAW:
-    fprintf(stderr, "writing raw 16-bit audio samples to '%s'\n",
-            filename.c_str());
-    audio_output.reset(new RawAudioOutput(filename));
-    break;
-  case MODE_WAV:
-    fprintf(stderr, "writing audio samples to '%s'\n", filename.c_str());
-    audio_output.reset(new WavAudioOutput(filename, pcmrate, stereo));
-    break;
-  case MODE_ALSA:
+  auto open_output = [&](const OutputSpec &spec) -> AudioOutput * {
+    if (spec.mode == MODE_ALSA) {
 #ifdef USE_ALSA
-    fprintf(stderr, "playing audio to ALSA device '%s'\n", alsadev.c_str());
-    audio_output.reset(new AlsaAudioOutput(alsadev, pcmrate, stereo));
-    break;
+      fprintf(stderr, "playing audio to ALSA device '%s'\n",
+              spec.name.c_str());
+      return new AlsaAudioOutput(spec.name, pcmrate, stereo, sample_format);
 #else  // !USE_ALSA
-    fprintf(stderr, "ALSA not implemented\n");
-    exit(1);
+      fprintf(stderr, "ALSA not implemented\n");
+      exit(1);
 #endif // USE_ALSA
-  }
+    }
 
-  if (!(*audio_output)) {
-    fprintf(stderr, "ERROR: AudioOutput: %s\n", audio_output->error().c_str());
-    exit(1);
+    if (spec.mode == MODE_SOCKET) {
+      fprintf(stderr, "serving raw audio samples on '%s'\n",
+              spec.name.c_str());
+      return new SocketAudioOutput(spec.name, sample_format);
+    }
+
+    RotatingAudioOutput::Factory factory;
+    if (spec.mode == MODE_RAW) {
+      fprintf(stderr, "writing raw audio samples to '%s'\n",
+              spec.name.c_str());
+      factory = [sample_format, direct_io](const std::string &name) {
+        return new RawAudioOutput(name, sample_format, direct_io);
+      };
+    } else {
+      fprintf(stderr, "writing audio samples to '%s'\n", spec.name.c_str());
+      factory = [pcmrate, stereo, sample_format,
+                 direct_io](const std::string &name) {
+        return new WavAudioOutput(name, pcmrate, stereo, sample_format,
+                                  direct_io);
+      };
+    }
+
+    if (segment_secs > 0 && spec.name != "-") {
+      fprintf(stderr, "splitting '%s' into %.1f second segments\n",
+              spec.name.c_str(), segment_secs);
+      RotatingAudioOutput *rotating = new RotatingAudioOutput(
+          spec.name, pcmrate, stereo ? 2 : 1, sample_format, segment_secs,
+          true, factory);
+      rotating_outputs.push_back(rotating);
+      return rotating;
+    }
+    return factory(spec.name);
+  };
+
+  auto open_outputs = [&](const std::vector<OutputSpec> &specs) {
+    std::unique_ptr<AudioOutput> output;
+
+    if (specs.size() == 1) {
+      output.reset(open_output(specs[0]));
+    } else {
+      // Fan out to several outputs, each with its own queue and thread.
+      TeeAudioOutput *tee = new TeeAudioOutput();
+      output.reset(tee);
+      for (const OutputSpec &spec : specs) {
+        AudioOutput *out = open_output(spec);
+        if (!(*out)) {
+          fprintf(stderr, "ERROR: AudioOutput: %s\n", out->error().c_str());
+          delete out;
+          exit(1);
+        }
+        tee->add_sink(out, spec.name);
+      }
+    }
+
+    if (!(*output)) {
+      fprintf(stderr, "ERROR: AudioOutput: %s\n", output->error().c_str());
+      exit(1);
+    }
+
+    output->set_dither(dither, stereo ? 2 : 1);
+    return output;
+  };
+
+  // Every station of -m has its own outputs.
+  std::unique_ptr<AudioOutput> audio_output;
+  std::vector<std::unique_ptr<AudioOutput>> station_outputs;
+
+  if (station_freqs.empty()) {
+    audio_output = open_outputs(outputs);
+  } else {
+    for (double f : station_freqs) {
+      std::vector<OutputSpec> specs(outputs);
+      for (OutputSpec &spec : specs) {
+        spec.name = station_filename(spec.name, f);
+      }
+      station_outputs.push_back(open_outputs(specs));
+    }
   }
 
   if (!get_device(devnames, devtype_str, &srcsdr, devidx)) {
@@ -510,74 +1078,209 @@ int main(int argc, char **argv) {
   fprintf(stderr, "audio bandwidth:   %.3f kHz\n", bandwidth_pcm * 1.0e-3);
   fprintf(stderr, "deemphasis:        %.1f microseconds\n", deemphasis);
 
-  // Prepare decoder.
-  FmDecoder fm(ifrate,                          // sample_rate_if
-               freq - tuner_freq,               // tuning_offset
-               pcmrate,                         // sample_rate_pcm
-               stereo,                          // stereo
-               deemphasis,                      // deemphasis,
-               FmDecoder::default_bandwidth_if, // bandwidth_if
-               FmDecoder::default_freq_dev,     // freq_dev
-               bandwidth_pcm,                   // bandwidth_pcm
-               downsample,                      // downsample
-               pilot_shift);                    // pilot_shift
+  // Prepare decoder, unless the stations of -m have their own.
+  std::unique_ptr<FmDecoder> fm;
+  if (station_freqs.empty()) {
+    fm.reset(new FmDecoder(
+        ifrate,                          // sample_rate_if
+        freq - tuner_freq,               // tuning_offset
+        pcmrate,                         // sample_rate_pcm
+        stereo,                          // stereo
+        deemphasis,                      // deemphasis,
+        FmDecoder::default_bandwidth_if, // bandwidth_if
+        FmDecoder::default_freq_dev,     // freq_dev
+        bandwidth_pcm,                   // bandwidth_pcm
+        downsample,                      // downsample
+        pilot_shift,                     // pilot_shift
+        FmDecoder::default_audio_gain)); // audio_gain
+
+    if (pipeline) {
+      fm->start_pipeline();
+    }
+  }
+
+  // Split the band into channels for the stations of -m, and decode
+  // them in parallel.
+  std::unique_ptr<StationSet> stations;
+  std::vector<std::thread> station_writers;
+
+  if (!station_freqs.empty()) {
+    stations.reset(new StationSet(
+        ifrate, tuner_freq, station_freqs, pcmrate, stereo, deemphasis,
+        bandwidth_pcm, pilot_shift, pipeline, station_workers,
+        station_drop ? BroadcastBuffer<IQSampleVector>::LAG_DROP
+                     : BroadcastBuffer<IQSampleVector>::LAG_WAIT,
+        station_cpus));
+    if (!(*stations)) {
+      fprintf(stderr, "ERROR: %s\n", stations->error().c_str());
+      exit(1);
+    }
+    stations->print_parms();
+
+    unsigned int nchannel = stereo ? 2 : 1;
+    for (std::size_t i = 0; i < station_outputs.size(); i++) {
+      station_writers.push_back(
+          std::thread(write_output_data, station_outputs[i].get(),
+                      &stations->output(i), outputbuf_samples * nchannel,
+                      (LatencyHistogram *)NULL));
+    }
+  }
+
+  // Latency from the capture of each block until its audio is decoded,
+  // and until it is written to the output.
+  LatencyHistogram latency_decoded;
+  LatencyHistogram latency_written;
+  auto report_latency = [&]() {
+    fprintf(stderr, "latency capture->decoded: %s\n",
+            latency_decoded.summary().c_str());
+    fprintf(stderr, "latency capture->written: %s\n",
+            latency_written.summary().c_str());
+  };
 
   // If buffering enabled, start background output thread.
   DataBuffer<Sample> output_buffer;
   std::thread output_thread;
 
-  if (outputbuf_samples > 0) {
+  if (outputbuf_samples > 0 && audio_output) {
     unsigned int nchannel = stereo ? 2 : 1;
-    output_thread = std::thread(write_output_data, audio_output.get(),
-                                &output_buffer, outputbuf_samples * nchannel);
+    output_thread =
+        std::thread(write_output_data, audio_output.get(), &output_buffer,
+                    outputbuf_samples * nchannel, &latency_written);
   }
 
   SampleVector audiosamples;
   bool inbuf_length_warning = false;
-  double audio_level = 0;
   bool got_stereo = false;
+  std::uint64_t frames_written = 0;
 
   double block_time = get_time();
+  double prev_block_time = block_time;
+
+  std::unique_ptr<MetricsServer> metrics;
+  if (!metrics_address.empty()) {
+    metrics.reset(new MetricsServer(metrics_address));
+    if (!(*metrics)) {
+      fprintf(stderr, "ERROR: MetricsServer: %s\n", metrics->error().c_str());
+      exit(1);
+    }
+    metrics->set_frequency(freq);
+    fprintf(stderr, "metrics server:    %s\n", metrics_address.c_str());
+  }
+
+  // Run the commands from stdin and the control socket.
+  CommandHandler handler(up_srcsdr.get(), &source_buffer, fm.get(),
+                         metrics.get(), stereo);
+
+  // Start reading commands.
+  std::shared_ptr<DataBuffer<std::string>> commands;
+  if (command_input) {
+    commands = std::make_shared<DataBuffer<std::string>>();
+    // The thread may be blocked in fgets() at exit; it holds a reference
+    // to the queue and ends with the process.
+    std::thread(read_commands, commands).detach();
+    fprintf(stderr, "reading commands from stdin\n");
+  }
+
+  std::unique_ptr<ControlServer> control;
+  if (!control_path.empty()) {
+    control.reset(new ControlServer(control_path));
+    if (!(*control)) {
+      fprintf(stderr, "ERROR: ControlServer: %s\n", control->error().c_str());
+      exit(1);
+    }
+    fprintf(stderr, "control socket:    %s\n", control_path.c_str());
+  }
 
   // Main loop.
   for (unsigned int block = 0; !stop_flag.load(); block++) {
 
+    // Run commands between blocks.
+    bool ran_commands = false;
+    while (commands && commands->queued_samples() > 0) {
+      std::string msg;
+      bool ok = handler.run(commands->pull(), msg);
+      fprintf(stderr, "\n%s%s\n", ok ? "" : "ERROR: ", msg.c_str());
+      ran_commands = true;
+    }
+    ControlServer::Command cmd;
+    while (control && control->next_command(cmd)) {
+      std::string msg;
+      bool ok = handler.run(cmd.words, msg);
+      control->reply(cmd.client, ok, msg);
+      ran_commands = true;
+    }
+    if (ran_commands) {
+      freq = up_srcsdr->get_configured_frequency();
+      tuner_freq = up_srcsdr->get_frequency();
+      delta_if = tuner_freq - freq;
+    }
+
     // Check for overflow of source buffer.
     if (!inbuf_length_warning && source_buffer.queued_samples() > 10 * ifrate) {
       fprintf(stderr, "\nWARNING: Input buffer is growing (system too slow)\n");
       inbuf_length_warning = true;
     }
 
+    if (report_flag.exchange(false) && !stations) {
+      fprintf(stderr, "\n");
+      report_latency();
+    }
+
     // Pull next block from source buffer.
-    IQSampleVector iqsamples = source_buffer.pull();
+    double capture_time;
+    IQSampleVector iqsamples = source_buffer.pull(capture_time);
 
     if (iqsamples.empty()) {
       break;
     }
 
-    double prev_block_time = block_time;
+    double prev2_block_time = prev_block_time;
+    prev_block_time = block_time;
     block_time = get_time();
 
+    // Hand the block to the decoders of the -m stations.
+    if (stations) {
+      stations->process(iqsamples);
+      source_buffer.recycle(std::move(iqsamples));
+
+      if (!quietmode) {
+        fprintf(stderr, "\rblk=%6d:%s", block, stations->status().c_str());
+        fflush(stderr);
+      }
+      continue;
+    }
+
     // Decode FM signal.
-    fm.process(iqsamples, audiosamples);
+    // The decoder also sets the nominal audio volume.
+    std::chrono::steady_clock::time_point decode_start =
+        std::chrono::steady_clock::now();
+    fm->process(iqsamples, audiosamples, capture_time);
+    if (fm->get_capture_time() > 0) {
+      latency_decoded.record(monotonic_time() - fm->get_capture_time());
+    }
 
-    // Measure audio level.
-    double audio_mean, audio_rms;
-    samples_mean_rms(audiosamples, audio_mean, audio_rms);
-    audio_level = 0.95 * audio_level + 0.05 * audio_rms;
+    if (metrics) {
+      std::chrono::duration<double> decode_time =
+          std::chrono::steady_clock::now() - decode_start;
+      metrics->add_block(iqsamples.size(), decode_time.count());
+      metrics->set_input_queue(source_buffer.queued_samples());
+      metrics->set_output_queue(output_buffer.queued_samples());
+      metrics->set_if_level(fm->get_if_level());
+      metrics->set_pilot_locked(fm->stereo_detected());
+    }
 
-    // Set nominal audio volume.
-    adjust_gain(audiosamples, 0.5);
+    // Hand the block back to the source for reuse.
+    source_buffer.recycle(std::move(iqsamples));
 
     // the minus factor is to show the ppm correction
     // to make and not the one made
-    ppm_average.feed(((fm.get_tuning_offset() + delta_if) / tuner_freq) *
+    ppm_average.feed(((fm->get_tuning_offset() + delta_if) / tuner_freq) *
                      -1.0e6);
-    double ppm_error = (tuner_freq + fm.get_tuning_offset()) * 1.0e-6;
+    double ppm_error = (tuner_freq + fm->get_tuning_offset()) * 1.0e-6;
     double ppm_value_average = ppm_average.average();
-    double if_level_db = 20 * log10(fm.get_if_level());
-    double baseband_level_db = 20 * log10(fm.get_baseband_level()) + 3.01;
-    double audio_level_db = 20 * log10(audio_level) + 3.01;
+    double if_level_db = 20 * log10(fm->get_if_level());
+    double baseband_level_db = 20 * log10(fm->get_baseband_level()) + 3.01;
+    double audio_level_db = 20 * log10(fm->get_audio_level()) + 3.01;
 
     double buflen_sec;
     if (outputbuf_samples > 0) {
@@ -597,11 +1300,11 @@ int main(int argc, char **argv) {
               block, ppm_error, ppm_value_average, if_level_db,
               baseband_level_db, audio_level_db, buflen_sec);
       // Show stereo status.
-      if (fm.stereo_detected() != got_stereo) {
-        got_stereo = fm.stereo_detected();
+      if (fm->stereo_detected() != got_stereo) {
+        got_stereo = fm->stereo_detected();
         if (got_stereo) {
           fprintf(stderr, "\ngot stereo signal (pilot level = %f)\n",
-                  fm.get_pilot_level());
+                  fm->get_pilot_level());
         } else {
           fprintf(stderr, "\nlost stereo signal\n");
         }
@@ -609,11 +1312,36 @@ int main(int argc, char **argv) {
       fflush(stderr);
     }
 
+    // Publish the state for the control socket.
+    if (control) {
+      ControlServer::Telemetry t;
+      t.block = block;
+      t.freq = freq;
+      t.tuner_freq = tuner_freq;
+      t.ppm = ppm_value_average;
+      t.if_level = if_level_db;
+      t.baseband_level = baseband_level_db;
+      t.audio_level = audio_level_db;
+      t.pilot_level = fm->get_pilot_level();
+      t.stereo_detected = fm->stereo_detected();
+      t.stereo_output = stereo && fm->stereo_output();
+      t.muted = handler.muted();
+      t.input_buffer = source_buffer.queued_samples() / ifrate;
+      t.output_buffer = buflen_sec;
+      t.dropped_samples = handler.dropped_samples();
+      t.cpu_if = fm->get_if_cpu_time();
+      t.cpu_baseband = fm->get_baseband_cpu_time();
+      t.cpu_total = get_process_cpu_time();
+      control->publish(t);
+    }
+
     // Write PPS markers.
     if (ppsfile != NULL) {
-      for (const PilotPhaseLock::PpsEvent &ev : fm.get_pps_events()) {
-        double ts = prev_block_time;
-        ts += ev.block_position * (block_time - prev_block_time);
+      // A pipelined decoder returns the events of the block before.
+      double t0 = fm->pipelined() ? prev2_block_time : prev_block_time;
+      double t1 = fm->pipelined() ? prev_block_time : block_time;
+      for (const PilotPhaseLock::PpsEvent &ev : fm->get_pps_events()) {
+        double ts = t0 + ev.block_position * (t1 - t0);
         fprintf(ppsfile, "%8s %14s %18.6f\n",
                 std::to_string(ev.pps_index).c_str(),
                 std::to_string(ev.sample_index).c_str(), ts);
@@ -625,13 +1353,33 @@ int main(int argc, char **argv) {
     // They are noisy because IF filters are still starting up.
     // (Increased from one to support high sampling rates)
     if (block > 4) {
+      // Prefer PPS events as file boundaries.
+      unsigned int nchannel = stereo ? 2 : 1;
+      std::size_t nframes = audiosamples.size() / nchannel;
+      if (pps_align) {
+        for (const PilotPhaseLock::PpsEvent &ev : fm->get_pps_events()) {
+          for (RotatingAudioOutput *rotating : rotating_outputs) {
+            rotating->add_sync_point(
+                frames_written + std::llround(ev.block_position * nframes));
+          }
+        }
+      }
+      frames_written += nframes;
+
+      if (handler.muted()) {
+        std::fill(audiosamples.begin(), audiosamples.end(), 0);
+      }
+
       // Write samples to output.
       if (outputbuf_samples > 0) {
         // Buffered write.
-        output_buffer.push(move(audiosamples));
+        output_buffer.push(move(audiosamples), fm->get_capture_time());
       } else {
         // Direct write.
         audio_output->write(audiosamples);
+        if (fm->get_capture_time() > 0) {
+          latency_written.record(monotonic_time() - fm->get_capture_time());
+        }
       }
     }
   }
@@ -642,11 +1390,24 @@ int main(int argc, char **argv) {
   // source_thread.join();
   up_srcsdr->stop();
 
-  if (outputbuf_samples > 0) {
+  if (!(*up_srcsdr)) {
+    fprintf(stderr, "ERROR: source: %s\n", up_srcsdr->error().c_str());
+  }
+
+  if (output_thread.joinable()) {
     output_buffer.push_end();
     output_thread.join();
   }
 
+  if (stations) {
+    stations->finish();
+    for (std::thread &writer : station_writers) {
+      writer.join();
+    }
+  } else {
+    report_latency();
+  }
+
   // No cleanup needed; everything handled by destructors
 
   return 0;
@@ -489,8 +489,33 @@ void AirspySource::run(airspy_device *dev, std::atomic_bool *stop_flag) {
 bool AirspySource::stop() {
   std::cerr << "AirspySource::stop" << std::endl;
 
-  m_thread->join();
-  delete m_thread;
+  if (m_thread) {
+    m_thread->join();
+    delete m_thread;
+    m_thread = 0;
+  }
+  return true;
+}
+
+// Retune while streaming.
+bool AirspySource::retune(uint32_t frequency, std::string &error) {
+  if ((frequency < 24000000) || (frequency > 1800000000)) {
+    error = "Invalid frequency";
+    return false;
+  }
+
+  uint32_t tuner_freq = frequency + 0.25 * m_sampleRate;
+  airspy_error rc = (airspy_error)airspy_set_freq(m_dev, tuner_freq);
+
+  if (rc != AIRSPY_SUCCESS) {
+    std::ostringstream err_ostr;
+    err_ostr << "Could not set center frequency to " << tuner_freq << " Hz";
+    error = err_ostr.str();
+    return false;
+  }
+
+  m_confFreq = frequency;
+  m_frequency = tuner_freq;
   return true;
 }
 
@@ -505,6 +530,8 @@ int AirspySource::rx_callback(airspy_transfer_t *transfer) {
 }
 
 void AirspySource::callback(const short *buf, int len) {
+  // The transfer is complete now; time it before the conversion.
+  double timestamp = monotonic_time();
   IQSampleVector iqsamples;
 
   iqsamples.resize(len / 2);
@@ -517,5 +544,5 @@ void AirspySource::callback(const short *buf, int len) {
                  im / IQSample::value_type(1 << 11));
   }
 
-  m_buf->push(move(iqsamples));
+  m_buf->push(move(iqsamples), timestamp);
 }
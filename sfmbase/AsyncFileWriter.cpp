@@ -0,0 +1,344 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#define _FILE_OFFSET_BITS 64
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "AsyncFileWriter.h"
+
+constexpr std::size_t AsyncFileWriter::alignment;
+constexpr std::size_t AsyncFileWriter::default_batch_size;
+constexpr unsigned int AsyncFileWriter::head_buffer;
+
+// Write a buffer at a file offset, retrying after partial writes.
+// Return 0 on success, or the errno value on failure.
+static int pwrite_all(int fd, const std::uint8_t *data, std::size_t n,
+                      std::uint64_t offset) {
+  std::size_t p = 0;
+  while (p < n) {
+    ssize_t k = pwrite(fd, data + p, n - p, offset + p);
+    if (k <= 0) {
+      if (k == 0 || errno != EINTR) {
+        return (k == 0) ? EIO : errno;
+      }
+    } else {
+      p += k;
+    }
+  }
+  return 0;
+}
+
+/* ****************  class AsyncFileWriter  **************** */
+
+// Construct writer.
+AsyncFileWriter::AsyncFileWriter(int fd, bool direct, std::size_t batch_size)
+    : m_fd(fd),
+      m_batch_size(std::max(alignment, (batch_size + alignment - 1) /
+                                           alignment * alignment)),
+      m_direct(false), m_use_ring(false), m_finished(false), m_cur(0),
+      m_offset(0), m_head_len(0), m_error(0), m_stop(false) {
+  for (unsigned int i = 0; i < 3; i++) {
+    std::size_t size = (i == head_buffer) ? alignment : m_batch_size;
+    void *p = NULL;
+    if (posix_memalign(&p, alignment, size) != 0) {
+      p = NULL;
+      set_error(ENOMEM);
+    }
+    m_buf[i].data = static_cast<std::uint8_t *>(p);
+    m_buf[i].len = 0;
+    m_buf[i].offset = 0;
+    m_buf[i].done = 0;
+    m_buf[i].busy = false;
+  }
+  if (m_error != 0) {
+    m_finished = true;
+    return;
+  }
+
+  // Not all file systems support O_DIRECT; fall back to buffered I/O.
+  if (direct) {
+    int flags = fcntl(m_fd, F_GETFL);
+    m_direct = (flags != -1 && fcntl(m_fd, F_SETFL, flags | O_DIRECT) != -1);
+  }
+
+#ifdef USE_IO_URING
+  // io_uring may be unavailable at run time (old kernel, seccomp filter).
+  m_use_ring = (io_uring_queue_init(4, &m_ring, 0) == 0);
+#endif // USE_IO_URING
+
+  if (!m_use_ring) {
+    m_thread = std::thread(&AsyncFileWriter::run, this);
+  }
+}
+
+// Destructor.
+AsyncFileWriter::~AsyncFileWriter() {
+  finish();
+
+  if (m_thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+  }
+
+#ifdef USE_IO_URING
+  if (m_use_ring) {
+    io_uring_queue_exit(&m_ring);
+  }
+#endif // USE_IO_URING
+
+  for (unsigned int i = 0; i < 3; i++) {
+    free(m_buf[i].data);
+  }
+}
+
+// Append data to the file.
+bool AsyncFileWriter::write(const std::uint8_t *data, std::size_t n) {
+  if (m_finished) {
+    return false;
+  }
+
+#ifdef USE_IO_URING
+  if (m_use_ring) {
+    ring_reap(false);
+  }
+#endif // USE_IO_URING
+
+  while (n > 0) {
+    Buffer &b = m_buf[m_cur];
+    std::size_t k = std::min(n, m_batch_size - b.len);
+    std::memcpy(b.data + b.len, data, k);
+    b.len += k;
+    data += k;
+    n -= k;
+
+    if (b.len == m_batch_size) {
+      // Hand over the full batch, and continue in the other buffer.
+      submit(m_cur, m_offset);
+      m_offset += m_batch_size;
+      m_cur ^= 1;
+      wait_idle(m_cur);
+      m_buf[m_cur].len = 0;
+    }
+  }
+
+  return m_error == 0;
+}
+
+// Overwrite the start of the file.
+bool AsyncFileWriter::write_head(const std::uint8_t *data, std::size_t n) {
+  if (m_finished || n > alignment || n > size()) {
+    return false;
+  }
+
+  if (m_offset == 0) {
+    // The first batch has not been submitted yet.
+    std::memcpy(m_buf[m_cur].data, data, n);
+  } else {
+    // Rewrite the first page from its copy; with O_DIRECT, only whole
+    // pages can be written. The first batch must not overtake it.
+    Buffer &b = m_buf[head_buffer];
+    if (m_offset == m_batch_size) {
+      wait_idle(0);
+    }
+    wait_idle(head_buffer);
+    std::memcpy(b.data, data, n);
+    b.len = m_direct ? m_head_len : n;
+    submit(head_buffer, 0);
+  }
+
+  return m_error == 0;
+}
+
+// Write all remaining data and wait until all writes are complete.
+bool AsyncFileWriter::finish() {
+  if (m_finished) {
+    return m_error == 0;
+  }
+  m_finished = true;
+
+  Buffer &b = m_buf[m_cur];
+  std::uint64_t end = m_offset + b.len;
+  if (b.len > 0) {
+    // With O_DIRECT, write whole pages and cut off the padding afterwards.
+    if (m_direct) {
+      std::size_t padded = (b.len + alignment - 1) / alignment * alignment;
+      std::fill(b.data + b.len, b.data + padded, 0);
+      b.len = padded;
+    }
+    submit(m_cur, m_offset);
+  }
+
+  for (unsigned int i = 0; i < 3; i++) {
+    wait_idle(i);
+  }
+
+  if (m_direct && end % alignment != 0 && ftruncate(m_fd, end) == -1) {
+    set_error(errno);
+  }
+
+  return m_error == 0;
+}
+
+// Start writing a buffer at the given file offset.
+void AsyncFileWriter::submit(unsigned int index, std::uint64_t offset) {
+  Buffer &b = m_buf[index];
+  assert(!b.busy);
+
+  // Keep a copy of the first page for write_head().
+  if (offset == 0 && index != head_buffer) {
+    m_head_len = std::min(b.len, alignment);
+    std::memcpy(m_buf[head_buffer].data, b.data, m_head_len);
+  }
+
+  b.offset = offset;
+  b.done = 0;
+
+#ifdef USE_IO_URING
+  if (m_use_ring) {
+    b.busy = true;
+    ring_submit(b);
+    return;
+  }
+#endif // USE_IO_URING
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    b.busy = true;
+    m_queue.push_back(index);
+  }
+  m_cond.notify_all();
+}
+
+// Wait until a buffer is no longer being written.
+void AsyncFileWriter::wait_idle(unsigned int index) {
+  Buffer &b = m_buf[index];
+
+#ifdef USE_IO_URING
+  if (m_use_ring) {
+    while (b.busy) {
+      ring_reap(true);
+    }
+    return;
+  }
+#endif // USE_IO_URING
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_cond.wait(lock, [&b] { return !b.busy; });
+}
+
+// Record the first error.
+void AsyncFileWriter::set_error(int err) {
+  int expected = 0;
+  m_error.compare_exchange_strong(expected, err);
+}
+
+// Writer thread.
+void AsyncFileWriter::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+    if (m_queue.empty()) {
+      break;
+    }
+    Buffer &b = m_buf[m_queue.front()];
+    m_queue.pop_front();
+    lock.unlock();
+
+    int err = pwrite_all(m_fd, b.data, b.len, b.offset);
+    if (err != 0) {
+      set_error(err);
+    }
+
+    lock.lock();
+    b.busy = false;
+    m_cond.notify_all();
+  }
+}
+
+#ifdef USE_IO_URING
+// Queue a write of the unwritten part of a buffer to the ring.
+void AsyncFileWriter::ring_submit(Buffer &b) {
+  // The ring has room for all buffers.
+  struct io_uring_sqe *sqe = io_uring_get_sqe(&m_ring);
+  assert(sqe != NULL);
+  io_uring_prep_write(sqe, m_fd, b.data + b.done, b.len - b.done,
+                      b.offset + b.done);
+  io_uring_sqe_set_data(sqe, &b);
+
+  int ret;
+  do {
+    ret = io_uring_submit(&m_ring);
+  } while (ret == -EINTR);
+  if (ret < 0) {
+    set_error(-ret);
+    b.busy = false;
+  }
+}
+
+// Process completions.
+void AsyncFileWriter::ring_reap(bool wait) {
+  for (;;) {
+    struct io_uring_cqe *cqe;
+    int ret = wait ? io_uring_wait_cqe(&m_ring, &cqe)
+                   : io_uring_peek_cqe(&m_ring, &cqe);
+    if (ret == -EINTR) {
+      continue;
+    }
+    if (ret < 0) {
+      // No completion available (-EAGAIN), or the ring failed.
+      if (wait) {
+        set_error(-ret);
+        for (unsigned int i = 0; i < 3; i++) {
+          m_buf[i].busy = false;
+        }
+      }
+      return;
+    }
+
+    Buffer &b = *static_cast<Buffer *>(io_uring_cqe_get_data(cqe));
+    int res = cqe->res;
+    io_uring_cqe_seen(&m_ring, cqe);
+
+    if (res > 0 && b.done + res < b.len) {
+      // Short write; write the rest.
+      b.done += res;
+      ring_submit(b);
+    } else if (res == -EINTR || res == -EAGAIN) {
+      ring_submit(b);
+    } else {
+      if (res <= 0) {
+        set_error(res == 0 ? EIO : -res);
+      }
+      b.busy = false;
+    }
+    wait = false;
+  }
+}
+#endif // USE_IO_URING
+
+/* end */
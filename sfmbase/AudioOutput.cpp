@@ -18,11 +18,15 @@
 #define _FILE_OFFSET_BITS 64
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cerrno>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #ifdef USE_ALSA
@@ -34,29 +38,239 @@
 
 /* ****************  class AudioOutput  **************** */
 
+// Return a different seed for the dither generator of each thread,
+// so that the outputs written by separate threads get uncorrelated dither.
+static std::uint64_t dither_seed() {
+  static std::atomic<std::uint64_t> counter(0);
+  // splitmix64 of a per-thread counter value.
+  std::uint64_t z =
+      counter.fetch_add(1, std::memory_order_relaxed) * 0x9e3779b97f4a7c15ULL +
+      0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+  return (z != 0) ? z : 1; // xorshift64 must not start from zero
+}
+
+// State of the per-thread pseudo random number generator for dither.
+static thread_local std::uint64_t dither_rng_state = dither_seed();
+
+// Return triangular PDF dither in the range (-1, +1) LSB.
+// The two uniform random values are taken from one xorshift64 draw.
+static inline Sample dither_tpdf(std::uint64_t &state) {
+  std::uint64_t x = state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  state = x;
+  std::int64_t sum = std::int64_t(x & 0xffffffff) + std::int64_t(x >> 32);
+  return Sample(sum) * Sample(1.0 / 4294967296.0) - 1;
+}
+
+// Round to nearest integer, halfway cases upwards.
+// Unlike lrint(), this is vectorized by the compiler, and it compiles
+// to branch-free code in the scalar dither loops.
+static inline int round_sample(Sample s) {
+  return int(std::floor(s + Sample(0.5)));
+}
+
+// Return the number of bytes per sample of a sample format.
+unsigned int AudioOutput::bytes_per_sample(SampleFormat format) {
+  switch (format) {
+  case FORMAT_S16_LE:
+    return 2;
+  case FORMAT_S24_3LE:
+    return 3;
+  case FORMAT_S32_LE:
+  case FORMAT_FLOAT_LE:
+    return 4;
+  }
+  return 0;
+}
+
+// Set dither mode for conversion to integer samples.
+void AudioOutput::set_dither(DitherMode mode, unsigned int nchannels) {
+  m_dither = mode;
+  m_shape_error.assign(std::max(1U, nchannels), 0);
+}
+
 // Encode a list of samples as signed 16-bit little-endian integers.
 void AudioOutput::samplesToInt16(const SampleVector &samples,
                                  std::vector<uint8_t> &bytes) {
-  bytes.resize(2 * samples.size());
+  unsigned int n = samples.size();
+  bytes.resize(2 * n);
+
+  // Write 16-bit integers directly into the byte buffer so that the
+  // conversion loop is vectorized, then fix the byte order if needed.
+  const Sample *in = samples.data();
+  int16_t *out = reinterpret_cast<int16_t *>(bytes.data());
+
+  if (m_dither == DITHER_NONE) {
+
+    for (unsigned int i = 0; i < n; i++) {
+      Sample s = in[i] * 32767;
+      s = std::max(Sample(-32767), std::min(Sample(32767), s));
+      out[i] = round_sample(s);
+    }
+
+  } else {
 
-  SampleVector::const_iterator i = samples.begin();
-  SampleVector::const_iterator n = samples.end();
-  std::vector<uint8_t>::iterator k = bytes.begin();
+    // Scale to LSB units, add dither and round.
+    std::uint64_t rng = dither_rng_state;
 
-  while (i != n) {
-    Sample s = *(i++);
-    s = std::max(Sample(-1.0), std::min(Sample(1.0), s));
-    long v = lrint(s * 32767);
-    unsigned long u = v;
-    *(k++) = u & 0xff;
-    *(k++) = (u >> 8) & 0xff;
+    if (m_dither == DITHER_TPDF) {
+      for (unsigned int i = 0; i < n; i++) {
+        Sample w = in[i] * 32767;
+        w = std::max(Sample(-32768), std::min(Sample(32768), w));
+        int v = round_sample(w + dither_tpdf(rng));
+        out[i] = std::max(-32767, std::min(32767, v));
+      }
+    } else {
+      // Noise shaping: subtract the quantization error of the previous
+      // sample of the same channel before quantizing,
+      // which gives a (1 - 1/z) noise spectrum.
+      unsigned int nch = m_shape_error.size();
+      for (unsigned int i = 0; i < n; i += nch) {
+        for (unsigned int k = 0; k < nch && i + k < n; k++) {
+          Sample w = in[i + k] * 32767 - m_shape_error[k];
+          w = std::max(Sample(-32768), std::min(Sample(32768), w));
+          int v = round_sample(w + dither_tpdf(rng));
+          m_shape_error[k] = v - w;
+          out[i + k] = std::max(-32767, std::min(32767, v));
+        }
+      }
+    }
+
+    dither_rng_state = rng;
+  }
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  for (unsigned int i = 0; i < n; i++) {
+    std::swap(bytes[2 * i], bytes[2 * i + 1]);
+  }
+#endif
+}
+
+// Encode a list of samples as signed 24-bit little-endian integers.
+void AudioOutput::samplesToInt24(const SampleVector &samples,
+                                 std::vector<uint8_t> &bytes) {
+  unsigned int n = samples.size();
+  bytes.resize(3 * n);
+
+  const Sample *in = samples.data();
+  uint8_t *out = bytes.data();
+
+  for (unsigned int i = 0; i < n; i++) {
+    Sample s = in[i] * 8388607;
+    s = std::max(Sample(-8388607), std::min(Sample(8388607), s));
+    uint32_t u = round_sample(s);
+    out[3 * i] = u & 0xff;
+    out[3 * i + 1] = (u >> 8) & 0xff;
+    out[3 * i + 2] = (u >> 16) & 0xff;
   }
 }
 
+// Encode a list of samples as signed 32-bit little-endian integers.
+void AudioOutput::samplesToInt32(const SampleVector &samples,
+                                 std::vector<uint8_t> &bytes) {
+  unsigned int n = samples.size();
+  bytes.resize(4 * n);
+
+  const Sample *in = samples.data();
+  int32_t *out = reinterpret_cast<int32_t *>(bytes.data());
+
+  for (unsigned int i = 0; i < n; i++) {
+    Sample s = in[i] * 2147483647.0;
+    s = std::max(Sample(-2147483647.0), std::min(Sample(2147483647.0), s));
+    out[i] = round_sample(s);
+  }
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  for (unsigned int i = 0; i < n; i++) {
+    std::reverse(bytes.begin() + 4 * i, bytes.begin() + 4 * i + 4);
+  }
+#endif
+}
+
+// Encode a list of samples as 32-bit little-endian floats.
+// Samples are stored without clipping.
+void AudioOutput::samplesToFloat32(const SampleVector &samples,
+                                   std::vector<uint8_t> &bytes) {
+  unsigned int n = samples.size();
+  bytes.resize(4 * n);
+
+  const Sample *in = samples.data();
+  float *out = reinterpret_cast<float *>(bytes.data());
+
+  for (unsigned int i = 0; i < n; i++) {
+    out[i] = float(in[i]);
+  }
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  for (unsigned int i = 0; i < n; i++) {
+    std::reverse(bytes.begin() + 4 * i, bytes.begin() + 4 * i + 4);
+  }
+#endif
+}
+
+// Encode a list of samples in the sample format of the stream.
+void AudioOutput::samplesToBytes(const SampleVector &samples,
+                                 std::vector<uint8_t> &bytes) {
+  switch (m_format) {
+  case FORMAT_S16_LE:
+    samplesToInt16(samples, bytes);
+    break;
+  case FORMAT_S24_3LE:
+    samplesToInt24(samples, bytes);
+    break;
+  case FORMAT_S32_LE:
+    samplesToInt32(samples, bytes);
+    break;
+  case FORMAT_FLOAT_LE:
+    samplesToFloat32(samples, bytes);
+    break;
+  }
+}
+
+// Write audio data.
+bool AudioOutput::write(const SampleVector &samples) {
+  samplesToBytes(samples, m_bytebuf);
+  return write_bytes(m_bytebuf.data(), m_bytebuf.size());
+}
+
+// Write a buffer to a file descriptor, retrying after partial writes.
+// Return 0 on success, or the errno value on failure.
+static int write_all(int fd, const uint8_t *data, std::size_t n) {
+  std::size_t p = 0;
+  while (p < n) {
+    ssize_t k = ::write(fd, data + p, n - p);
+    if (k <= 0) {
+      if (k == 0 || errno != EINTR) {
+        return (k == 0) ? EIO : errno;
+      }
+    } else {
+      p += k;
+    }
+  }
+  return 0;
+}
+
+// Write a buffer through the background writer if there is one,
+// otherwise directly. Return 0 on success, or the errno value on failure.
+static int write_data(int fd, AsyncFileWriter *writer, const uint8_t *data,
+                      std::size_t n) {
+  if (writer != NULL) {
+    return writer->write(data, n) ? 0 : writer->error();
+  }
+  return write_all(fd, data, n);
+}
+
 /* ****************  class RawAudioOutput  **************** */
 
 // Construct raw audio writer.
-RawAudioOutput::RawAudioOutput(const std::string &filename) {
+RawAudioOutput::RawAudioOutput(const std::string &filename,
+                               SampleFormat format, bool direct_io)
+    : AudioOutput(format) {
   if (filename == "-") {
 
     m_fd = STDOUT_FILENO;
@@ -70,41 +284,39 @@ RawAudioOutput::RawAudioOutput(const std::string &filename) {
       return;
     }
   }
+
+  // Write regular files in the background.
+  struct stat st;
+  if (fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode) &&
+      lseek(m_fd, 0, SEEK_CUR) == 0) {
+    m_writer.reset(new AsyncFileWriter(m_fd, direct_io));
+  }
 }
 
 // Destructor.
 RawAudioOutput::~RawAudioOutput() {
+  // Wait for pending writes.
+  m_writer.reset();
+
   // Close file descriptor.
   if (m_fd >= 0 && m_fd != STDOUT_FILENO) {
     close(m_fd);
   }
 }
 
-// Write audio data.
-bool RawAudioOutput::write(const SampleVector &samples) {
+// Write encoded audio data.
+bool RawAudioOutput::write_bytes(const std::uint8_t *data, std::size_t n) {
   if (m_fd < 0) {
     return false;
   }
 
-  // Convert samples to bytes.
-  samplesToInt16(samples, m_bytebuf);
-
   // Write data.
-  std::size_t p = 0;
-  std::size_t n = m_bytebuf.size();
-  while (p < n) {
-
-    ssize_t k = ::write(m_fd, m_bytebuf.data() + p, n - p);
-    if (k <= 0) {
-      if (k == 0 || errno != EINTR) {
-        m_error = "write failed (";
-        m_error += strerror(errno);
-        m_error += ")";
-        return false;
-      }
-    } else {
-      p += k;
-    }
+  int err = write_data(m_fd, m_writer.get(), data, n);
+  if (err != 0) {
+    m_error = "write failed (";
+    m_error += strerror(err);
+    m_error += ")";
+    return false;
   }
 
   return true;
@@ -114,18 +326,41 @@ bool RawAudioOutput::write(const SampleVector &samples) {
 
 // Construct .WAV writer.
 WavAudioOutput::WavAudioOutput(const std::string &filename,
-                               unsigned int samplerate, bool stereo)
-    : numberOfChannels(stereo ? 2 : 1), sampleRate(samplerate) {
-  m_stream = fopen(filename.c_str(), "wb");
-  if (m_stream == NULL) {
-    m_error = "can not open '" + filename + "' (" + strerror(errno) + ")";
-    m_zombie = true;
-    return;
+                               unsigned int samplerate, bool stereo,
+                               SampleFormat format, bool direct_io)
+    : AudioOutput(format), numberOfChannels(stereo ? 2 : 1),
+      sampleRate(samplerate),
+      // RIFF header, JUNK/ds64 chunk, fmt chunk and data chunk header.
+      // IEEE float files have an extended fmt chunk and a fact chunk.
+      headerSize(format == FORMAT_FLOAT_LE ? 94 : 80), m_fd(-1),
+      m_seekable(false), m_data_bytes(0), m_header_update_bytes(0) {
+  if (filename == "-") {
+    m_fd = STDOUT_FILENO;
+  } else {
+    m_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (m_fd < 0) {
+      m_error = "can not open '" + filename + "' (" + strerror(errno) + ")";
+      m_zombie = true;
+      return;
+    }
+  }
+
+  // Only regular files can have their header rewritten.
+  struct stat st;
+  m_seekable = (fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode) &&
+                lseek(m_fd, 0, SEEK_CUR) == 0);
+
+  m_header_update_bytes = std::uint64_t(header_update_interval) *
+                          sampleRate * numberOfChannels *
+                          bytes_per_sample(m_format);
+
+  // Write regular files in the background.
+  if (m_seekable) {
+    m_writer.reset(new AsyncFileWriter(m_fd, direct_io));
   }
 
-  // Write initial header with a dummy sample count.
-  // This will be replaced with the actual header once the WavFile is closed.
-  if (!write_header(0x7fff0000)) {
+  // Write initial header with an empty data chunk, or a streaming header.
+  if (!write_header(0)) {
     m_error = "can not write to '" + filename + "' (" + strerror(errno) + ")";
     m_zombie = true;
   }
@@ -133,89 +368,138 @@ WavAudioOutput::WavAudioOutput(const std::string &filename,
 
 // Destructor.
 WavAudioOutput::~WavAudioOutput() {
-  // We need to go back and fill in the header ...
-
-  if (!m_zombie) {
-
-    const unsigned bytesPerSample = 2;
-
-    const long currentPosition = ftell(m_stream);
-
-    assert((currentPosition - 44) % bytesPerSample == 0);
-
-    const unsigned totalNumberOfSamples =
-        (currentPosition - 44) / bytesPerSample;
-
-    assert(totalNumberOfSamples % numberOfChannels == 0);
-
-    // Put header in front
-
-    if (fseek(m_stream, 0, SEEK_SET) == 0) {
-      write_header(totalNumberOfSamples);
+  if (!m_zombie && m_seekable) {
+    // The data chunk must have an even size.
+    if (m_data_bytes % 2 != 0) {
+      uint8_t pad = 0;
+      write_data(m_fd, m_writer.get(), &pad, 1);
     }
+
+    // Put the final header in front.
+    write_header(m_data_bytes);
   }
 
-  // Done writing the file
+  // Wait for pending writes.
+  m_writer.reset();
 
-  if (m_stream) {
-    fclose(m_stream);
+  // Done writing the file.
+  if (m_fd >= 0 && m_fd != STDOUT_FILENO) {
+    close(m_fd);
   }
 }
 
-// Write audio data.
-bool WavAudioOutput::write(const SampleVector &samples) {
+// Write encoded audio data.
+bool WavAudioOutput::write_bytes(const std::uint8_t *data, std::size_t n) {
   if (m_zombie) {
     return false;
   }
 
-  // Convert samples to bytes.
-  samplesToInt16(samples, m_bytebuf);
-
   // Write samples to file.
-  std::size_t k = fwrite(m_bytebuf.data(), 1, m_bytebuf.size(), m_stream);
-  if (k != m_bytebuf.size()) {
+  int err = write_data(m_fd, m_writer.get(), data, n);
+  if (err != 0) {
     m_error = "write failed (";
-    m_error += strerror(errno);
+    m_error += strerror(err);
     m_error += ")";
     return false;
   }
 
+  // Update the header every header_update_interval seconds,
+  // so that the file is playable if the recording is interrupted.
+  std::uint64_t prev_bytes = m_data_bytes;
+  m_data_bytes += n;
+  if (m_seekable && m_data_bytes / m_header_update_bytes !=
+                        prev_bytes / m_header_update_bytes) {
+    if (!write_header(m_data_bytes)) {
+      m_error = "header update failed (";
+      m_error += strerror(errno);
+      m_error += ")";
+      return false;
+    }
+  }
+
   return true;
 }
 
 // (Re)write .WAV header.
-bool WavAudioOutput::write_header(unsigned int nsamples) {
-  const unsigned bytesPerSample = 2;
-  const unsigned bitsPerSample = 16;
+bool WavAudioOutput::write_header(std::uint64_t data_bytes) {
+  const unsigned bytesPerSample = bytes_per_sample(m_format);
+  const unsigned bitsPerSample = 8 * bytesPerSample;
+  const bool isFloat = (m_format == FORMAT_FLOAT_LE);
 
   enum wFormatTagId {
     WAVE_FORMAT_PCM = 0x0001,
     WAVE_FORMAT_IEEE_FLOAT = 0x0003
   };
 
-  assert(nsamples % numberOfChannels == 0);
+  // Sizes in the header, including the pad byte of an odd data chunk.
+  // A file larger than 4 GB is written as RF64, where the 32-bit size
+  // fields are set to 0xFFFFFFFF and the actual sizes are in the ds64
+  // chunk. A streaming header has unknown sizes.
+  const std::uint64_t riffSize = headerSize - 8 + data_bytes + data_bytes % 2;
+  const std::uint64_t frames = data_bytes / (bytesPerSample * numberOfChannels);
+  const bool isRf64 = m_seekable && riffSize > 0xffffffff;
+  const bool unknownSize = !m_seekable || isRf64;
 
   // synthesize header
 
-  uint8_t wavHeader[44];
+  uint8_t wavHeader[94];
+  const unsigned fmtSize = isFloat ? 18 : 16;
 
-  encode_chunk_id(wavHeader + 0, "RIFF");
-  set_value<uint32_t>(wavHeader + 4, 36 + nsamples * bytesPerSample);
+  encode_chunk_id(wavHeader + 0, isRf64 ? "RF64" : "RIFF");
+  set_value<uint32_t>(wavHeader + 4, unknownSize ? 0xffffffff : riffSize);
   encode_chunk_id(wavHeader + 8, "WAVE");
-  encode_chunk_id(wavHeader + 12, "fmt ");
-  set_value<uint32_t>(wavHeader + 16, 16);
-  set_value<uint16_t>(wavHeader + 20, WAVE_FORMAT_PCM);
-  set_value<uint16_t>(wavHeader + 22, numberOfChannels);
-  set_value<uint32_t>(wavHeader + 24, sampleRate); // sample rate
-  set_value<uint32_t>(wavHeader + 28, sampleRate * numberOfChannels *
+
+  // Reserved space for the ds64 chunk, which must follow "WAVE".
+  encode_chunk_id(wavHeader + 12, isRf64 ? "ds64" : "JUNK");
+  set_value<uint32_t>(wavHeader + 16, 28);
+  std::fill(wavHeader + 20, wavHeader + 48, 0);
+  if (isRf64) {
+    set_value<uint64_t>(wavHeader + 20, riffSize);
+    set_value<uint64_t>(wavHeader + 28, data_bytes);
+    set_value<uint64_t>(wavHeader + 36, frames);
+    set_value<uint32_t>(wavHeader + 44, 0); // table length
+  }
+
+  encode_chunk_id(wavHeader + 48, "fmt ");
+  set_value<uint32_t>(wavHeader + 52, fmtSize);
+  set_value<uint16_t>(wavHeader + 56,
+                      isFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+  set_value<uint16_t>(wavHeader + 58, numberOfChannels);
+  set_value<uint32_t>(wavHeader + 60, sampleRate); // sample rate
+  set_value<uint32_t>(wavHeader + 64, sampleRate * numberOfChannels *
                                           bytesPerSample); // byte rate
-  set_value<uint16_t>(wavHeader + 32,
+  set_value<uint16_t>(wavHeader + 68,
                       numberOfChannels * bytesPerSample); // block size
-  set_value<uint16_t>(wavHeader + 34, bitsPerSample);
-  encode_chunk_id(wavHeader + 36, "data");
-  set_value<uint32_t>(wavHeader + 40, nsamples * bytesPerSample);
+  set_value<uint16_t>(wavHeader + 70, bitsPerSample);
+
+  uint8_t *ptr = wavHeader + 72;
+  if (isFloat) {
+    // Non-PCM formats need the cbSize field and a fact chunk
+    // holding the number of sample frames.
+    set_value<uint16_t>(ptr, 0); // cbSize
+    encode_chunk_id(ptr + 2, "fact");
+    set_value<uint32_t>(ptr + 6, 4);
+    set_value<uint32_t>(ptr + 10, unknownSize ? 0xffffffff : frames);
+    ptr += 14;
+  }
+
+  encode_chunk_id(ptr, "data");
+  set_value<uint32_t>(ptr + 4, unknownSize ? 0xffffffff : data_bytes);
+
+  assert(ptr + 8 == wavHeader + headerSize);
 
-  return fwrite(wavHeader, 1, 44, m_stream) == 44;
+  if (m_writer) {
+    // The initial header starts the file, later ones replace it.
+    bool ok = (m_writer->size() == 0)
+                  ? m_writer->write(wavHeader, headerSize)
+                  : m_writer->write_head(wavHeader, headerSize);
+    if (!ok) {
+      errno = m_writer->error();
+    }
+    return ok;
+  } else {
+    return write_all(m_fd, wavHeader, headerSize) == 0;
+  }
 }
 
 void WavAudioOutput::encode_chunk_id(uint8_t *ptr, const char *chunkname) {
@@ -239,7 +523,9 @@ template <typename T> void WavAudioOutput::set_value(uint8_t *ptr, T value) {
 
 // Construct ALSA output stream.
 AlsaAudioOutput::AlsaAudioOutput(const std::string &devname,
-                                 unsigned int samplerate, bool stereo) {
+                                 unsigned int samplerate, bool stereo,
+                                 SampleFormat format)
+    : AudioOutput(format) {
   m_pcm = NULL;
   m_nchannels = stereo ? 2 : 1;
 
@@ -255,7 +541,23 @@ AlsaAudioOutput::AlsaAudioOutput(const std::string &devname,
 
   snd_pcm_nonblock(m_pcm, 0);
 
-  r = snd_pcm_set_params(m_pcm, SND_PCM_FORMAT_S16_LE,
+  snd_pcm_format_t pcm_format = SND_PCM_FORMAT_S16_LE;
+  switch (format) {
+  case FORMAT_S16_LE:
+    pcm_format = SND_PCM_FORMAT_S16_LE;
+    break;
+  case FORMAT_S24_3LE:
+    pcm_format = SND_PCM_FORMAT_S24_3LE;
+    break;
+  case FORMAT_S32_LE:
+    pcm_format = SND_PCM_FORMAT_S32_LE;
+    break;
+  case FORMAT_FLOAT_LE:
+    pcm_format = SND_PCM_FORMAT_FLOAT_LE;
+    break;
+  }
+
+  r = snd_pcm_set_params(m_pcm, pcm_format,
                          SND_PCM_ACCESS_RW_INTERLEAVED, m_nchannels, samplerate,
                          1,       // allow soft resampling
                          500000); // latency in us
@@ -276,22 +578,19 @@ AlsaAudioOutput::~AlsaAudioOutput() {
   }
 }
 
-// Write audio data.
-bool AlsaAudioOutput::write(const SampleVector &samples) {
+// Write encoded audio data.
+bool AlsaAudioOutput::write_bytes(const std::uint8_t *data, std::size_t n) {
   if (m_zombie) {
     return false;
   }
 
-  // Convert samples to bytes.
-  samplesToInt16(samples, m_bytebuf);
-
   // Write data.
+  unsigned int framesize = bytes_per_sample(m_format) * m_nchannels;
+  unsigned int nframes = n / framesize;
   unsigned int p = 0;
-  unsigned int n = samples.size() / m_nchannels;
-  unsigned int framesize = 2 * m_nchannels;
-  while (p < n) {
+  while (p < nframes) {
 
-    int k = snd_pcm_writei(m_pcm, m_bytebuf.data() + p * framesize, n - p);
+    int k = snd_pcm_writei(m_pcm, data + p * framesize, nframes - p);
     if (k < 0) {
       m_error = "write failed (";
       m_error += strerror(errno);
@@ -0,0 +1,199 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "BandScanner.h"
+#include "Filter.h"
+#include "FmDecode.h"
+
+constexpr unsigned int BandScanner::default_fft_size;
+constexpr double BandScanner::default_channel_step;
+constexpr double BandScanner::default_threshold_db;
+constexpr double BandScanner::burst_seconds;
+constexpr double BandScanner::pilot_bandwidth;
+
+/* ****************  class BandScanner  **************** */
+
+// Construct band scanner.
+BandScanner::BandScanner(double sample_rate, double channel_step,
+                         double threshold_db, unsigned int fft_size)
+    : m_sample_rate(sample_rate), m_channel_step(channel_step),
+      m_threshold(pow(10.0, 0.1 * threshold_db)),
+      m_downsample(std::max(
+          1, int(sample_rate / (FmDecoder::default_bandwidth_if * 2.2)))),
+      m_noise_floor(0), m_fft(fft_size), m_window(fft_size),
+      m_frame(fft_size), m_spectrum(fft_size) {
+  assert(Fft<float>::is_power_of_two(fft_size));
+
+  // Stay clear of the roll-off of the tuner filters, and keep the
+  // neighbours of the outermost channels within the spectrum.
+  m_usable_halfwidth =
+      std::min(0.4 * sample_rate, 0.5 * sample_rate - channel_step -
+                                      FmDecoder::default_freq_dev);
+  m_usable_halfwidth = std::max(0.0, m_usable_halfwidth);
+
+  // Hann window.
+  for (unsigned int i = 0; i < fft_size; i++) {
+    m_window[i] = 0.5 - 0.5 * cos(2 * M_PI * (i + 0.5) / fft_size);
+  }
+}
+
+// Find the stations in a capture.
+void BandScanner::process(const IQSampleVector &samples, double center_freq,
+                          double lo_freq, double hi_freq,
+                          std::vector<Station> &stations) {
+  if (m_usable_halfwidth <= 0 || samples.size() < m_fft.size()) {
+    return;
+  }
+
+  power_spectrum(samples);
+
+  lo_freq = std::max(lo_freq, center_freq - m_usable_halfwidth);
+  hi_freq = std::min(hi_freq, center_freq + m_usable_halfwidth);
+
+  for (long k = lrint(ceil(lo_freq / m_channel_step));
+       k * m_channel_step < hi_freq; k++) {
+    double freq = k * m_channel_step;
+    double offset = freq - center_freq;
+    double power = channel_power(offset);
+
+    // Report a wide carrier only once, on its strongest channel.
+    if (power < m_threshold * m_noise_floor ||
+        power < channel_power(offset - m_channel_step) ||
+        power <= channel_power(offset + m_channel_step)) {
+      continue;
+    }
+
+    Station station;
+    station.freq = freq;
+    station.snr = 10 * log10(power / m_noise_floor);
+    check_station(samples, offset, station);
+    stations.push_back(station);
+  }
+}
+
+// Average the power spectra of the FFT frames of a capture.
+void BandScanner::power_spectrum(const IQSampleVector &samples) {
+  unsigned int n = m_fft.size();
+  unsigned int nframes = samples.size() / n;
+
+  std::fill(m_spectrum.begin(), m_spectrum.end(), 0.0);
+  for (unsigned int f = 0; f < nframes; f++) {
+    const IQSample *in = samples.data() + f * n;
+    for (unsigned int i = 0; i < n; i++) {
+      m_frame[i] = in[i] * m_window[i];
+    }
+    m_fft.forward(m_frame.data());
+
+    // Store the bins in order of frequency, DC in the middle.
+    for (unsigned int k = 0; k < n; k++) {
+      m_spectrum[(k + n / 2) % n] += std::norm(m_frame[k]);
+    }
+  }
+
+  // Scale such that a full scale tone in the middle of a bin is 1.0.
+  double wsum = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    wsum += m_window[i];
+  }
+  double scale = 1.0 / (nframes * wsum * wsum);
+  for (unsigned int k = 0; k < n; k++) {
+    m_spectrum[k] *= scale;
+  }
+
+  // Noise floor: lower quartile of the usable bins, which is still
+  // noise when up to three quarters of the band are occupied.
+  // The DC offset of the tuner is left out and then hidden.
+  unsigned int half = lrint(m_usable_halfwidth / m_sample_rate * n);
+  m_sorted.clear();
+  for (unsigned int k = n / 2 - half; k <= n / 2 + half; k++) {
+    if (k + 1 < n / 2 || k > n / 2 + 1) {
+      m_sorted.push_back(m_spectrum[k]);
+    }
+  }
+  std::nth_element(m_sorted.begin(), m_sorted.begin() + m_sorted.size() / 4,
+                   m_sorted.end());
+  m_noise_floor = std::max(m_sorted[m_sorted.size() / 4], 1.0e-30);
+
+  for (unsigned int k = n / 2 - 1; k <= n / 2 + 1; k++) {
+    m_spectrum[k] = m_noise_floor;
+  }
+}
+
+// Return mean power density of the channel at an offset from center.
+double BandScanner::channel_power(double offset) const {
+  int n = m_fft.size();
+  double halfwidth = FmDecoder::default_freq_dev;
+  int first = lrint((offset - halfwidth) / m_sample_rate * n) + n / 2;
+  int last = lrint((offset + halfwidth) / m_sample_rate * n) + n / 2;
+  first = std::max(first, 0);
+  last = std::min(last, n - 1);
+
+  double sum = 0;
+  for (int k = first; k <= last; k++) {
+    sum += m_spectrum[k];
+  }
+  return (last >= first) ? sum / (last - first + 1) : 0.0;
+}
+
+// Measure IF level and look for the pilot of a station.
+// This is the front of FmDecoder up to the pilot PLL, without the
+// audio stages and with a faster PLL.
+void BandScanner::check_station(const IQSampleVector &samples, double offset,
+                                Station &station) {
+  unsigned int table_size = FmDecoder::finetuner_table_size;
+  double sample_rate_baseband = m_sample_rate / m_downsample;
+
+  FineTuner finetuner(table_size,
+                      lrint(-double(table_size) * offset / m_sample_rate));
+  LowPassFilterFirIQ iffilter(10,
+                              FmDecoder::default_bandwidth_if / m_sample_rate);
+  PhaseDiscriminator phasedisc(FmDecoder::default_freq_dev / m_sample_rate);
+  DownsampleFilter resample(8 * m_downsample, 0.4 / m_downsample,
+                            m_downsample, true);
+  PilotPhaseLock pilotpll(FmDecoder::pilot_freq / sample_rate_baseband,
+                          pilot_bandwidth / sample_rate_baseband, 0.01);
+
+  // The PLL decides on lock once per block; use blocks of 10 ms.
+  std::size_t blocksize = std::max(1L, lrint(0.01 * m_sample_rate));
+  IQSampleVector block, tuned, filtered;
+  SampleVector raw, baseband, pilot;
+  double if_power = 0;
+
+  for (std::size_t pos = 0; pos < samples.size(); pos += blocksize) {
+    std::size_t end = std::min(pos + blocksize, samples.size());
+    block.assign(samples.begin() + pos, samples.begin() + end);
+
+    finetuner.process(block, tuned);
+    iffilter.process(tuned, filtered);
+    for (const IQSample &s : filtered) {
+      if_power += std::norm(s);
+    }
+    phasedisc.process(filtered, raw);
+    resample.process(raw, baseband);
+    pilotpll.process(baseband, pilot, false);
+  }
+
+  station.if_level = sqrt(if_power / samples.size());
+  station.stereo = pilotpll.locked();
+  station.pilot_level = pilotpll.get_pilot_level();
+}
+
+/* end */
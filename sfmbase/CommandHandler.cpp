@@ -0,0 +1,152 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <strings.h>
+
+#include "CommandHandler.h"
+#include "util.h"
+
+// Parse "on" or "off".
+static bool parse_on_off(const std::string &s, bool &v) {
+  if (strcasecmp(s.c_str(), "on") == 0) {
+    v = true;
+  } else if (strcasecmp(s.c_str(), "off") == 0) {
+    v = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/* ****************  class CommandHandler  **************** */
+
+// Construct handler.
+CommandHandler::CommandHandler(Source *source,
+                               DataBuffer<IQSample> *source_buffer,
+                               FmDecoder *decoder, MetricsServer *metrics,
+                               bool stereo)
+    : m_source(source), m_source_buffer(source_buffer), m_decoder(decoder),
+      m_metrics(metrics), m_stereo(stereo), m_muted(false),
+      m_dropped_samples(0) {}
+
+// Run a command.
+bool CommandHandler::run(const std::vector<std::string> &words,
+                         std::string &msg) {
+  if (words.empty()) {
+    msg = "empty command";
+    return false;
+  }
+
+  if (words[0] == "freq" && words.size() == 2) {
+    return retune(words[1], msg);
+  }
+
+  if (words[0] == "gain" && words.size() == 2) {
+    return set_gain(words[1], msg);
+  }
+
+  bool on;
+  if (words[0] == "mute" && words.size() == 2 && parse_on_off(words[1], on)) {
+    m_muted = on;
+    msg = on ? "muted" : "unmuted";
+    return true;
+  }
+
+  if (words[0] == "stereo" && words.size() == 2 &&
+      parse_on_off(words[1], on)) {
+    if (!m_stereo) {
+      msg = "stereo: decoding in mono (-M)";
+      return false;
+    }
+    if (m_decoder == NULL) {
+      msg = "stereo: no decoder to switch";
+      return false;
+    }
+    m_decoder->set_stereo_output(on);
+    msg = on ? "stereo output on" : "stereo output off";
+    return true;
+  }
+
+  msg = "invalid command '" + words[0] + "'";
+  return false;
+}
+
+// Retune the source and the decoder.
+bool CommandHandler::retune(const std::string &arg, std::string &msg) {
+  double f;
+  if (!parse_dbl(arg.c_str(), f) || f < 1 || f > UINT32_MAX) {
+    msg = "invalid frequency '" + arg + "'";
+    return false;
+  }
+  std::string error;
+  if (!m_source->retune(std::uint32_t(lrint(f)), error)) {
+    msg = "retune: " + error;
+    return false;
+  }
+
+  double freq = m_source->get_configured_frequency();
+  double tuner_freq = m_source->get_frequency();
+  if (m_decoder != NULL) {
+    m_decoder->retune(freq - tuner_freq);
+  }
+
+  // Blocks still queued were received at the old frequency.
+  std::size_t stale = m_source_buffer->flush();
+  m_dropped_samples += stale;
+  if (m_metrics != NULL) {
+    m_metrics->add_dropped(stale);
+    m_metrics->set_frequency(freq);
+  }
+
+  char buf[80];
+  snprintf(buf, sizeof(buf), "retuned to %.6f MHz (dropped %.3f s)",
+           freq * 1.0e-6, stale / double(m_source->get_sample_rate()));
+  msg = buf;
+  return true;
+}
+
+// Set the tuner gain.
+bool CommandHandler::set_gain(const std::string &arg, std::string &msg) {
+  int gain = INT_MIN;
+  double g;
+  if (strcasecmp(arg.c_str(), "auto") != 0) {
+    if (!parse_dbl(arg.c_str(), g) || g < -100 || g > 100) {
+      msg = "invalid gain '" + arg + "'";
+      return false;
+    }
+    gain = lrint(g * 10);
+  }
+  std::string error;
+  if (!m_source->set_tuner_gain(gain, error)) {
+    msg = "gain: " + error;
+    return false;
+  }
+
+  char buf[80];
+  if (gain == INT_MIN) {
+    snprintf(buf, sizeof(buf), "tuner gain auto");
+  } else {
+    snprintf(buf, sizeof(buf), "tuner gain %.1f dB", 0.1 * gain);
+  }
+  msg = buf;
+  return true;
+}
+
+/* end */
@@ -0,0 +1,318 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ControlServer.h"
+
+// Return a string as a quoted JSON string.
+static std::string json_string(const std::string &s) {
+  std::string ret("\"");
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      ret += '\\';
+      ret += c;
+    } else if ((unsigned char)c < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+      ret += esc;
+    } else {
+      ret += c;
+    }
+  }
+  return ret + "\"";
+}
+
+// Return a number in JSON; JSON has no infinity, so use null.
+static std::string json_number(double v, const char *fmt = "%.2f") {
+  if (!std::isfinite(v)) {
+    return "null";
+  }
+  char buf[32];
+  snprintf(buf, sizeof(buf), fmt, v);
+  return buf;
+}
+
+// Return true if a command is a plain "status".
+static bool is_status(const ControlServer::Command &command) {
+  return command.words.size() == 1 && command.words[0] == "status";
+}
+
+/* ****************  class ControlServer  **************** */
+
+// Construct server and start listening.
+ControlServer::ControlServer(const std::string &path)
+    : m_listen(path.compare(0, 5, "unix:") == 0 ? path : "unix:" + path),
+      m_next_id(1), m_have_telemetry(false), m_stop(false) {
+  if (!m_listen) {
+    m_error = m_listen.error();
+    return;
+  }
+
+  m_thread = std::thread(&ControlServer::run, this);
+}
+
+// Destructor.
+ControlServer::~ControlServer() {
+  if (m_thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_listen.wakeup();
+    m_thread.join();
+  }
+
+  for (std::unique_ptr<Client> &c : m_clients) {
+    close(c->fd);
+  }
+}
+
+// Publish the decoder state.
+void ControlServer::publish(const Telemetry &telemetry) {
+  bool answered = false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_telemetry = telemetry;
+    m_have_telemetry = true;
+
+    // Answer "status" queued behind commands which have now been run.
+    while (!m_commands.empty() && is_status(m_commands.front())) {
+      std::uint64_t id = m_commands.front().client;
+      m_commands.pop_front();
+      for (std::unique_ptr<Client> &c : m_clients) {
+        if (c->id == id && !c->closed) {
+          c->output += status_json(m_telemetry);
+          c->pending--;
+          break;
+        }
+      }
+      answered = true;
+    }
+  }
+  if (answered) {
+    m_listen.wakeup();
+  }
+}
+
+// Take the next queued command.
+bool ControlServer::next_command(Command &command) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // A queued "status" waits for the telemetry published after the
+  // commands before it, and so do the commands after it.
+  if (m_commands.empty() || is_status(m_commands.front())) {
+    return false;
+  }
+  command = std::move(m_commands.front());
+  m_commands.pop_front();
+  return true;
+}
+
+// Send the result of a command to the client.
+void ControlServer::reply(std::uint64_t client, bool ok,
+                          const std::string &msg) {
+  std::string line = ok ? "{\"ok\":true,\"msg\":" + json_string(msg) + "}\n"
+                        : "{\"ok\":false,\"error\":" + json_string(msg) + "}\n";
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (std::unique_ptr<Client> &c : m_clients) {
+      if (c->id == client && !c->closed) {
+        c->output += line;
+        c->pending--;
+        break;
+      }
+    }
+  }
+  m_listen.wakeup();
+}
+
+// Handle a command line.
+std::string ControlServer::handle_line(Client &client,
+                                       const std::string &line) {
+  Command cmd;
+  cmd.client = client.id;
+  std::istringstream ss(line);
+  std::string word;
+  while (ss >> word) {
+    cmd.words.push_back(word);
+  }
+
+  if (cmd.words.empty()) {
+    return std::string();
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // Answer "status" at once unless earlier commands are still queued.
+  if (is_status(cmd) && client.pending == 0) {
+    if (!m_have_telemetry) {
+      return "{\"ok\":false,\"error\":\"no data yet\"}\n";
+    }
+    return status_json(m_telemetry);
+  }
+  m_commands.push_back(std::move(cmd));
+  client.pending++;
+  return std::string();
+}
+
+// Format the telemetry as JSON.
+std::string ControlServer::status_json(const Telemetry &t) {
+  std::string s = "{\"ok\":true";
+  s += ",\"block\":" + std::to_string(t.block);
+  s += ",\"freq\":" + json_number(t.freq, "%.0f");
+  s += ",\"tuner_freq\":" + json_number(t.tuner_freq, "%.0f");
+  s += ",\"ppm\":" + json_number(t.ppm);
+  s += ",\"if_db\":" + json_number(t.if_level);
+  s += ",\"bb_db\":" + json_number(t.baseband_level);
+  s += ",\"af_db\":" + json_number(t.audio_level);
+  s += ",\"pilot\":" + json_number(t.pilot_level, "%.4f");
+  s += std::string(",\"stereo\":") + (t.stereo_detected ? "true" : "false");
+  s += std::string(",\"stereo_output\":") +
+       (t.stereo_output ? "true" : "false");
+  s += std::string(",\"muted\":") + (t.muted ? "true" : "false");
+  s += ",\"input_buffer_s\":" + json_number(t.input_buffer, "%.3f");
+  s += ",\"output_buffer_s\":" + json_number(t.output_buffer, "%.3f");
+  s += ",\"dropped_samples\":" + std::to_string(t.dropped_samples);
+  s += ",\"cpu_s\":{\"if\":" + json_number(t.cpu_if, "%.3f") +
+       ",\"baseband\":" + json_number(t.cpu_baseband, "%.3f") +
+       ",\"total\":" + json_number(t.cpu_total, "%.3f") + "}";
+  return s + "}\n";
+}
+
+// Read commands from a client.
+bool ControlServer::receive(Client &client) {
+  char buf[512];
+  ssize_t k = recv(client.fd, buf, sizeof(buf), MSG_DONTWAIT);
+  if (k == 0) {
+    // Stay connected until the queued commands have been answered.
+    client.eof = true;
+    return true;
+  }
+  if (k < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+  }
+
+  client.input.append(buf, k);
+  std::size_t eol;
+  while ((eol = client.input.find('\n')) != std::string::npos) {
+    std::string reply = handle_line(client, client.input.substr(0, eol));
+    client.input.erase(0, eol + 1);
+    if (!reply.empty()) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      client.output += reply;
+    }
+  }
+
+  // A client which never ends its line is not talking to us.
+  return client.input.size() <= max_line;
+}
+
+// Send queued replies to a client.
+bool ControlServer::send_output(Client &client) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (client.output.empty()) {
+    return true;
+  }
+  ssize_t k = send(client.fd, client.output.data(), client.output.size(),
+                   MSG_NOSIGNAL | MSG_DONTWAIT);
+  if (k < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+  }
+  client.output.erase(0, k);
+
+  // Do not buffer without limit for a client which does not read.
+  return client.output.size() <= max_output;
+}
+
+// Server thread.
+void ControlServer::run() {
+  std::vector<struct pollfd> pfds;
+
+  for (;;) {
+    std::size_t nclients;
+    pfds.clear();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_stop) {
+        break;
+      }
+
+      // Close clients which have disconnected or are done.
+      auto it = std::remove_if(m_clients.begin(), m_clients.end(),
+                               [](const std::unique_ptr<Client> &c) {
+                                 bool done = c->closed ||
+                                             (c->eof && c->pending == 0 &&
+                                              c->output.empty());
+                                 if (done) {
+                                   close(c->fd);
+                                 }
+                                 return done;
+                               });
+      m_clients.erase(it, m_clients.end());
+
+      nclients = m_clients.size();
+      for (std::unique_ptr<Client> &c : m_clients) {
+        short events = (c->eof ? 0 : POLLIN) |
+                       (c->output.empty() ? 0 : POLLOUT);
+        pfds.push_back({c->fd, events, 0});
+      }
+    }
+
+    if (!m_listen.poll(pfds)) {
+      continue; // EINTR
+    }
+
+    // Clients are only added and removed by this thread.
+    for (std::size_t i = 0; i < nclients; i++) {
+      Client &c = *m_clients[i];
+      short revents = pfds[i].revents;
+      // After the end of its commands, a hangup means that the client
+      // has gone; before, read what it sent up to the hangup.
+      bool ok = !(revents & (POLLERR | POLLNVAL)) &&
+                !(c.eof && (revents & POLLHUP));
+      if (ok && (revents & (POLLIN | POLLHUP))) {
+        ok = receive(c);
+      }
+      if (ok) {
+        ok = send_output(c);
+      }
+      if (!ok) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        c.closed = true;
+      }
+    }
+
+    int fd;
+    while ((fd = m_listen.accept()) >= 0) {
+      std::unique_ptr<Client> c(new Client);
+      c->fd = fd;
+      c->pending = 0;
+      c->eof = false;
+      c->closed = false;
+      std::lock_guard<std::mutex> lock(m_mutex);
+      c->id = m_next_id++;
+      m_clients.push_back(std::move(c));
+    }
+  }
+}
+
+/* end */
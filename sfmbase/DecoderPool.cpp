@@ -0,0 +1,175 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
+#include "DecoderPool.h"
+
+constexpr unsigned int DecoderPool::default_queue_blocks;
+
+/* ****************  class DecoderPool  **************** */
+
+// Construct pool without stations.
+DecoderPool::DecoderPool(unsigned int skip_blocks, unsigned int nworkers,
+                         LagPolicy lag_policy, unsigned int queue_blocks)
+    : m_skip_blocks(skip_blocks), m_queue_blocks(std::max(1U, queue_blocks)),
+      m_blocks(m_queue_blocks, lag_policy), m_started(false) {
+  if (nworkers > 0) {
+    m_scheduler.reset(new WorkStealingScheduler(nworkers, m_queue_blocks));
+  }
+}
+
+// Destructor.
+DecoderPool::~DecoderPool() { finish(); }
+
+// Add a station and start its thread.
+bool DecoderPool::add_station(FmDecoder *decoder, int cpu) {
+  assert(!m_started);
+
+  std::unique_ptr<Station> st(new Station);
+  st->index = m_stations.size();
+  st->decoder.reset(decoder);
+  st->consumer = 0;
+  st->blocks = 0;
+  st->if_level.store(0);
+  st->stereo.store(false);
+
+  if (m_scheduler) {
+    st->strand = m_scheduler->add_strand();
+    m_stations.push_back(std::move(st));
+    return true;
+  }
+
+  st->consumer = m_blocks.add_consumer();
+  st->thread = std::thread(&DecoderPool::run, this, st.get());
+
+  bool ok = true;
+  if (cpu >= 0) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    int rc = pthread_setaffinity_np(st->thread.native_handle(),
+                                    sizeof(cpuset), &cpuset);
+    if (rc != 0) {
+      m_error = "can not bind station " + std::to_string(st->index) +
+                " to CPU " + std::to_string(cpu) + ": " + strerror(rc);
+      ok = false;
+    }
+  }
+
+  m_stations.push_back(std::move(st));
+  return ok;
+}
+
+// Bind a scheduler worker to a CPU.
+bool DecoderPool::bind_worker(unsigned int worker, int cpu) {
+  if (!m_scheduler) {
+    m_error = "no scheduler workers";
+    return false;
+  }
+  if (!m_scheduler->bind_worker(worker, cpu)) {
+    m_error = m_scheduler->error();
+    return false;
+  }
+  return true;
+}
+
+// Queue a block for all stations.
+void DecoderPool::process(const Block &block) {
+  if (m_scheduler) {
+    for (std::unique_ptr<Station> &st : m_stations) {
+      Station *station = st.get();
+      m_scheduler->submit(st->strand,
+                          [this, station, block] { decode(station, block); });
+    }
+    return;
+  }
+
+  start();
+  m_blocks.push(block);
+}
+
+// Let the station threads start reading blocks.
+void DecoderPool::start() {
+  if (m_started) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_start_mutex);
+    m_started = true;
+  }
+  m_start_cond.notify_all();
+}
+
+// Decode all queued blocks and stop the threads.
+void DecoderPool::finish() {
+  if (m_scheduler) {
+    m_scheduler->finish();
+    for (std::unique_ptr<Station> &st : m_stations) {
+      st->output.push_end();
+    }
+    return;
+  }
+
+  start();
+  m_blocks.push_end();
+  for (std::unique_ptr<Station> &st : m_stations) {
+    if (st->thread.joinable()) {
+      st->thread.join();
+    }
+  }
+}
+
+// Decode one block of a station.
+void DecoderPool::decode(Station *st, const Block &block) {
+  st->decoder->process((*block)[st->index], st->audio);
+
+  st->if_level.store(st->decoder->get_if_level(), std::memory_order_relaxed);
+  st->stereo.store(st->decoder->stereo_detected(), std::memory_order_relaxed);
+
+  // Throw away the first blocks while the filters start up.
+  if (st->blocks++ >= m_skip_blocks) {
+    st->output.push(std::move(st->audio));
+    st->audio = SampleVector();
+  }
+}
+
+// Station thread.
+void DecoderPool::run(Station *st) {
+  // Adding a consumer to m_blocks is not safe while another consumer
+  // reads, so wait until all stations have been added.
+  {
+    std::unique_lock<std::mutex> lock(m_start_mutex);
+    m_start_cond.wait(lock, [this] { return m_started; });
+  }
+
+  for (;;) {
+    Block block = m_blocks.pull(st->consumer);
+    if (!block) {
+      break;
+    }
+    decode(st, block);
+  }
+
+  st->output.push_end();
+}
+
+/* end */
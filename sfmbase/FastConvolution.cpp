@@ -0,0 +1,135 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cassert>
+
+#include "FastConvolution.h"
+
+// Choose the FFT size for a filter with ntaps coefficients.
+// A transform of at least 4 times the filter length keeps the overlap
+// (ntaps - 1 samples per block) below 25% of the work.
+static unsigned int fast_convolution_size(unsigned int ntaps) {
+  return Fft<float>::next_power_of_two(std::max(64U, 4 * ntaps));
+}
+
+/* ****************  class FastConvolutionIQ  **************** */
+
+// Construct FFT convolution engine.
+FastConvolutionIQ::FastConvolutionIQ(
+    const std::vector<IQSample::value_type> &taps)
+    : m_ntaps(taps.size()), m_fft(fast_convolution_size(taps.size())) {
+  assert(m_ntaps > 0);
+
+  unsigned int nfft = m_fft.size();
+  m_block = nfft - (m_ntaps - 1);
+
+  // Precompute the frequency response of the filter,
+  // including the 1/N normalization of the inverse transform.
+  m_kernel.assign(nfft, IQSample(0));
+  for (unsigned int i = 0; i < m_ntaps; i++) {
+    m_kernel[i] = taps[i] / IQSample::value_type(nfft);
+  }
+  m_fft.forward(m_kernel.data());
+
+  // First (ntaps - 1) elements hold the history of the input stream.
+  m_input.assign(nfft, IQSample(0));
+  m_work.resize(nfft);
+}
+
+// Process samples.
+void FastConvolutionIQ::process(const IQSample *in, unsigned int n,
+                                IQSample *out) {
+  unsigned int hist = m_ntaps - 1;
+  unsigned int nfft = m_fft.size();
+
+  // A short final segment costs a full transform but keeps the output
+  // in lock step with the input; samples beyond the segment only
+  // affect outputs that are discarded.
+  for (unsigned int pos = 0; pos < n;) {
+    unsigned int r = std::min(m_block, n - pos);
+
+    std::copy(in + pos, in + pos + r, m_input.begin() + hist);
+    std::copy(m_input.begin(), m_input.begin() + hist + r, m_work.begin());
+    std::fill(m_work.begin() + hist + r, m_work.end(), IQSample(0));
+
+    m_fft.forward(m_work.data());
+    for (unsigned int k = 0; k < nfft; k++) {
+      m_work[k] *= m_kernel[k];
+    }
+    m_fft.inverse(m_work.data());
+
+    // The first (ntaps - 1) outputs are corrupted by circular wrap-around.
+    std::copy(m_work.begin() + hist, m_work.begin() + hist + r, out + pos);
+
+    // Keep the last (ntaps - 1) input samples as history.
+    std::copy(m_input.begin() + r, m_input.begin() + r + hist,
+              m_input.begin());
+
+    pos += r;
+  }
+}
+
+/* ****************  class FastConvolution  **************** */
+
+// Construct FFT convolution engine.
+FastConvolution::FastConvolution(const SampleVector &taps)
+    : m_ntaps(taps.size()), m_fft(fast_convolution_size(taps.size())) {
+  assert(m_ntaps > 0);
+
+  unsigned int nfft = m_fft.size();
+  m_block = nfft - (m_ntaps - 1);
+
+  SampleVector padded(nfft, 0);
+  for (unsigned int i = 0; i < m_ntaps; i++) {
+    padded[i] = taps[i] / Sample(nfft);
+  }
+  m_kernel.resize(nfft / 2 + 1);
+  m_fft.forward(padded.data(), m_kernel.data());
+
+  m_spectrum.resize(nfft / 2 + 1);
+  m_input.assign(nfft, 0);
+  m_work.resize(nfft);
+}
+
+// Process samples.
+void FastConvolution::process(const Sample *in, unsigned int n, Sample *out) {
+  unsigned int hist = m_ntaps - 1;
+  unsigned int nbins = m_fft.size() / 2 + 1;
+
+  for (unsigned int pos = 0; pos < n;) {
+    unsigned int r = std::min(m_block, n - pos);
+
+    std::copy(in + pos, in + pos + r, m_input.begin() + hist);
+    std::fill(m_input.begin() + hist + r, m_input.end(), 0);
+
+    m_fft.forward(m_input.data(), m_spectrum.data());
+    for (unsigned int k = 0; k < nbins; k++) {
+      m_spectrum[k] *= m_kernel[k];
+    }
+    m_fft.inverse(m_spectrum.data(), m_work.data());
+
+    std::copy(m_work.begin() + hist, m_work.begin() + hist + r, out + pos);
+
+    std::copy(m_input.begin() + r, m_input.begin() + r + hist,
+              m_input.begin());
+
+    pos += r;
+  }
+}
+
+/* end */
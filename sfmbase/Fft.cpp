@@ -0,0 +1,202 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "Fft.h"
+
+/* ****************  class Fft  **************** */
+
+// Construct FFT.
+template <class T>
+Fft<T>::Fft(unsigned int size) : m_size(size), m_bitrev(size) {
+  assert(is_power_of_two(size));
+
+  unsigned int nbits = 0;
+  while ((1U << nbits) < size) {
+    nbits++;
+  }
+
+  // Bit-reversed index table.
+  for (unsigned int i = 0; i < size; i++) {
+    unsigned int r = 0;
+    for (unsigned int b = 0; b < nbits; b++) {
+      r |= ((i >> b) & 1) << (nbits - 1 - b);
+    }
+    m_bitrev[i] = r;
+  }
+
+  // Twiddle factors for each radix-4 pass, stored contiguously as
+  // w**1, w**2, w**3 for w = exp(-2 * pi * j * i / (4 * len)),
+  // i = 0 .. len-1, so that the butterfly loop scans them forward.
+  unsigned int len = ((size & 0x55555555) == 0 && size > 1) ? 2 : 1;
+  for (; len < size; len *= 4) {
+    for (unsigned int m = 1; m <= 3; m++) {
+      for (unsigned int i = 0; i < len; i++) {
+        double phi = -2.0 * M_PI * m * i / double(4 * len);
+        m_twiddle.push_back(Complex(cos(phi), sin(phi)));
+        m_twiddle_inv.push_back(Complex(cos(phi), -sin(phi)));
+      }
+    }
+  }
+}
+
+// Forward transform in-place.
+template <class T> void Fft<T>::forward(Complex *data) const {
+  transform<false>(data);
+}
+
+// Inverse transform in-place.
+template <class T> void Fft<T>::inverse(Complex *data) const {
+  transform<true>(data);
+}
+
+// Decimation-in-time transform.
+template <class T>
+template <bool inverse>
+void Fft<T>::transform(Complex *data) const {
+  unsigned int n = m_size;
+
+  // Reorder input in bit-reversed order.
+  for (unsigned int i = 0; i < n; i++) {
+    unsigned int r = m_bitrev[i];
+    if (r > i) {
+      std::swap(data[i], data[r]);
+    }
+  }
+
+  // One radix-2 pass if log2(n) is odd.
+  unsigned int len = 1;
+  if ((n > 1) && ((n & 0x55555555) == 0)) {
+    for (unsigned int i = 0; i < n; i += 2) {
+      Complex a0 = data[i];
+      Complex a1 = data[i + 1];
+      data[i] = a0 + a1;
+      data[i + 1] = a0 - a1;
+    }
+    len = 2;
+  }
+
+  // Radix-4 passes, each merging four transforms of size len.
+  //
+  // The input of a butterfly is in radix-2 bit-reversed order, so
+  // a0 ... a3 are the transforms of the sub-sequences x[4m], x[4m+2],
+  // x[4m+1], x[4m+3] respectively.
+  const Complex *tw = inverse ? m_twiddle_inv.data() : m_twiddle.data();
+  for (; len < n; tw += 3 * len, len *= 4) {
+    const Complex *w1 = tw;
+    const Complex *w2 = tw + len;
+    const Complex *w3 = tw + 2 * len;
+    for (unsigned int g = 0; g < n; g += 4 * len) {
+      Complex *p = data + g;
+      for (unsigned int j = 0; j < len; j++) {
+        Complex p0 = p[j];
+        Complex p1 = p[j + len] * w2[j];
+        Complex p2 = p[j + 2 * len] * w1[j];
+        Complex p3 = p[j + 3 * len] * w3[j];
+
+        Complex b0 = p0 + p1;
+        Complex b1 = p0 - p1;
+        Complex c0 = p2 + p3;
+        Complex c1 = p2 - p3;
+
+        // Multiply c1 by -j (forward) or +j (inverse).
+        Complex d1 = inverse ? Complex(-c1.imag(), c1.real())
+                             : Complex(c1.imag(), -c1.real());
+
+        p[j] = b0 + c0;
+        p[j + len] = b1 + d1;
+        p[j + 2 * len] = b0 - c0;
+        p[j + 3 * len] = b1 - d1;
+      }
+    }
+  }
+}
+
+/* ****************  class RealFft  **************** */
+
+// Construct real FFT.
+template <class T>
+RealFft<T>::RealFft(unsigned int size)
+    : m_size(size), m_fft(size / 2), m_twiddle(size / 2 + 1),
+      m_work(size / 2) {
+  assert(size >= 2 && Fft<T>::is_power_of_two(size));
+
+  for (unsigned int k = 0; k <= size / 2; k++) {
+    double phi = -2.0 * M_PI * k / double(size);
+    m_twiddle[k] = Complex(cos(phi), sin(phi));
+  }
+}
+
+// Forward transform.
+template <class T> void RealFft<T>::forward(const T *in, Complex *out) {
+  unsigned int h = m_size / 2;
+
+  // Pack even samples into the real part and odd samples into
+  // the imaginary part.
+  for (unsigned int i = 0; i < h; i++) {
+    m_work[i] = Complex(in[2 * i], in[2 * i + 1]);
+  }
+
+  m_fft.forward(m_work.data());
+
+  // Separate the spectra of the even and odd sub-sequences:
+  //   E[k] = (Z[k] + conj(Z[h-k])) / 2
+  //   O[k] = (Z[k] - conj(Z[h-k])) / 2j
+  //   X[k] = E[k] + exp(-2*pi*j*k/N) * O[k]
+  for (unsigned int k = 0; k <= h; k++) {
+    Complex zk = m_work[(k == h) ? 0 : k];
+    Complex zc = std::conj(m_work[(k == 0) ? 0 : h - k]);
+    Complex e = (zk + zc) * T(0.5);
+    Complex d = (zk - zc) * T(0.5);
+    Complex o(d.imag(), -d.real());
+    out[k] = e + m_twiddle[k] * o;
+  }
+}
+
+// Inverse transform.
+template <class T> void RealFft<T>::inverse(const Complex *in, T *out) {
+  unsigned int h = m_size / 2;
+
+  // Rebuild the packed half-size spectrum:
+  //   E[k] = X[k] + conj(X[h-k])
+  //   O[k] = (X[k] - conj(X[h-k])) * exp(2*pi*j*k/N)
+  //   Z[k] = E[k] + j * O[k]
+  for (unsigned int k = 0; k < h; k++) {
+    Complex xk = in[k];
+    Complex xc = std::conj(in[h - k]);
+    Complex e = xk + xc;
+    Complex o = (xk - xc) * std::conj(m_twiddle[k]);
+    m_work[k] = e + Complex(-o.imag(), o.real());
+  }
+
+  m_fft.inverse(m_work.data());
+
+  for (unsigned int i = 0; i < h; i++) {
+    out[2 * i] = m_work[i].real();
+    out[2 * i + 1] = m_work[i].imag();
+  }
+}
+
+template class Fft<float>;
+template class Fft<double>;
+template class RealFft<float>;
+template class RealFft<double>;
+
+/* end */
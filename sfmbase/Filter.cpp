@@ -59,6 +59,146 @@ static void make_lanczos_coeff(unsigned int filter_order, double cutoff,
   }
 }
 
+/* ****************  FIR kernels  **************** */
+
+// All FIR kernels exploit the symmetry of the Lanczos coefficients
+// (coeff[j] == coeff[ntaps-1-j]) by adding mirrored samples before
+// multiplying, which halves the number of multiplications.
+
+// The mirrored samples are addressed through a reversed pointer with
+// a signed index, which GCC vectorizes much better than x[ntaps-1-j].
+
+// Symmetric dot product of ntaps samples starting at x.
+template <class T, class C>
+static inline T fir_dot_folded(const T *x, const C *coeff,
+                               unsigned int ntaps) {
+  int half = ntaps / 2;
+  const T *xr = x + ntaps - 1;
+  T y = (ntaps & 1) ? x[half] * coeff[half] : T(0);
+  for (int j = 0; j < half; j++) {
+    y += (x[j] + xr[-j]) * coeff[j];
+  }
+  return y;
+}
+
+// Generic IQ FIR kernel.
+static void fir_kernel_iq_generic(const IQSample *inp,
+                                  const IQSample::value_type *coeff,
+                                  unsigned int ntaps, IQSample *out,
+                                  unsigned int n) {
+  for (unsigned int i = 0; i < n; i++) {
+    out[i] = fir_dot_folded(inp + i, coeff, ntaps);
+  }
+}
+
+// IQ FIR kernel for a fixed number of taps.
+// The constant trip count lets the compiler fully unroll and vectorize
+// the inner loop; I and Q are accumulated separately for the same reason.
+template <unsigned int ntaps>
+static void fir_kernel_iq(const IQSample *inp,
+                          const IQSample::value_type *coeff, unsigned int,
+                          IQSample *out, unsigned int n) {
+  const int half = ntaps / 2;
+  for (unsigned int i = 0; i < n; i++) {
+    const IQSample *x = inp + i;
+    const IQSample *xr = x + ntaps - 1;
+    IQSample::value_type yi = 0, yq = 0;
+    if (ntaps & 1) {
+      yi = x[half].real() * coeff[half];
+      yq = x[half].imag() * coeff[half];
+    }
+    for (int j = 0; j < half; j++) {
+      yi += (x[j].real() + xr[-j].real()) * coeff[j];
+      yq += (x[j].imag() + xr[-j].imag()) * coeff[j];
+    }
+    out[i] = IQSample(yi, yq);
+  }
+}
+
+// Select the IQ FIR kernel for the specified number of taps.
+static LowPassFilterFirIQ::Kernel select_fir_kernel_iq(unsigned int ntaps) {
+  switch (ntaps) {
+  case 11: // FmDecoder IF filter (order 10)
+    return fir_kernel_iq<11>;
+  default:
+    return fir_kernel_iq_generic;
+  }
+}
+
+// Generic decimating FIR kernel.
+static void fir_kernel_decim_generic(const Sample *inp, const Sample *coeff,
+                                     unsigned int ntaps, unsigned int step,
+                                     Sample *out, unsigned int n) {
+  for (unsigned int i = 0; i < n; i++) {
+    out[i] = fir_dot_folded(inp + i * step, coeff, ntaps);
+  }
+}
+
+// Decimating FIR kernel for a fixed number of taps and decimation factor.
+template <unsigned int ntaps, unsigned int step>
+static void fir_kernel_decim(const Sample *inp, const Sample *coeff,
+                             unsigned int, unsigned int, Sample *out,
+                             unsigned int n) {
+  const int half = ntaps / 2;
+  for (unsigned int i = 0; i < n; i++) {
+    const Sample *x = inp + i * step;
+    const Sample *xr = x + ntaps - 1;
+    Sample y = (ntaps & 1) ? x[half] * coeff[half] : 0;
+    for (int j = 0; j < half; j++) {
+      y += (x[j] + xr[-j]) * coeff[j];
+    }
+    out[i] = y;
+  }
+}
+
+// Select the decimating FIR kernel for the specified number of taps
+// and decimation factor.
+// FmDecoder downsamples the baseband by an integer factor d with a filter
+// of 8 * d taps; d depends on the IF sample rate (960 kHz -> 4,
+// 2.4 MHz -> 10, 2.5 MHz -> 11, 5 MHz -> 22, 10 MHz -> 45, ...).
+static DownsampleFilter::Kernel select_fir_kernel_decim(unsigned int ntaps,
+                                                        unsigned int step) {
+  if (ntaps != 8 * step) {
+    return fir_kernel_decim_generic;
+  }
+  switch (step) {
+  case 2:
+    return fir_kernel_decim<16, 2>;
+  case 3:
+    return fir_kernel_decim<24, 3>;
+  case 4:
+    return fir_kernel_decim<32, 4>;
+  case 5:
+    return fir_kernel_decim<40, 5>;
+  case 6:
+    return fir_kernel_decim<48, 6>;
+  case 7:
+    return fir_kernel_decim<56, 7>;
+  case 8:
+    return fir_kernel_decim<64, 8>;
+  case 9:
+    return fir_kernel_decim<72, 9>;
+  case 10:
+    return fir_kernel_decim<80, 10>;
+  case 11:
+    return fir_kernel_decim<88, 11>;
+  case 13:
+    return fir_kernel_decim<104, 13>;
+  case 14:
+    return fir_kernel_decim<112, 14>;
+  case 22:
+    return fir_kernel_decim<176, 22>;
+  case 27:
+    return fir_kernel_decim<216, 27>;
+  case 36:
+    return fir_kernel_decim<288, 36>;
+  case 45:
+    return fir_kernel_decim<360, 45>;
+  default:
+    return fir_kernel_decim_generic;
+  }
+}
+
 /* ****************  class FineTuner  **************** */
 
 // Construct finetuner.
@@ -99,6 +239,12 @@ void FineTuner::process(const IQSampleVector &samples_in,
 LowPassFilterFirIQ::LowPassFilterFirIQ(unsigned int filter_order, double cutoff)
     : m_state(filter_order) {
   make_lanczos_coeff(filter_order, cutoff, m_coeff);
+  m_kernel = select_fir_kernel_iq(m_coeff.size());
+
+  // Use FFT convolution for long filters.
+  if (m_coeff.size() >= fast_convolution_min_taps) {
+    m_fastconv.reset(new FastConvolutionIQ(m_coeff));
+  }
 }
 
 // Process samples.
@@ -113,31 +259,30 @@ void LowPassFilterFirIQ::process(const IQSampleVector &samples_in,
     return;
   }
 
+  if (m_fastconv) {
+    m_fastconv->process(samples_in.data(), n, samples_out.data());
+    return;
+  }
+
   // NOTE: We use m_coeff the wrong way around because it is slightly
   // faster to scan forward through the array. The result is still correct
   // because the coefficients are symmetric.
 
   // The first few samples need data from m_state.
-  unsigned int i = 0;
-  for (; i < n && i < order; i++) {
-    IQSample y = 0;
-    for (unsigned int j = 0; j < order - i; j++) {
-      y += m_state[i + j] * m_coeff[j];
-    }
-    for (unsigned int j = order - i; j <= order; j++) {
-      y += samples_in[i - order + j] * m_coeff[j];
-    }
-    samples_out[i] = y;
-  }
+  // Join m_state with the start of the block so that these samples
+  // can be computed by the same kernel.
+  unsigned int nhead = std::min(n, order);
+  m_headbuf.resize(order + nhead);
+  copy(m_state.begin(), m_state.end(), m_headbuf.begin());
+  copy(samples_in.begin(), samples_in.begin() + nhead,
+       m_headbuf.begin() + order);
+  m_kernel(m_headbuf.data(), m_coeff.data(), order + 1, samples_out.data(),
+           nhead);
 
   // Remaining samples only need data from samples_in.
-  for (; i < n; i++) {
-    IQSample y = 0;
-    IQSampleVector::const_iterator inp = samples_in.begin() + i - order;
-    for (unsigned int j = 0; j <= order; j++) {
-      y += inp[j] * m_coeff[j];
-    }
-    samples_out[i] = y;
+  if (nhead < n) {
+    m_kernel(samples_in.data(), m_coeff.data(), order + 1,
+             samples_out.data() + nhead, n - nhead);
   }
 
   // Update m_state.
@@ -156,7 +301,8 @@ DownsampleFilter::DownsampleFilter(unsigned int filter_order, double cutoff,
                                    double downsample, bool integer_factor)
     : m_downsample(downsample),
       m_downsample_int(integer_factor ? lrint(downsample) : 0), m_pos_int(0),
-      m_pos_frac(0), m_state(filter_order) {
+      m_pos_frac(0), m_state(filter_order),
+      m_kernel(select_fir_kernel_decim(filter_order, m_downsample_int)) {
   assert(downsample >= 1);
   assert(filter_order > 1);
 
@@ -166,6 +312,15 @@ DownsampleFilter::DownsampleFilter(unsigned int filter_order, double cutoff,
   make_lanczos_coeff(filter_order - 1, cutoff, m_coeff);
   m_coeff.insert(m_coeff.begin(), 0);
   m_coeff.push_back(0);
+
+  // Use FFT convolution for long filters.
+  // The engine computes h[p] = sum(m_coeff[j+1] * samples_in[p-j]),
+  // so the direct form output for position p equals h[p-1].
+  if (filter_order >= fast_convolution_min_taps * downsample) {
+    SampleVector taps(m_coeff.begin() + 1, m_coeff.end() - 1);
+    m_fastconv.reset(new FastConvolution(taps));
+    m_fastbuf.assign(1, 0);
+  }
 }
 
 // Process samples.
@@ -174,6 +329,14 @@ void DownsampleFilter::process(const SampleVector &samples_in,
   unsigned int order = m_state.size();
   unsigned int n = samples_in.size();
 
+  if (m_fastconv) {
+    // Run the filter at the full input rate.
+    // m_fastbuf[p] is the filter output for input position p,
+    // m_fastbuf[0] is carried over from the previous block.
+    m_fastbuf.resize(n + 1);
+    m_fastconv->process(samples_in.data(), n, m_fastbuf.data() + 1);
+  }
+
   if (m_downsample_int != 0) {
 
     // Integer downsample factor, no linear interpolation.
@@ -184,26 +347,39 @@ void DownsampleFilter::process(const SampleVector &samples_in,
 
     samples_out.resize((n - p + pstep - 1) / pstep);
 
-    // The first few samples need data from m_state.
     unsigned int i = 0;
-    for (; p < n && p < order; p += pstep, i++) {
-      Sample y = 0;
-      for (unsigned int j = 1; j <= p; j++) {
-        y += samples_in[p - j] * m_coeff[j];
-      }
-      for (unsigned int j = p + 1; j <= order; j++) {
-        y += m_state[order + p - j] * m_coeff[j];
+
+    // Pick filtered samples if FFT convolution is used.
+    if (m_fastconv) {
+      for (; p < n; p += pstep, i++) {
+        samples_out[i] = m_fastbuf[p];
       }
-      samples_out[i] = y;
+    }
+
+    // The first few samples need data from m_state.
+    // Join m_state with the start of the block as for LowPassFilterFirIQ.
+    if (p < n && p < order) {
+      unsigned int nhead = std::min(n, order);
+      unsigned int nout = (nhead - p + pstep - 1) / pstep;
+      m_histbuf.resize(order + nhead);
+      copy(m_state.begin(), m_state.end(), m_histbuf.begin());
+      copy(samples_in.begin(), samples_in.begin() + nhead,
+           m_histbuf.begin() + order);
+      m_kernel(m_histbuf.data() + p, m_coeff.data() + 1, order, pstep,
+               samples_out.data() + i, nout);
+      p += nout * pstep;
+      i += nout;
     }
 
     // Remaining samples only need data from samples_in.
-    for (; p < n; p += pstep, i++) {
-      Sample y = 0;
-      for (unsigned int j = 1; j <= order; j++) {
-        y += samples_in[p - j] * m_coeff[j];
-      }
-      samples_out[i] = y;
+    // The kernel scans the coefficients forward, which gives the same
+    // result because m_coeff[1 .. order] is symmetric.
+    if (p < n) {
+      unsigned int nout = (n - p + pstep - 1) / pstep;
+      m_kernel(samples_in.data() + p - order, m_coeff.data() + 1, order,
+               pstep, samples_out.data() + i, nout);
+      p += nout * pstep;
+      i += nout;
     }
 
     assert(i == samples_out.size());
@@ -215,6 +391,17 @@ void DownsampleFilter::process(const SampleVector &samples_in,
 
     // Fractional downsample factor via linear interpolation of
     // the FIR coefficient table. This is a real headache.
+    //
+    // Interpolating the coefficients is equivalent to interpolating
+    // between the filter outputs for input positions pi and pi+1,
+    // each of which is a symmetric dot product over m_coeff[1 .. order].
+    // The filter history is joined with the block so that both
+    // dot products scan contiguous memory.
+    if (!m_fastconv) {
+      m_histbuf.resize(order + n);
+      copy(m_state.begin(), m_state.end(), m_histbuf.begin());
+      copy(samples_in.begin(), samples_in.end(), m_histbuf.begin() + order);
+    }
 
     // Estimate number of output samples we can produce in this run.
     Sample p = m_pos_frac;
@@ -231,11 +418,14 @@ void DownsampleFilter::process(const SampleVector &samples_in,
       Sample k1 = pf - pi;
       Sample k0 = 1 - k1;
 
-      Sample y = 0;
-      for (unsigned int j = 0; j <= order; j++) {
-        Sample k = m_coeff[j] * k0 + m_coeff[j + 1] * k1;
-        Sample s = (j <= pi) ? samples_in[pi - j] : m_state[order + pi - j];
-        y += k * s;
+      Sample y;
+      if (m_fastconv) {
+        y = k0 * m_fastbuf[pi] + k1 * m_fastbuf[pi + 1];
+      } else {
+        const Sample *x = m_histbuf.data() + pi;
+        const Sample *c = m_coeff.data() + 1;
+        y = k0 * fir_dot_folded(x, c, order) +
+            k1 * fir_dot_folded(x + 1, c, order);
       }
       samples_out[i] = y;
 
@@ -256,6 +446,10 @@ void DownsampleFilter::process(const SampleVector &samples_in,
     }
   }
 
+  if (m_fastconv) {
+    m_fastbuf[0] = m_fastbuf[n];
+  }
+
   // Update m_state.
   if (n < order) {
     copy(m_state.begin() + n, m_state.end(), m_state.begin());
@@ -271,8 +465,18 @@ void DownsampleFilter::process(const SampleVector &samples_in,
 LowPassFilterRC::LowPassFilterRC(double timeconst)
     : m_timeconst(timeconst), m_y0_1(0), m_y1_1(0) {
   m_a1 = -exp(-1 / m_timeconst);
-  ;
   m_b0 = 1 + m_a1;
+
+  // Unrolling the recurrence y[k] = b0 * x[k] + a * y[k-1], a = -a1,
+  // over four samples gives
+  //   y[k] = sum(b0 * a**(k-m) * x[m], m = 0 .. k) + a**(k+1) * y[-1].
+  Sample a = -m_a1;
+  Sample ak = 1;
+  for (unsigned int k = 0; k < 4; k++) {
+    m_g[k] = m_b0 * ak;
+    ak *= a;
+    m_p[k] = ak;
+  }
 }
 
 // Process samples.
@@ -287,82 +491,90 @@ void LowPassFilterRC::process(const SampleVector &samples_in,
    */
   unsigned int n = samples_in.size();
   samples_out.resize(n);
-
-  Sample y = m_y0_1;
-
-  for (unsigned int i = 0; i < n; i++) {
-    Sample x = samples_in[i];
-    y = m_b0 * x - m_a1 * y;
-    samples_out[i] = y;
-  }
-
-  m_y0_1 = y;
+  process_block(samples_in.data(), samples_out.data(), n);
 }
 
 // Process interleaved samples.
 void LowPassFilterRC::process_interleaved(const SampleVector &samples_in,
                                           SampleVector &samples_out) {
-  /*
-   * Continuous domain:
-   *   H(s) = 1 / (1 - s * timeconst)
-   *
-   * Discrete domain:
-   *   H(z) = (1 - exp(-1/timeconst)) / (1 - exp(-1/timeconst) / z)
-   */
   unsigned int n = samples_in.size();
   samples_out.resize(n);
-
-  Sample y0 = m_y0_1;
-  Sample y1 = m_y1_1;
-
-  for (unsigned int i = 0; i < n - 1; i += 2) {
-    Sample x0 = samples_in[i];
-    y0 = m_b0 * x0 - m_a1 * y0;
-    samples_out[i] = y0;
-
-    Sample x1 = samples_in[i + 1];
-    y1 = m_b0 * x1 - m_a1 * y1;
-    samples_out[i + 1] = y1;
-  }
-
-  m_y0_1 = y0;
-  m_y1_1 = y1;
+  process_pairs(samples_in.data(), samples_out.data(), n / 2);
 }
 
 // Process samples in-place.
 void LowPassFilterRC::process_inplace(SampleVector &samples) {
-  unsigned int n = samples.size();
+  process_block(samples.data(), samples.data(), samples.size());
+}
+
+// Process interleaved samples in-place.
+void LowPassFilterRC::process_interleaved_inplace(SampleVector &samples) {
+  process_pairs(samples.data(), samples.data(), samples.size() / 2);
+}
 
+// Process a single channel with four samples of look-ahead.
+void LowPassFilterRC::process_block(const Sample *in, Sample *out,
+                                    unsigned int n) {
   Sample y = m_y0_1;
+  unsigned int i = 0;
 
-  for (unsigned int i = 0; i < n; i++) {
-    Sample x = samples[i];
-    y = m_b0 * x - m_a1 * y;
-    samples[i] = y;
+  for (; i + 4 <= n; i += 4) {
+    Sample x0 = in[i], x1 = in[i + 1], x2 = in[i + 2], x3 = in[i + 3];
+
+    // These terms do not depend on y and can be computed in parallel.
+    Sample u0 = m_g[0] * x0;
+    Sample u1 = m_g[0] * x1 + m_g[1] * x0;
+    Sample u2 = m_g[0] * x2 + m_g[1] * x1 + m_g[2] * x0;
+    Sample u3 = m_g[0] * x3 + m_g[1] * x2 + m_g[2] * x1 + m_g[3] * x0;
+
+    out[i] = u0 + m_p[0] * y;
+    out[i + 1] = u1 + m_p[1] * y;
+    out[i + 2] = u2 + m_p[2] * y;
+    y = u3 + m_p[3] * y;
+    out[i + 3] = y;
+  }
+
+  for (; i < n; i++) {
+    y = m_b0 * in[i] - m_a1 * y;
+    out[i] = y;
   }
 
   m_y0_1 = y;
 }
 
-// Process interleaved samples in-place.
-void LowPassFilterRC::process_interleaved_inplace(SampleVector &samples) {
-  unsigned int n = samples.size();
-
-  Sample y0 = m_y0_1;
-  Sample y1 = m_y1_1;
+// Process two interleaved channels in parallel lanes.
+void LowPassFilterRC::process_pairs(const Sample *in, Sample *out,
+                                    unsigned int n) {
+  Sample y[2] = {m_y0_1, m_y1_1};
+  unsigned int i = 0;
 
-  for (unsigned int i = 0; i < n - 1; i += 2) {
-    Sample x0 = samples[i];
-    y0 = m_b0 * x0 - m_a1 * y0;
-    samples[i] = y0;
+  // Same look-ahead as process_block(), with one lane per channel.
+  for (; i + 4 <= n; i += 4) {
+    const Sample *x = in + 2 * i;
+    Sample *o = out + 2 * i;
+    for (unsigned int k = 0; k < 2; k++) {
+      Sample u0 = m_g[0] * x[k];
+      Sample u1 = m_g[0] * x[2 + k] + m_g[1] * x[k];
+      Sample u2 = m_g[0] * x[4 + k] + m_g[1] * x[2 + k] + m_g[2] * x[k];
+      Sample u3 = m_g[0] * x[6 + k] + m_g[1] * x[4 + k] +
+                  m_g[2] * x[2 + k] + m_g[3] * x[k];
+      o[k] = u0 + m_p[0] * y[k];
+      o[2 + k] = u1 + m_p[1] * y[k];
+      o[4 + k] = u2 + m_p[2] * y[k];
+      y[k] = u3 + m_p[3] * y[k];
+      o[6 + k] = y[k];
+    }
+  }
 
-    Sample x1 = samples[i + 1];
-    y1 = m_b0 * x1 - m_a1 * y1;
-    samples[i + 1] = y1;
+  for (; i < n; i++) {
+    for (unsigned int k = 0; k < 2; k++) {
+      y[k] = m_b0 * in[2 * i + k] - m_a1 * y[k];
+      out[2 * i + k] = y[k];
+    }
   }
 
-  m_y0_1 = y0;
-  m_y1_1 = y1;
+  m_y0_1 = y[0];
+  m_y1_1 = y[1];
 }
 
 /* ****************  class LowPassFilterIir  **************** */
@@ -461,38 +673,155 @@ HighPassFilterIir::HighPassFilterIir(double cutoff)
   b0 /= g;
   b1 /= g;
   b2 /= g;
+
+  // Block coefficients for four outputs per step.
+  // h is the impulse response of 1 / (1 + a1/z + a2/z**2),
+  // c1 and c2 are its zero-input responses to y[-1] = 1 and y[-2] = 1.
+  Sample hm1 = 0, hm2 = 0;
+  Sample c1m1 = 1, c1m2 = 0;
+  Sample c2m1 = 0, c2m2 = 1;
+  for (unsigned int k = 0; k < 4; k++) {
+    h[k] = ((k == 0) ? 1 : 0) - a1 * hm1 - a2 * hm2;
+    c1[k] = -a1 * c1m1 - a2 * c1m2;
+    c2[k] = -a1 * c2m1 - a2 * c2m2;
+    hm2 = hm1;
+    hm1 = h[k];
+    c1m2 = c1m1;
+    c1m1 = c1[k];
+    c2m2 = c2m1;
+    c2m1 = c2[k];
+  }
 }
 
 // Process samples.
 void HighPassFilterIir::process(const SampleVector &samples_in,
                                 SampleVector &samples_out) {
   unsigned int n = samples_in.size();
-
   samples_out.resize(n);
-
-  for (unsigned int i = 0; i < n; i++) {
-    Sample x = samples_in[i];
-    Sample y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
-    x2 = x1;
-    x1 = x;
-    y2 = y1;
-    y1 = y;
-    samples_out[i] = y;
-  }
+  process_block(samples_in.data(), samples_out.data(), n);
 }
 
 // Process samples in-place.
 void HighPassFilterIir::process_inplace(SampleVector &samples) {
-  unsigned int n = samples.size();
+  process_block(samples.data(), samples.data(), samples.size());
+}
 
-  for (unsigned int i = 0; i < n; i++) {
-    Sample x = samples[i];
+// Process samples in block state-space form.
+void HighPassFilterIir::process_block(const Sample *in, Sample *out,
+                                      unsigned int n) {
+  unsigned int i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    Sample u0 = in[i], u1 = in[i + 1], u2 = in[i + 2], u3 = in[i + 3];
+
+    // Feed-forward part, independent of the output.
+    Sample v0 = b0 * u0 + b1 * x1 + b2 * x2;
+    Sample v1 = b0 * u1 + b1 * u0 + b2 * x1;
+    Sample v2 = b0 * u2 + b1 * u1 + b2 * u0;
+    Sample v3 = b0 * u3 + b1 * u2 + b2 * u1;
+
+    // Each output depends on the state of the previous step only.
+    Sample s0 = c1[0] * y1 + c2[0] * y2;
+    Sample s1 = c1[1] * y1 + c2[1] * y2;
+    Sample s2 = c1[2] * y1 + c2[2] * y2;
+    Sample s3 = c1[3] * y1 + c2[3] * y2;
+
+    out[i] = h[0] * v0 + s0;
+    out[i + 1] = h[0] * v1 + h[1] * v0 + s1;
+    Sample yb = h[0] * v2 + h[1] * v1 + h[2] * v0 + s2;
+    Sample ya = h[0] * v3 + h[1] * v2 + h[2] * v1 + h[3] * v0 + s3;
+    out[i + 2] = yb;
+    out[i + 3] = ya;
+
+    x2 = u2;
+    x1 = u3;
+    y2 = yb;
+    y1 = ya;
+  }
+
+  for (; i < n; i++) {
+    Sample x = in[i];
     Sample y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
     x2 = x1;
     x1 = x;
     y2 = y1;
     y1 = y;
-    samples[i] = y;
+    out[i] = y;
+  }
+}
+
+// Process two sample streams in parallel lanes.
+void HighPassFilterIir::process_pair(HighPassFilterIir &f0, const Sample *in0,
+                                     Sample *out0, HighPassFilterIir &f1,
+                                     const Sample *in1, Sample *out1,
+                                     unsigned int n) {
+  // The block state-space form of process_block(), with each quantity
+  // held in a two-element array so that both filters run in SIMD lanes.
+  HighPassFilterIir *f[2] = {&f0, &f1};
+  const Sample *in[2] = {in0, in1};
+  Sample *out[2] = {out0, out1};
+
+  Sample vb0[2], vb1[2], vb2[2], vh[4][2], vc1[4][2], vc2[4][2];
+  Sample vx1[2], vx2[2], vy1[2], vy2[2];
+  for (unsigned int k = 0; k < 2; k++) {
+    vb0[k] = f[k]->b0;
+    vb1[k] = f[k]->b1;
+    vb2[k] = f[k]->b2;
+    for (unsigned int j = 0; j < 4; j++) {
+      vh[j][k] = f[k]->h[j];
+      vc1[j][k] = f[k]->c1[j];
+      vc2[j][k] = f[k]->c2[j];
+    }
+    vx1[k] = f[k]->x1;
+    vx2[k] = f[k]->x2;
+    vy1[k] = f[k]->y1;
+    vy2[k] = f[k]->y2;
+  }
+
+  unsigned int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    Sample u[4][2], v[4][2], y[4][2];
+    for (unsigned int k = 0; k < 2; k++) {
+      for (unsigned int j = 0; j < 4; j++) {
+        u[j][k] = in[k][i + j];
+      }
+      v[0][k] = vb0[k] * u[0][k] + vb1[k] * vx1[k] + vb2[k] * vx2[k];
+      v[1][k] = vb0[k] * u[1][k] + vb1[k] * u[0][k] + vb2[k] * vx1[k];
+      v[2][k] = vb0[k] * u[2][k] + vb1[k] * u[1][k] + vb2[k] * u[0][k];
+      v[3][k] = vb0[k] * u[3][k] + vb1[k] * u[2][k] + vb2[k] * u[1][k];
+      for (unsigned int j = 0; j < 4; j++) {
+        Sample acc = vc1[j][k] * vy1[k] + vc2[j][k] * vy2[k];
+        for (unsigned int m = 0; m <= j; m++) {
+          acc += vh[j - m][k] * v[m][k];
+        }
+        y[j][k] = acc;
+        out[k][i + j] = acc;
+      }
+      vx2[k] = u[2][k];
+      vx1[k] = u[3][k];
+      vy2[k] = y[2][k];
+      vy1[k] = y[3][k];
+    }
+  }
+
+  for (; i < n; i++) {
+    for (unsigned int k = 0; k < 2; k++) {
+      Sample x = in[k][i];
+      Sample y = vb0[k] * x + vb1[k] * vx1[k] + vb2[k] * vx2[k] -
+                 f[k]->a1 * vy1[k] - f[k]->a2 * vy2[k];
+      vx2[k] = vx1[k];
+      vx1[k] = x;
+      vy2[k] = vy1[k];
+      vy1[k] = y;
+      out[k][i] = y;
+    }
+  }
+
+  for (unsigned int k = 0; k < 2; k++) {
+    f[k]->x1 = vx1[k];
+    f[k]->x2 = vx2[k];
+    f[k]->y1 = vy1[k];
+    f[k]->y2 = vy2[k];
   }
 }
 
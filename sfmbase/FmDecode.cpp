@@ -16,11 +16,22 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <ctime>
 
 #include "FmDecode.h"
 
+// Return CPU time of the calling thread in seconds.
+static double thread_cpu_time() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+    return 0;
+  }
+  return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
 // Compute RMS over a small prefix of the specified sample vector.
 double rms_level_approx(const IQSampleVector &samples) {
   unsigned int n = samples.size();
@@ -48,15 +59,19 @@ PhaseDiscriminator::PhaseDiscriminator(double max_freq_dev)
 // András Retzler, HA7ILM, is used here, as
 // presented in https://github.com/simonyiszk/csdr/blob/master/libcsdr.c
 // as fmdemod_quadri_cf().
-inline void PhaseDiscriminator::process(const IQSampleVector &samples_in,
-                                        SampleVector &samples_out) {
+void PhaseDiscriminator::process(const IQSampleVector &samples_in,
+                                 SampleVector &samples_out) {
   unsigned int n = samples_in.size();
   samples_out.resize(n);
 
-  // Made static for speeding up processing.
-  static SampleVector temp(n);
-  static std::vector<IQSample::value_type> temp_dq(n);
-  static std::vector<IQSample::value_type> temp_di(n);
+  // Per-instance work buffers, so that several decoders can run in
+  // parallel and blocks may grow.
+  m_temp.resize(n);
+  m_temp_dq.resize(n);
+  m_temp_di.resize(n);
+  Sample *temp = m_temp.data();
+  IQSample::value_type *temp_dq = m_temp_dq.data();
+  IQSample::value_type *temp_di = m_temp_di.data();
 
   // Compute dq.
   temp_dq[0] = samples_in[0].real() - m_last1_sample.real();
@@ -300,7 +315,8 @@ void PilotPhaseLock::process(SampleVector &samples_in,
 FmDecoder::FmDecoder(double sample_rate_if, double tuning_offset,
                      double sample_rate_pcm, bool stereo, double deemphasis,
                      double bandwidth_if, double freq_dev, double bandwidth_pcm,
-                     unsigned int downsample, bool pilot_shift)
+                     unsigned int downsample, bool pilot_shift,
+                     double audio_gain)
 
     // Initialize member fields
     : m_sample_rate_if(sample_rate_if),
@@ -310,8 +326,12 @@ FmDecoder::FmDecoder(double sample_rate_if, double tuning_offset,
                            sample_rate_if)),
       m_freq_dev(freq_dev), m_downsample(downsample),
       m_pilot_shift(pilot_shift), m_stereo_enabled(stereo),
-      m_stereo_detected(false), m_if_level(0), m_baseband_mean(0),
-      m_baseband_level(0)
+      m_stereo_output(true), m_retuned(false), m_stereo_detected(false),
+      m_if_level(0), m_baseband_mean(0), m_baseband_level(0),
+      m_audio_gain(audio_gain), m_audio_level(0), m_pilot_level(0),
+      m_if_cpu_time(0), m_baseband_cpu_time(0), m_capture_time(0),
+      m_baseband_audio_level(0), m_pipeline_in(2), m_pipeline_out(2),
+      m_pipeline_pending(0)
 
       // Construct FineTuner
       ,
@@ -340,9 +360,9 @@ FmDecoder::FmDecoder(double sample_rate_if, double tuning_offset,
 
       // Construct PilotPhaseLock
       ,
-      m_pilotpll(pilot_freq / m_sample_rate_baseband, // freq
-                 50 / m_sample_rate_baseband,         // bandwidth
-                 0.01)                                // minsignal (was 0.04)
+      m_pilotpll(pilot_freq / m_sample_rate_baseband,          // freq
+                 pilot_pll_bandwidth / m_sample_rate_baseband, // bandwidth
+                 pilot_pll_minsignal)                          // minsignal
 
       // Construct DownsampleFilter for mono channel
       ,
@@ -374,7 +394,77 @@ FmDecoder::FmDecoder(double sample_rate_if, double tuning_offset,
   // nothing more to do
 }
 
-void FmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
+// Stop the baseband thread if pipelined.
+FmDecoder::~FmDecoder() {
+  if (m_pipeline_thread.joinable()) {
+    m_pipeline_in.close();
+    m_pipeline_out.close();
+    m_pipeline_thread.join();
+  }
+}
+
+// Run the baseband stages in a separate thread.
+void FmDecoder::start_pipeline() {
+  if (!m_pipeline_thread.joinable()) {
+    m_pipeline_thread = std::thread(&FmDecoder::run_pipeline, this);
+  }
+}
+
+// Retune to a station at another offset.
+void FmDecoder::retune(double tuning_offset) {
+  m_tuning_shift = lrint(-double(m_tuning_table_size) * tuning_offset /
+                         m_sample_rate_if);
+  m_finetuner = FineTuner(m_tuning_table_size, m_tuning_shift);
+
+  m_if_level = 0;
+  m_baseband_mean = 0;
+  m_baseband_level = 0;
+
+  // The baseband stages restart with the next block, in their thread.
+  m_retuned = true;
+}
+
+// Process IQ samples and return audio samples.
+void FmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio,
+                        double capture_time) {
+  double t0 = thread_cpu_time();
+  process_if(samples_in, m_block.baseband);
+  m_if_cpu_time += thread_cpu_time() - t0;
+  m_block.retuned = m_retuned;
+  m_block.stereo_output = m_stereo_output;
+  m_block.capture_time = capture_time;
+  m_retuned = false;
+
+  if (!m_pipeline_thread.joinable()) {
+    process_baseband(m_block);
+  } else {
+    m_pipeline_in.push(std::move(m_block));
+    m_pipeline_pending++;
+
+    // Take back the previous block, which the baseband thread has been
+    // processing in parallel with the IF stages above. Its vectors are
+    // reused for the next block.
+    if (m_pipeline_pending < 2 || !m_pipeline_out.pop(m_block)) {
+      m_block = BasebandBlock();
+      audio.clear();
+      m_capture_time = 0;
+      return;
+    }
+    m_pipeline_pending--;
+  }
+
+  swap(audio, m_block.audio);
+  m_stereo_detected = m_block.stereo_detected;
+  m_audio_level = m_block.audio_level;
+  m_pilot_level = m_block.pilot_level;
+  m_baseband_cpu_time += m_block.cpu_time;
+  m_capture_time = m_block.capture_time;
+  swap(m_pps_events, m_block.pps_events);
+}
+
+// Run the IF stages.
+void FmDecoder::process_if(const IQSampleVector &samples_in,
+                           SampleVector &baseband) {
   // Fine tuning.
   m_finetuner.process(samples_in, m_buf_iftuned);
 
@@ -389,73 +479,74 @@ void FmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
   m_phasedisc.process(m_buf_iffiltered, m_buf_baseband_raw);
 
   // Compensate 0th-hold aperture effect
-  // by applying the equalizer to the discriminator output.
-  m_disceq.process(m_buf_baseband_raw, m_buf_baseband);
-
-  // Downsample baseband signal to reduce processing.
+  // by applying the equalizer to the discriminator output,
+  // and downsample baseband signal to reduce processing.
   if (m_downsample > 1) {
-    SampleVector tmp(move(m_buf_baseband));
-    m_resample_baseband.process(tmp, m_buf_baseband);
+    m_disceq.process(m_buf_baseband_raw, m_buf_baseband);
+    m_resample_baseband.process(m_buf_baseband, baseband);
+  } else {
+    m_disceq.process(m_buf_baseband_raw, baseband);
   }
 
   // Measure baseband level.
   double baseband_mean, baseband_rms;
-  samples_mean_rms(m_buf_baseband, baseband_mean, baseband_rms);
+  samples_mean_rms(baseband, baseband_mean, baseband_rms);
   m_baseband_mean = 0.95 * m_baseband_mean + 0.05 * baseband_mean;
   m_baseband_level = 0.95 * m_baseband_level + 0.05 * baseband_rms;
+}
+
+// Run the baseband stages.
+void FmDecoder::process_baseband(BasebandBlock &block) {
+  double t0 = thread_cpu_time();
+  block.stereo_detected = false;
+
+  // Lock on the pilot of the new station from scratch.
+  if (block.retuned) {
+    m_pilotpll = PilotPhaseLock(pilot_freq / m_sample_rate_baseband,
+                                pilot_pll_bandwidth / m_sample_rate_baseband,
+                                pilot_pll_minsignal);
+    m_baseband_audio_level = 0;
+  }
 
   if (m_stereo_enabled) {
     // Lock on stereo pilot,
     // and remove locked 19kHz tone from the composite signal.
-    m_pilotpll.process(m_buf_baseband, m_buf_rawstereo, m_pilot_shift);
-    m_stereo_detected = m_pilotpll.locked();
+    m_pilotpll.process(block.baseband, m_buf_rawstereo, m_pilot_shift);
+    block.stereo_detected = m_pilotpll.locked();
   }
 
   // Extract mono audio signal.
-  m_resample_mono.process(m_buf_baseband, m_buf_mono);
-  // DC blocking
-  m_dcblock_mono.process_inplace(m_buf_mono);
+  m_resample_mono.process(block.baseband, m_buf_mono);
 
   if (m_stereo_enabled) {
 
     // Demodulate stereo signal.
-    demod_stereo(m_buf_baseband, m_buf_rawstereo);
+    demod_stereo(block.baseband, m_buf_rawstereo);
 
     // Extract audio and downsample.
     // NOTE: This MUST be done even if no stereo signal is detected yet,
     // because the downsamplers for mono and stereo signal must be
     // kept in sync.
     m_resample_stereo.process(m_buf_rawstereo, m_buf_stereo);
+  }
 
-    // DC blocking
-    m_dcblock_stereo.process_inplace(m_buf_stereo);
-
-    if (m_stereo_detected) {
-      if (m_pilot_shift) {
-        // Duplicate L-R shifted output in left/right channels.
-        // No deemphasis
-        mono_to_left_right(m_buf_stereo, audio);
-      } else {
-        // Extract left/right channels from (L+R) / (L-R) signals.
-        stereo_to_left_right(m_buf_mono, m_buf_stereo, audio);
-        // L and R de-emphasis.
-        m_deemph_stereo.process_interleaved_inplace(audio);
-      }
-    } else {
-      if (m_pilot_shift) {
-        // Fill zero output in left/right channels.
-        zero_to_left_right(m_buf_stereo, audio);
-      } else {
-        // De-emphasis.
-        m_deemph_mono.process_inplace(m_buf_mono);
-        // Duplicate mono signal in left/right channels.
-        mono_to_left_right(m_buf_mono, audio);
-      }
+  // DC blocking, stereo matrix, de-emphasis and gain.
+  process_audio(block.stereo_detected && block.stereo_output, block.audio);
+
+  block.audio_level = m_baseband_audio_level;
+  block.pilot_level = m_pilotpll.get_pilot_level();
+  block.pps_events = m_pilotpll.get_pps_events();
+  block.cpu_time = thread_cpu_time() - t0;
+}
+
+// Baseband thread of the pipelined decoder.
+void FmDecoder::run_pipeline() {
+  BasebandBlock block;
+  while (m_pipeline_in.pop(block)) {
+    process_baseband(block);
+    if (!m_pipeline_out.push(std::move(block))) {
+      break;
     }
-  } else {
-    m_deemph_mono.process_inplace(m_buf_mono); //  De-emphasis.
-    // Just return mono channel.
-    audio = move(m_buf_mono);
   }
 }
 
@@ -473,45 +564,83 @@ void FmDecoder::demod_stereo(const SampleVector &samples_baseband,
   }
 }
 
-// Duplicate mono signal in left/right channels.
-void FmDecoder::mono_to_left_right(const SampleVector &samples_mono,
-                                   SampleVector &audio) {
-  unsigned int n = samples_mono.size();
-
-  audio.resize(2 * n);
-  for (unsigned int i = 0; i < n; i++) {
-    Sample m = samples_mono[i];
-    audio[2 * i] = m;
-    audio[2 * i + 1] = m;
-  }
-}
-
-// Extract left/right channels from (L+R) / (L-R) signals.
-void FmDecoder::stereo_to_left_right(const SampleVector &samples_mono,
-                                     const SampleVector &samples_stereo,
-                                     SampleVector &audio) {
-  unsigned int n = samples_mono.size();
-  assert(n == samples_stereo.size());
+// Run the audio chain after resampling in a single pass.
+void FmDecoder::process_audio(bool stereo_detected, SampleVector &audio) {
+  const Sample *mono = m_buf_mono.data();
+  const Sample *stereo = m_buf_stereo.data();
+  unsigned int n = m_buf_mono.size();
+  assert(!m_stereo_enabled || m_buf_stereo.size() == n);
+  unsigned int nout = m_stereo_enabled ? 2 * n : n;
+  Sample gain = m_audio_gain;
+  Sample sumsq = 0;
+
+  audio.resize(nout);
+
+  // Short chunks keep the intermediate signals in L1 cache while the
+  // block filters run four samples per step. The DC blocking filters
+  // always run to keep their state continuous, even if their output
+  // is not used.
+  const unsigned int chunk = 256;
+  Sample bm[chunk];
+  Sample bs[chunk];
+  for (unsigned int i0 = 0; i0 < n; i0 += chunk) {
+    unsigned int k = std::min(chunk, n - i0);
+
+    if (!m_stereo_enabled) {
+      // Mono output.
+      Sample *out = audio.data() + i0;
+      m_dcblock_mono.process_block(mono + i0, out, k);
+      m_deemph_mono.process_block(out, out, k);
+      for (unsigned int i = 0; i < k; i++) {
+        sumsq += out[i] * out[i];
+        out[i] *= gain;
+      }
+      continue;
+    }
 
-  audio.resize(2 * n);
-  for (unsigned int i = 0; i < n; i++) {
-    Sample m = samples_mono[i];
-    Sample s = samples_stereo[i];
-    audio[2 * i] = m + s;
-    audio[2 * i + 1] = m - s;
+    // DC blocking of mono and stereo signals in parallel.
+    HighPassFilterIir::process_pair(m_dcblock_mono, mono + i0, bm,
+                                    m_dcblock_stereo, stereo + i0, bs, k);
+    Sample *out = audio.data() + 2 * i0;
+
+    if (stereo_detected && !m_pilot_shift) {
+      // Extract left/right channels from (L+R) / (L-R) signals,
+      // followed by L and R de-emphasis.
+      for (unsigned int i = 0; i < k; i++) {
+        out[2 * i] = bm[i] + bs[i];
+        out[2 * i + 1] = bm[i] - bs[i];
+      }
+      m_deemph_stereo.process_pairs(out, out, k);
+      for (unsigned int i = 0; i < 2 * k; i++) {
+        sumsq += out[i] * out[i];
+        out[i] *= gain;
+      }
+    } else if (stereo_detected) {
+      // Duplicate L-R shifted output in left/right channels.
+      // No deemphasis
+      for (unsigned int i = 0; i < k; i++) {
+        sumsq += 2 * bs[i] * bs[i];
+        out[2 * i] = gain * bs[i];
+        out[2 * i + 1] = gain * bs[i];
+      }
+    } else if (!m_pilot_shift) {
+      // De-emphasis, and duplicate mono signal in left/right channels.
+      m_deemph_mono.process_block(bm, bm, k);
+      for (unsigned int i = 0; i < k; i++) {
+        sumsq += 2 * bm[i] * bm[i];
+        out[2 * i] = gain * bm[i];
+        out[2 * i + 1] = gain * bm[i];
+      }
+    } else {
+      // Fill zero output in left/right channels.
+      std::fill(out, out + 2 * k, Sample(0));
+    }
   }
-}
-
-// Fill zero signal in left/right channels.
-// (samples_mono used for the size determination only)
-void FmDecoder::zero_to_left_right(const SampleVector &samples_mono,
-                                   SampleVector &audio) {
-  unsigned int n = samples_mono.size();
 
-  audio.resize(2 * n);
-  for (unsigned int i = 0; i < n; i++) {
-    audio[2 * i] = 0.0;
-    audio[2 * i + 1] = 0.0;
+  // Measure audio level before gain.
+  if (nout > 0) {
+    m_baseband_audio_level =
+        0.95 * m_baseband_audio_level + 0.05 * sqrt(sumsq / nout);
   }
 }
 
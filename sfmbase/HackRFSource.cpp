@@ -437,8 +437,34 @@ void HackRFSource::run(hackrf_device *dev, std::atomic_bool *stop_flag) {
 bool HackRFSource::stop() {
   std::cerr << "HackRFSource::stop" << std::endl;
 
-  m_thread->join();
-  delete m_thread;
+  if (m_thread) {
+    m_thread->join();
+    delete m_thread;
+    m_thread = 0;
+  }
+  return true;
+}
+
+// Retune while streaming.
+bool HackRFSource::retune(uint32_t frequency, std::string &error) {
+  if (frequency < 1000000) {
+    error = "Invalid frequency";
+    return false;
+  }
+
+  uint32_t tuner_freq = frequency + 0.25 * m_sampleRate;
+  hackrf_error rc =
+      (hackrf_error)hackrf_set_freq(m_dev, static_cast<uint64_t>(tuner_freq));
+
+  if (rc != HACKRF_SUCCESS) {
+    std::ostringstream err_ostr;
+    err_ostr << "Could not set center frequency to " << tuner_freq << " Hz";
+    error = err_ostr.str();
+    return false;
+  }
+
+  m_confFreq = frequency;
+  m_frequency = tuner_freq;
   return true;
 }
 
@@ -453,6 +479,8 @@ int HackRFSource::rx_callback(hackrf_transfer *transfer) {
 }
 
 void HackRFSource::callback(const char *buf, int len) {
+  // The transfer is complete now; time it before the conversion.
+  double timestamp = monotonic_time();
   IQSampleVector iqsamples;
 
   iqsamples.resize(len / 2);
@@ -464,5 +492,5 @@ void HackRFSource::callback(const char *buf, int len) {
                             (im - 128) / IQSample::value_type(128));
   }
 
-  m_buf->push(move(iqsamples));
+  m_buf->push(move(iqsamples), timestamp);
 }
@@ -0,0 +1,141 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "LatencyHistogram.h"
+
+const unsigned int LatencyHistogram::sub_buckets;
+const std::uint64_t LatencyHistogram::max_value;
+
+/* ****************  class LatencyHistogram  **************** */
+
+// Construct empty histogram.
+LatencyHistogram::LatencyHistogram()
+    : m_count(0), m_max(0), m_sum(0), m_sumsq(0) {
+  for (std::atomic<std::uint64_t> &c : m_counts) {
+    c.store(0, std::memory_order_relaxed);
+  }
+}
+
+// Add a latency in seconds.
+void LatencyHistogram::record(double seconds) {
+  const std::memory_order relaxed = std::memory_order_relaxed;
+  std::uint64_t us = (seconds > 0) ? std::uint64_t(seconds * 1.0e6) : 0;
+  us = std::min(us, max_value);
+
+  m_counts[bucket_index(us)].fetch_add(1, relaxed);
+
+  // Single writer: plain read-modify-write of the relaxed atomics.
+  if (us > m_max.load(relaxed)) {
+    m_max.store(us, relaxed);
+  }
+  m_sum.store(m_sum.load(relaxed) + us, relaxed);
+  m_sumsq.store(m_sumsq.load(relaxed) + double(us) * us, relaxed);
+  m_count.store(m_count.load(relaxed) + 1, relaxed);
+}
+
+// Return number of recorded latencies.
+std::uint64_t LatencyHistogram::count() const {
+  return m_count.load(std::memory_order_relaxed);
+}
+
+// Return the latency below which a percentage of the latencies lie.
+double LatencyHistogram::percentile(double percent) const {
+  // Sum the buckets rather than use m_count, which may lag behind.
+  std::uint64_t total = 0;
+  for (const std::atomic<std::uint64_t> &c : m_counts) {
+    total += c.load(std::memory_order_relaxed);
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  std::uint64_t target =
+      std::max<std::uint64_t>(1, std::ceil(percent / 100 * total));
+  std::uint64_t sum = 0;
+  for (unsigned int i = 0; i < num_buckets; i++) {
+    sum += m_counts[i].load(std::memory_order_relaxed);
+    if (sum >= target) {
+      return std::min(bucket_value(i), m_max.load(std::memory_order_relaxed)) *
+             1.0e-6;
+    }
+  }
+  return max();
+}
+
+// Return the mean latency.
+double LatencyHistogram::mean() const {
+  std::uint64_t n = count();
+  return (n > 0) ? m_sum.load(std::memory_order_relaxed) / n * 1.0e-6 : 0;
+}
+
+// Return the standard deviation of the latency.
+double LatencyHistogram::stddev() const {
+  std::uint64_t n = count();
+  if (n == 0) {
+    return 0;
+  }
+  double m = m_sum.load(std::memory_order_relaxed) / n;
+  double var = m_sumsq.load(std::memory_order_relaxed) / n - m * m;
+  return sqrt(std::max(0.0, var)) * 1.0e-6;
+}
+
+// Return the largest recorded latency.
+double LatencyHistogram::max() const {
+  return m_max.load(std::memory_order_relaxed) * 1.0e-6;
+}
+
+// Return one line with count, percentiles, max and jitter.
+std::string LatencyHistogram::summary() const {
+  char buf[200];
+  snprintf(buf, sizeof(buf),
+           "n=%llu p50=%.2f p90=%.2f p99=%.2f p99.9=%.2f max=%.2f "
+           "jitter=%.2f ms",
+           (unsigned long long)count(), percentile(50) * 1.0e3,
+           percentile(90) * 1.0e3, percentile(99) * 1.0e3,
+           percentile(99.9) * 1.0e3, max() * 1.0e3, stddev() * 1.0e3);
+  return buf;
+}
+
+// Return the bucket of a value.
+unsigned int LatencyHistogram::bucket_index(std::uint64_t value) {
+  if (value < sub_buckets) {
+    return value;
+  }
+  // Keep the 7 most significant bits: 64 linear buckets per power of two.
+  unsigned int e = 63 - __builtin_clzll(value);
+  unsigned int shift = e - 6;
+  return sub_buckets + (e - 7) * (sub_buckets / 2) +
+         (unsigned int)((value >> shift) - sub_buckets / 2);
+}
+
+// Return the highest value counted in a bucket.
+std::uint64_t LatencyHistogram::bucket_value(unsigned int index) {
+  if (index < sub_buckets) {
+    return index;
+  }
+  unsigned int range = (index - sub_buckets) / (sub_buckets / 2);
+  std::uint64_t sub = (index - sub_buckets) % (sub_buckets / 2) +
+                      sub_buckets / 2;
+  unsigned int shift = range + 1;
+  return ((sub + 1) << shift) - 1;
+}
+
+/* end */
@@ -0,0 +1,183 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ListenSocket.h"
+
+/* ****************  class ListenSocket  **************** */
+
+// Construct socket and start listening.
+ListenSocket::ListenSocket(const std::string &address)
+    : m_listen_fd(-1), m_connecting(false) {
+  m_wakeup_fd[0] = m_wakeup_fd[1] = -1;
+
+  if (pipe2(m_wakeup_fd, O_NONBLOCK | O_CLOEXEC) == -1) {
+    m_error = "can not create pipe (" + std::string(strerror(errno)) + ")";
+    return;
+  }
+
+  int fd;
+  if (address.compare(0, 5, "unix:") == 0) {
+    fd = bind_unix(address.substr(5));
+  } else if (address.find('/') != std::string::npos) {
+    fd = bind_unix(address);
+  } else {
+    fd = bind_tcp(address);
+  }
+  if (fd < 0) {
+    return;
+  }
+
+  if (listen(fd, 16) == -1 || fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
+    m_error = "can not listen on '" + address + "' (" + strerror(errno) + ")";
+    close(fd);
+    return;
+  }
+  m_listen_fd = fd;
+}
+
+// Destructor.
+ListenSocket::~ListenSocket() {
+  if (m_listen_fd >= 0) {
+    close(m_listen_fd);
+  }
+  if (!m_unix_path.empty()) {
+    unlink(m_unix_path.c_str());
+  }
+  for (int fd : m_wakeup_fd) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+// Bind to a Unix domain socket.
+int ListenSocket::bind_unix(const std::string &path) {
+  struct sockaddr_un sa;
+  if (path.empty() || path.size() >= sizeof(sa.sun_path)) {
+    m_error = "invalid socket path '" + path + "'";
+    return -1;
+  }
+  std::memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  std::memcpy(sa.sun_path, path.c_str(), path.size());
+
+  // Remove a stale socket left by a previous run, but nothing else.
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path.c_str());
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == -1) {
+    m_error = "can not bind to '" + path + "' (" + strerror(errno) + ")";
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  m_unix_path = path;
+  return fd;
+}
+
+// Bind to a TCP port.
+int ListenSocket::bind_tcp(const std::string &address) {
+  std::string host("127.0.0.1");
+  std::string port(address);
+  std::size_t colon = address.rfind(':');
+  if (colon != std::string::npos) {
+    if (colon > 0) {
+      host = address.substr(0, colon);
+    }
+    port = address.substr(colon + 1);
+  }
+
+  struct addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+  struct addrinfo *ai = NULL;
+  int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &ai);
+  if (ret != 0) {
+    m_error =
+        "invalid address '" + address + "' (" + gai_strerror(ret) + ")";
+    return -1;
+  }
+
+  int fd =
+      socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+  int one = 1;
+  bool ok = fd >= 0 &&
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0 &&
+            bind(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+  int err = errno;
+  freeaddrinfo(ai);
+  if (!ok) {
+    m_error = "can not bind to '" + address + "' (" + strerror(err) + ")";
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  return fd;
+}
+
+// Wait for an event of a client, a connection or a wakeup.
+bool ListenSocket::poll(std::vector<struct pollfd> &pfds) {
+  pfds.push_back({m_wakeup_fd[0], POLLIN, 0});
+  pfds.push_back({m_listen_fd, POLLIN, 0});
+  int ret = ::poll(pfds.data(), pfds.size(), -1);
+  m_connecting = (ret > 0) && (pfds.back().revents & POLLIN);
+  pfds.pop_back();
+  if (ret > 0 && (pfds.back().revents & POLLIN)) {
+    char buf[64];
+    while (read(m_wakeup_fd[0], buf, sizeof(buf)) > 0) {
+    }
+  }
+  pfds.pop_back();
+  return ret != -1;
+}
+
+// Accept a connection.
+int ListenSocket::accept() {
+  if (!m_connecting) {
+    return -1;
+  }
+  int fd = accept4(m_listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0) {
+    m_connecting = false;
+  }
+  return fd;
+}
+
+// Wake up the thread in poll().
+void ListenSocket::wakeup() {
+  char c = 0;
+  ssize_t ret = ::write(m_wakeup_fd[1], &c, 1);
+  (void)ret; // a full pipe means that a wakeup is pending anyway
+}
+
+/* end */
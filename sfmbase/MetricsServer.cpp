@@ -0,0 +1,247 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "MetricsServer.h"
+
+const double MetricsServer::bucket_bounds[MetricsServer::num_buckets] = {
+    0.0005, 0.001, 0.002, 0.005, 0.01, 0.02,
+    0.05,   0.1,   0.2,   0.5,   1.0,  2.0};
+
+// Append a metric line with a value.
+static void add_metric(std::string &s, const char *name, double value) {
+  char buf[160];
+  if (std::isfinite(value)) {
+    snprintf(buf, sizeof(buf), "%s %.17g\n", name, value);
+  } else {
+    snprintf(buf, sizeof(buf), "%s %s\n", name,
+             std::isnan(value) ? "NaN" : (value > 0) ? "+Inf" : "-Inf");
+  }
+  s += buf;
+}
+
+// Append the help and type lines of a metric.
+static void add_header(std::string &s, const char *name, const char *type,
+                       const char *help) {
+  s += std::string("# HELP ") + name + " " + help + "\n";
+  s += std::string("# TYPE ") + name + " " + type + "\n";
+}
+
+/* ****************  class MetricsServer  **************** */
+
+// Construct server and start listening.
+MetricsServer::MetricsServer(const std::string &address)
+    : m_listen(address), m_stop(false), m_samples(0), m_dropped(0),
+      m_decode_ns(0), m_input_queue(0), m_output_queue(0), m_frequency(0),
+      m_if_level(0), m_pilot_locked(false) {
+  for (std::atomic<std::uint64_t> &b : m_buckets) {
+    b.store(0, std::memory_order_relaxed);
+  }
+
+  if (!m_listen) {
+    m_error = m_listen.error();
+    return;
+  }
+
+  m_thread = std::thread(&MetricsServer::run, this);
+}
+
+// Destructor.
+MetricsServer::~MetricsServer() {
+  if (m_thread.joinable()) {
+    m_stop.store(true);
+    m_listen.wakeup();
+    m_thread.join();
+  }
+
+  for (std::unique_ptr<Client> &c : m_clients) {
+    close(c->fd);
+  }
+}
+
+// Format the metrics.
+std::string MetricsServer::format_metrics() const {
+  const std::memory_order relaxed = std::memory_order_relaxed;
+  std::string s;
+
+  add_header(s, "ngsoftfm_samples_total", "counter",
+             "IQ samples decoded.");
+  add_metric(s, "ngsoftfm_samples_total", m_samples.load(relaxed));
+
+  add_header(s, "ngsoftfm_dropped_samples_total", "counter",
+             "IQ samples discarded without decoding.");
+  add_metric(s, "ngsoftfm_dropped_samples_total", m_dropped.load(relaxed));
+
+  add_header(s, "ngsoftfm_input_queue_samples", "gauge",
+             "IQ samples waiting for the decoder.");
+  add_metric(s, "ngsoftfm_input_queue_samples", m_input_queue.load(relaxed));
+
+  add_header(s, "ngsoftfm_output_queue_samples", "gauge",
+             "Audio samples waiting for the output.");
+  add_metric(s, "ngsoftfm_output_queue_samples",
+             m_output_queue.load(relaxed));
+
+  add_header(s, "ngsoftfm_frequency_hz", "gauge", "Station frequency.");
+  add_metric(s, "ngsoftfm_frequency_hz", m_frequency.load(relaxed));
+
+  add_header(s, "ngsoftfm_if_level_db", "gauge",
+             "RMS IF level relative to full scale.");
+  double if_level = m_if_level.load(relaxed);
+  add_metric(s, "ngsoftfm_if_level_db",
+             (if_level > 0) ? 20 * log10(if_level) : -INFINITY);
+
+  add_header(s, "ngsoftfm_pilot_locked", "gauge",
+             "1 if the stereo pilot is locked.");
+  add_metric(s, "ngsoftfm_pilot_locked", m_pilot_locked.load(relaxed));
+
+  add_header(s, "ngsoftfm_decode_seconds", "histogram",
+             "Time to decode a block.");
+  std::uint64_t count = 0;
+  char name[80];
+  for (unsigned int b = 0; b <= num_buckets; b++) {
+    count += m_buckets[b].load(relaxed);
+    if (b < num_buckets) {
+      snprintf(name, sizeof(name), "ngsoftfm_decode_seconds_bucket{le=\"%g\"}",
+               bucket_bounds[b]);
+    } else {
+      snprintf(name, sizeof(name),
+               "ngsoftfm_decode_seconds_bucket{le=\"+Inf\"}");
+    }
+    add_metric(s, name, count);
+  }
+  add_metric(s, "ngsoftfm_decode_seconds_sum",
+             m_decode_ns.load(relaxed) * 1.0e-9);
+  add_metric(s, "ngsoftfm_decode_seconds_count", count);
+
+  return s;
+}
+
+// Read the request of a client.
+bool MetricsServer::receive(Client &client) {
+  char buf[1024];
+  ssize_t k = recv(client.fd, buf, sizeof(buf), MSG_DONTWAIT);
+  if (k == 0) {
+    return false;
+  }
+  if (k < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+  }
+  client.request.append(buf, k);
+
+  std::size_t eoh = client.request.find("\r\n\r\n");
+  if (eoh == std::string::npos) {
+    eoh = client.request.find("\n\n");
+  }
+  if (eoh == std::string::npos) {
+    return client.request.size() <= max_request;
+  }
+
+  // Request line: METHOD PATH VERSION
+  std::string line = client.request.substr(0, client.request.find('\n'));
+  std::size_t sp1 = line.find(' ');
+  std::size_t sp2 = line.find(' ', sp1 + 1);
+  std::string method = line.substr(0, sp1);
+  std::string path = (sp1 == std::string::npos)
+                         ? std::string()
+                         : line.substr(sp1 + 1, sp2 - sp1 - 1);
+  path = path.substr(0, path.find('?'));
+
+  const char *status = "200 OK";
+  std::string body;
+  if (method != "GET" && method != "HEAD") {
+    status = "405 Method Not Allowed";
+    body = "only GET is supported\n";
+  } else if (path != "/metrics" && path != "/") {
+    status = "404 Not Found";
+    body = "metrics are at /metrics\n";
+  } else {
+    body = format_metrics();
+  }
+
+  client.response = std::string("HTTP/1.0 ") + status +
+                    "\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                    "Content-Length: " +
+                    std::to_string(body.size()) +
+                    "\r\nConnection: close\r\n\r\n";
+  if (method != "HEAD") {
+    client.response += body;
+  }
+  client.request.clear();
+  return true;
+}
+
+// Server thread.
+void MetricsServer::run() {
+  std::vector<struct pollfd> pfds;
+
+  while (!m_stop.load()) {
+    pfds.clear();
+    for (std::unique_ptr<Client> &c : m_clients) {
+      short events = c->response.empty() ? POLLIN : POLLOUT;
+      pfds.push_back({c->fd, events, 0});
+    }
+
+    if (!m_listen.poll(pfds)) {
+      continue; // EINTR
+    }
+
+    std::size_t nclients = m_clients.size();
+    for (std::size_t i = 0; i < nclients; i++) {
+      Client &c = *m_clients[i];
+      short revents = pfds[i].revents;
+      bool ok = !(revents & (POLLERR | POLLNVAL));
+      if (ok && c.response.empty() && (revents & (POLLIN | POLLHUP))) {
+        ok = receive(c);
+      }
+      if (ok && !c.response.empty() && (revents & POLLOUT)) {
+        ssize_t k = send(c.fd, c.response.data(), c.response.size(),
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (k > 0) {
+          c.response.erase(0, k);
+          // The response ends the connection.
+          ok = !c.response.empty();
+        } else {
+          ok = (k < 0 && (errno == EAGAIN || errno == EINTR));
+        }
+      }
+      if (!ok) {
+        close(c.fd);
+        c.fd = -1;
+      }
+    }
+    m_clients.erase(std::remove_if(m_clients.begin(), m_clients.end(),
+                                   [](const std::unique_ptr<Client> &c) {
+                                     return c->fd < 0;
+                                   }),
+                    m_clients.end());
+
+    int fd;
+    while ((fd = m_listen.accept()) >= 0) {
+      std::unique_ptr<Client> c(new Client);
+      c->fd = fd;
+      m_clients.push_back(std::move(c));
+    }
+  }
+}
+
+/* end */
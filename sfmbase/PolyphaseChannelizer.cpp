@@ -0,0 +1,196 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <cassert>
+#include <cmath>
+
+#include "PolyphaseChannelizer.h"
+
+constexpr unsigned int PolyphaseChannelizer::default_taps_per_branch;
+constexpr double PolyphaseChannelizer::passband;
+
+/* ****************  class PolyphaseChannelizer  **************** */
+
+// Construct channelizer.
+PolyphaseChannelizer::PolyphaseChannelizer(
+    unsigned int nchannels, const std::vector<unsigned int> &channels,
+    unsigned int taps_per_branch)
+    : m_nchannels(nchannels), m_decimation(nchannels / 2),
+      m_channels(channels), m_odd(false), m_fft(nchannels),
+      m_work(nchannels) {
+  assert(nchannels >= 2 && Fft<float>::is_power_of_two(nchannels));
+  assert(taps_per_branch >= 1);
+
+  // Prototype low-pass filter: windowed sinc with its -6 dB point at the
+  // channel spacing, i.e. halfway between the alias-free passband and the
+  // first frequency which aliases into it after decimation by M/2.
+  // The Blackman window keeps the stopband below about -70 dB.
+  unsigned int ntaps = taps_per_branch * nchannels;
+  double cutoff = 1.0 / nchannels;
+  double center = 0.5 * (ntaps - 1);
+  std::vector<double> coeff(ntaps);
+  double ysum = 0;
+  for (unsigned int i = 0; i < ntaps; i++) {
+    double t = i - center;
+    double x = 2 * M_PI * cutoff * t;
+    double sinc = (t == 0) ? 1.0 : sin(x) / x;
+    double w = 0.42 - 0.5 * cos(2 * M_PI * (i + 0.5) / ntaps) +
+               0.08 * cos(4 * M_PI * (i + 0.5) / ntaps);
+    coeff[i] = sinc * w;
+    ysum += coeff[i];
+  }
+
+  // Unit gain at DC, so each channel keeps the level of the input.
+  m_coeff_rev.resize(2 * ntaps);
+  for (unsigned int i = 0; i < ntaps; i++) {
+    m_coeff_rev[2 * i] = m_coeff_rev[2 * i + 1] =
+        coeff[ntaps - 1 - i] / ysum;
+  }
+
+  // Summing the folded branches in forward order computes the inverse DFT
+  // of the time-reversed branch sums, which equals the forward FFT of the
+  // branch sums rotated by exp(-2*pi*j*k/M).
+  m_rotation.resize(channels.size());
+  for (unsigned int i = 0; i < channels.size(); i++) {
+    assert(channels[i] < nchannels);
+    double phi = -2 * M_PI * channels[i] / nchannels;
+    m_rotation[i] = IQSample(cos(phi), sin(phi));
+  }
+
+  m_buf.assign(ntaps - 1, IQSample(0));
+  m_pos = ntaps - 1;
+}
+
+// Process samples.
+void PolyphaseChannelizer::process(const IQSampleVector &samples_in,
+                                   std::vector<IQSampleVector> &samples_out) {
+  const unsigned int ntaps = m_coeff_rev.size() / 2;
+  const unsigned int nfold = 2 * m_nchannels;
+
+  m_buf.insert(m_buf.end(), samples_in.begin(), samples_in.end());
+  std::size_t nbuf = m_buf.size();
+  std::size_t nout = (m_pos < nbuf) ? (nbuf - 1 - m_pos) / m_decimation + 1 : 0;
+
+  samples_out.resize(m_channels.size());
+  for (IQSampleVector &out : samples_out) {
+    out.resize(nout);
+  }
+
+  typedef IQSample::value_type Value;
+  const Value *coeff = m_coeff_rev.data();
+  Value *fold = reinterpret_cast<Value *>(m_work.data());
+
+  for (std::size_t j = 0; j < nout; j++) {
+    std::size_t t = m_pos + j * m_decimation;
+
+    // Fold the last ntaps input samples through the M filter branches.
+    // I and Q are handled as a flat float array so that the loop over
+    // the branches is vectorized.
+    const Value *x = reinterpret_cast<const Value *>(&m_buf[t + 1 - ntaps]);
+    for (unsigned int r = 0; r < nfold; r++) {
+      fold[r] = coeff[r] * x[r];
+    }
+    for (unsigned int p = nfold; p < 2 * ntaps; p += nfold) {
+      for (unsigned int r = 0; r < nfold; r++) {
+        fold[r] += coeff[p + r] * x[p + r];
+      }
+    }
+
+    m_fft.forward(m_work.data());
+
+    // Mixing channel k down to zero frequency at the decimated rate
+    // leaves a factor (-1)^(k*n) for D = M/2.
+    for (std::size_t i = 0; i < m_channels.size(); i++) {
+      unsigned int k = m_channels[i];
+      IQSample y = m_work[k] * m_rotation[i];
+      samples_out[i][j] = (m_odd && (k & 1)) ? -y : y;
+    }
+    m_odd = !m_odd;
+  }
+
+  // Keep the filter history.
+  std::size_t drop = nbuf - (ntaps - 1);
+  m_buf.erase(m_buf.begin(), m_buf.begin() + drop);
+  m_pos = m_pos + nout * m_decimation - drop;
+}
+
+// Return the channel containing a frequency.
+unsigned int PolyphaseChannelizer::channel_index(double offset,
+                                                 double sample_rate,
+                                                 unsigned int nchannels) {
+  long k = lround(offset * nchannels / sample_rate);
+  return (unsigned int)(((k % long(nchannels)) + nchannels) % nchannels);
+}
+
+// Return the center frequency of a channel.
+double PolyphaseChannelizer::channel_offset(unsigned int channel,
+                                            double sample_rate,
+                                            unsigned int nchannels) {
+  int k = (channel <= nchannels / 2) ? int(channel)
+                                     : int(channel) - int(nchannels);
+  return k * sample_rate / nchannels;
+}
+
+// Return the frequency relative to the center of its channel.
+double PolyphaseChannelizer::channel_residual(double offset,
+                                              double sample_rate,
+                                              unsigned int nchannels) {
+  unsigned int k = channel_index(offset, sample_rate, nchannels);
+  double r = offset - channel_offset(k, sample_rate, nchannels);
+
+  // Channel nchannels/2 is centered at +sample_rate/2, which is the same
+  // frequency as -sample_rate/2. Reduce modulo the sample rate, so that
+  // frequencies near -sample_rate/2 get a small residual too.
+  return r - sample_rate * std::ceil(r / sample_rate - 0.5);
+}
+
+// Return the largest suitable number of channels.
+unsigned int PolyphaseChannelizer::choose_num_channels(
+    double sample_rate, const std::vector<double> &offsets, double bandwidth,
+    double min_spacing) {
+  // Residuals are taken modulo the sample rate, so a signal outside the
+  // input band would seem to fit the channel it aliases into.
+  for (double f : offsets) {
+    if (std::fabs(f) + bandwidth > 0.5 * sample_rate) {
+      return 0;
+    }
+  }
+
+  unsigned int nchannels = 2;
+  while (sample_rate / (2 * nchannels) >= min_spacing) {
+    nchannels *= 2;
+  }
+
+  for (; nchannels >= 2; nchannels /= 2) {
+    double spacing = sample_rate / nchannels;
+    bool fits = true;
+    for (double f : offsets) {
+      double residual = channel_residual(f, sample_rate, nchannels);
+      if (std::fabs(residual) + bandwidth > passband * spacing) {
+        fits = false;
+        break;
+      }
+    }
+    if (fits) {
+      return nchannels;
+    }
+  }
+
+  return 0;
+}
+
+/* end */
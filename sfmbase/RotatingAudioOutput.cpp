@@ -0,0 +1,340 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RotatingAudioOutput.h"
+
+// Insert a segment index before the file name extension.
+static std::string insert_index(const std::string &name,
+                                std::uint64_t index) {
+  char idx[32];
+  snprintf(idx, sizeof(idx), "-%04llu", (unsigned long long)index);
+
+  std::size_t dot = name.rfind('.');
+  std::size_t slash = name.rfind('/');
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash)) {
+    return name + idx;
+  }
+  return name.substr(0, dot) + idx + name.substr(dot);
+}
+
+// Return the wall clock time in seconds.
+static double wall_time() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1.0e-6 * tv.tv_usec;
+}
+
+// Flush a closed file to disk.
+static void sync_file(const std::string &name) {
+  int fd = open(name.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+/* ****************  class RotatingAudioOutput  **************** */
+
+// Construct rotating writer.
+RotatingAudioOutput::RotatingAudioOutput(const std::string &pattern,
+                                         unsigned int samplerate,
+                                         unsigned int nchannels,
+                                         SampleFormat format,
+                                         double segment_secs, bool align,
+                                         Factory factory)
+    : AudioOutput(format), m_pattern(pattern), m_samplerate(samplerate),
+      m_nchannels(std::max(1U, nchannels)),
+      m_segment_frames(
+          std::max(1LL, std::llround(segment_secs * samplerate))),
+      m_align(align), m_factory(factory), m_started(false),
+      m_start_time(wall_time()), m_frames(0), m_boundary(0), m_index(0),
+      m_next_ready(false), m_stop(false) {
+  // Open the first file before decoding starts.
+  m_current_name = segment_filename(0, m_start_time);
+  m_current.reset(m_factory(m_current_name));
+  if (!(*m_current)) {
+    m_error = m_current->error();
+    m_zombie = true;
+    return;
+  }
+
+  m_thread = std::thread(&RotatingAudioOutput::run, this);
+}
+
+// Destructor.
+RotatingAudioOutput::~RotatingAudioOutput() {
+  if (m_thread.joinable()) {
+    // Close the last file.
+    AudioOutput *last = m_current.release();
+    std::string last_name = m_current_name;
+    post([last, last_name] {
+      delete last;
+      sync_file(last_name);
+    });
+
+    // Discard the pre-opened file, which was created empty.
+    post([this] {
+      std::unique_ptr<AudioOutput> next;
+      std::string name;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        next = std::move(m_next);
+        name = m_next_name;
+        m_next_ready = false;
+      }
+      if (next) {
+        next.reset();
+        unlink(name.c_str());
+      }
+    });
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+  }
+}
+
+// Add a preferred position for a segment boundary.
+void RotatingAudioOutput::add_sync_point(std::uint64_t frame) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_sync_points.push_back(frame);
+}
+
+// Write encoded audio data.
+bool RotatingAudioOutput::write_bytes(const std::uint8_t *data,
+                                      std::size_t n) {
+  if (m_zombie) {
+    return false;
+  }
+
+  std::size_t framesize = bytes_per_sample(m_format) * m_nchannels;
+  std::size_t nframes = n / framesize;
+  std::size_t pos = 0;
+
+  if (!m_started && nframes > 0) {
+    start();
+  }
+
+  while (pos < nframes) {
+    std::uint64_t cut = choose_cut();
+    if (m_frames == cut) {
+      if (!rotate()) {
+        return false;
+      }
+      continue;
+    }
+
+    // Write up to the boundary.
+    std::size_t k = std::min<std::uint64_t>(nframes - pos, cut - m_frames);
+    if (!m_current->write_bytes(data + pos * framesize, k * framesize)) {
+      m_error = m_current->error();
+      return false;
+    }
+
+    pos += k;
+    m_frames += k;
+  }
+
+  return true;
+}
+
+// Anchor the segment grid at the first written frame.
+void RotatingAudioOutput::start() {
+  m_started = true;
+  m_start_time = wall_time();
+
+  // Place the first boundary on the next multiple of the segment length
+  // in wall clock time, or one segment length after the start.
+  m_boundary = m_segment_frames;
+  if (m_align) {
+    double seg = m_segment_frames / double(m_samplerate);
+    double next = (std::floor(m_start_time / seg) + 1) * seg;
+    m_boundary = std::llround((next - m_start_time) * m_samplerate);
+    if (m_boundary == 0) {
+      m_boundary = m_segment_frames;
+    }
+  }
+
+  prepare_next();
+}
+
+// Return the file name of a segment.
+std::string RotatingAudioOutput::segment_filename(std::uint64_t index,
+                                                  double start_time) const {
+  if (m_pattern.find('%') != std::string::npos) {
+    time_t t = time_t(std::floor(start_time + 0.5));
+    struct tm tm;
+    localtime_r(&t, &tm);
+    char buf[1024];
+    std::size_t len = strftime(buf, sizeof(buf), m_pattern.c_str(), &tm);
+    if (len > 0) {
+      return std::string(buf, len);
+    }
+  }
+  return insert_index(m_pattern, index);
+}
+
+// Request the background thread to open the next segment file.
+void RotatingAudioOutput::prepare_next() {
+  std::uint64_t index = m_index + 1;
+  double start_time = m_start_time + m_boundary / double(m_samplerate);
+  std::string name = segment_filename(index, start_time);
+
+  // Never reopen (and truncate) the current file, which happens if the
+  // pattern has a coarser time resolution than the segment length.
+  if (name == m_current_name) {
+    name = insert_index(name, index);
+  }
+
+  post([this, name] {
+    // Opening truncates, so an existing file is left alone until the
+    // boundary and only opened when it becomes the current segment.
+    struct stat st;
+    AudioOutput *out = NULL;
+    if (lstat(name.c_str(), &st) == -1) {
+      out = m_factory(name);
+      if (!(*out)) {
+        unlink(name.c_str());
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_next.reset(out);
+      m_next_name = name;
+      m_next_ready = true;
+    }
+    m_cond.notify_all();
+  });
+}
+
+// Switch to the next segment file.
+bool RotatingAudioOutput::rotate() {
+  std::unique_ptr<AudioOutput> next;
+  std::string next_name;
+  {
+    // The next file is normally opened long before it is needed.
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this] { return m_next_ready; });
+    next = std::move(m_next);
+    next_name = m_next_name;
+    m_next_ready = false;
+  }
+
+  m_boundary += m_segment_frames;
+
+  if (!next) {
+    // The file already existed when the segment was prepared.
+    next.reset(m_factory(next_name));
+  }
+
+  if (!(*next)) {
+    // Keep writing to the current file rather than losing audio,
+    // and try again at the next boundary.
+    fprintf(stderr, "WARNING: can not open next segment (%s)\n",
+            next->error().c_str());
+    next.reset();
+    prepare_next();
+    return true;
+  }
+
+  // Close the current file in the background.
+  AudioOutput *prev = m_current.release();
+  std::string prev_name = m_current_name;
+  post([prev, prev_name] {
+    delete prev;
+    sync_file(prev_name);
+  });
+
+  m_current = std::move(next);
+  m_current_name = next_name;
+  m_index++;
+
+  prepare_next();
+  return true;
+}
+
+// Return the frame at which the current segment ends.
+std::uint64_t RotatingAudioOutput::choose_cut() {
+  // Move the boundary to the nearest sync point within half a second,
+  // or a quarter segment for very short segments.
+  std::uint64_t tol = std::min<std::uint64_t>(m_samplerate / 2,
+                                              m_segment_frames / 4);
+  std::uint64_t cut = m_boundary;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Forget sync points in the past.
+    m_sync_points.erase(std::remove_if(m_sync_points.begin(),
+                                       m_sync_points.end(),
+                                       [this](std::uint64_t s) {
+                                         return s < m_frames;
+                                       }),
+                        m_sync_points.end());
+
+    std::uint64_t best = tol + 1;
+    for (std::uint64_t s : m_sync_points) {
+      std::uint64_t d = (s > m_boundary) ? s - m_boundary : m_boundary - s;
+      if (d < best) {
+        best = d;
+        cut = s;
+      }
+    }
+  }
+
+  return std::max(cut, m_frames);
+}
+
+// Queue a job for the background thread.
+void RotatingAudioOutput::post(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(std::move(job));
+  }
+  m_cond.notify_all();
+}
+
+// Background thread running file system operations.
+void RotatingAudioOutput::run() {
+  for (;;) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+      if (m_jobs.empty()) {
+        break;
+      }
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+    job();
+  }
+}
+
+/* end */
@@ -31,7 +31,8 @@ RtlSdrSource *RtlSdrSource::m_this = 0;
 
 // Open RTL-SDR device.
 RtlSdrSource::RtlSdrSource(int dev_index)
-    : m_dev(0), m_block_length(default_block_length), m_thread(0) {
+    : m_dev(0), m_block_length(default_block_length), m_async(false),
+      m_buf_num(default_buf_num), m_short_reads(0), m_thread(0) {
   int r;
 
   const char *devname = rtlsdr_get_device_name(dev_index);
@@ -157,6 +158,22 @@ bool RtlSdrSource::configure(std::string configurationStr) {
       agcmode = true;
     }
 
+    if (m.find("async") != m.end()) {
+      std::cerr << "RtlSdrSource::configure: async" << std::endl;
+      m_async = true;
+    }
+
+    if (m.find("bufnum") != m.end()) {
+      std::cerr << "RtlSdrSource::configure: bufnum: " << m["bufnum"]
+                << std::endl;
+      m_buf_num = atoi(m["bufnum"].c_str());
+
+      if (m_buf_num < 2 || m_buf_num > 256) {
+        m_error = "Invalid number of buffers";
+        return false;
+      }
+    }
+
     // Intentionally tune at a higher frequency to avoid DC offset.
     m_confFreq = frequency;
     m_confAgc = agcmode;
@@ -250,6 +267,11 @@ void RtlSdrSource::print_specific_parms() {
 
   fprintf(stderr, "RTL AGC mode:      %s\n",
           m_confAgc ? "enabled" : "disabled");
+
+  if (m_async) {
+    fprintf(stderr, "USB transfers:     %d x %d bytes (async)\n", m_buf_num,
+            2 * m_block_length);
+  }
 }
 
 // Return current tuner gain in units of 0.1 dB.
@@ -284,22 +306,106 @@ bool RtlSdrSource::start(DataBuffer<IQSample> *buf,
   }
 }
 
+// Stop streaming and report short reads.
 bool RtlSdrSource::stop() {
   if (m_thread) {
+    if (m_async) {
+      rtlsdr_cancel_async(m_dev);
+    }
     m_thread->join();
     delete m_thread;
     m_thread = 0;
+
+    if (m_short_reads > 0) {
+      fprintf(stderr, "RTL-SDR: %llu short reads, samples lost\n",
+              (unsigned long long)m_short_reads);
+    }
   }
 
   return true;
 }
 
+// Retune while streaming.
+bool RtlSdrSource::retune(uint32_t frequency, std::string &error) {
+  if ((frequency < 10000000) || (frequency > 2200000000)) {
+    error = "Invalid frequency";
+    return false;
+  }
+
+  // Keep the offset from configure() which avoids the DC offset.
+  uint32_t tuner_freq = frequency + 0.25 * get_sample_rate();
+  if (rtlsdr_set_center_freq(m_dev, tuner_freq) < 0) {
+    error = "rtlsdr_set_center_freq failed";
+    return false;
+  }
+
+  m_confFreq = frequency;
+  return true;
+}
+
+// Change tuner gain while streaming.
+bool RtlSdrSource::set_tuner_gain(int gain, std::string &error) {
+  if (gain == INT_MIN) {
+    if (rtlsdr_set_tuner_gain_mode(m_dev, 0) < 0) {
+      error = "rtlsdr_set_tuner_gain_mode could not set automatic gain";
+      return false;
+    }
+    return true;
+  }
+
+  if (find(m_gains.begin(), m_gains.end(), gain) == m_gains.end()) {
+    error = "Gain not supported. Available gains (dB): " + m_gainsStr;
+    return false;
+  }
+  if (rtlsdr_set_tuner_gain_mode(m_dev, 1) < 0) {
+    error = "rtlsdr_set_tuner_gain_mode could not set manual gain";
+    return false;
+  }
+  if (rtlsdr_set_tuner_gain(m_dev, gain) < 0) {
+    error = "rtlsdr_set_tuner_gain failed";
+    return false;
+  }
+  return true;
+}
+
 void RtlSdrSource::run() {
-  IQSampleVector iqsamples;
+  if (m_this->m_async) {
+    // Keep several transfers queued in the USB stack, so that the device
+    // is read even while no thread of ours is scheduled.
+    int r = rtlsdr_read_async(m_this->m_dev, rx_callback, m_this,
+                              m_this->m_buf_num, 2 * m_this->m_block_length);
+    if (r < 0) {
+      m_this->m_error = "rtlsdr_read_async failed";
+    }
+  } else {
+    IQSampleVector iqsamples;
 
-  while (!m_this->m_stop_flag->load() && get_samples(&iqsamples)) {
-    m_this->m_buf->push(move(iqsamples));
+    while (!m_this->m_stop_flag->load() && get_samples(&iqsamples)) {
+      m_this->m_buf->push(move(iqsamples));
+    }
+  }
+
+  // Let the decoder finish if streaming ends with an error.
+  m_this->m_buf->push_end();
+}
+
+// Receive a transfer in asynchronous mode.
+void RtlSdrSource::rx_callback(unsigned char *buf, uint32_t len, void *ctx) {
+  RtlSdrSource *self = (RtlSdrSource *)ctx;
+  double timestamp = monotonic_time();
+
+  if (self->m_stop_flag->load()) {
+    rtlsdr_cancel_async(self->m_dev);
+    return;
   }
+
+  if (len != uint32_t(2 * self->m_block_length)) {
+    self->m_short_reads++;
+  }
+
+  IQSampleVector iqsamples = self->m_buf->get_spare();
+  iq_samples_from_u8(buf, len / 2, iqsamples);
+  self->m_buf->push(move(iqsamples), timestamp);
 }
 
 // Fetch a bunch of samples from the device.
@@ -324,19 +430,13 @@ bool RtlSdrSource::get_samples(IQSampleVector *samples) {
     return false;
   }
 
+  // Pass on what has been read; the gap is reported when stopping.
   if (n_read != 2 * m_this->m_block_length) {
-    m_this->m_error = "short read, samples lost";
-    return false;
+    m_this->m_short_reads++;
   }
 
-  samples->resize(m_this->m_block_length);
-
-  for (int i = 0; i < m_this->m_block_length; i++) {
-    int32_t re = buf[2 * i];
-    int32_t im = buf[2 * i + 1];
-    (*samples)[i] = IQSample((re - 128) / IQSample::value_type(128),
-                             (im - 128) / IQSample::value_type(128));
-  }
+  *samples = m_this->m_buf->get_spare();
+  iq_samples_from_u8(buf.data(), n_read / 2, *samples);
 
   return true;
 }
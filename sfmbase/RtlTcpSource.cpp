@@ -0,0 +1,409 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RtlTcpSource.h"
+#include "parsekv.h"
+#include "util.h"
+
+// Tuner names in the order of enum rtlsdr_tuner.
+static const char *const tuner_names[] = {"unknown", "E4000",  "FC0012",
+                                          "FC0013",  "FC2580", "R820T",
+                                          "R828D"};
+
+// Decode a big-endian 32-bit value.
+static std::uint32_t get_be32(const std::uint8_t *p) {
+  return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) |
+         (std::uint32_t(p[2]) << 8) | std::uint32_t(p[3]);
+}
+
+// Construct unconnected source.
+RtlTcpSource::RtlTcpSource(int)
+    : m_fd(-1), m_tuner_type(0), m_tuner_gain_count(0), m_sample_rate(0),
+      m_frequency(0), m_tuner_gain(INT_MIN), m_ppm(0), m_agc(false),
+      m_block_length(default_block_length), m_thread(0) {
+  m_devname = "rtl_tcp network source";
+}
+
+// Close connection.
+RtlTcpSource::~RtlTcpSource() {
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+}
+
+bool RtlTcpSource::configure(std::string configurationStr) {
+  namespace qi = boost::spirit::qi;
+  std::string::iterator begin = configurationStr.begin();
+  std::string::iterator end = configurationStr.end();
+
+  std::string host("127.0.0.1");
+  std::string port(std::to_string(default_port));
+  uint32_t sample_rate = 1000000;
+  uint32_t frequency = 100000000;
+  int tuner_gain = INT_MIN;
+  int block_length = default_block_length;
+  int ppm = 0;
+  bool agcmode = false;
+  bool list_gains = false;
+
+  parsekv::key_value_sequence<std::string::iterator> p;
+  parsekv::pairs_type m;
+
+  if (!qi::parse(begin, end, p, m)) {
+    m_error = "Configuration parsing failed\n";
+    return false;
+  }
+
+  if (m.find("host") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: host: " << m["host"] << std::endl;
+    host = m["host"];
+  }
+
+  if (m.find("port") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: port: " << m["port"] << std::endl;
+    port = m["port"];
+  }
+
+  if (m.find("srate") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: srate: " << m["srate"]
+              << std::endl;
+    sample_rate = atoi(m["srate"].c_str());
+
+    if ((sample_rate < 225001) ||
+        ((sample_rate > 300000) && (sample_rate < 900001)) ||
+        (sample_rate > 3200000)) {
+      m_error = "Invalid sample rate";
+      return false;
+    }
+  }
+
+  if (m.find("freq") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: freq: " << m["freq"] << std::endl;
+    frequency = atoi(m["freq"].c_str());
+
+    if ((frequency < 10000000) || (frequency > 2200000000)) {
+      m_error = "Invalid frequency";
+      return false;
+    }
+  }
+
+  if (m.find("gain") != m.end()) {
+    std::string gain_str = m["gain"];
+    std::cerr << "RtlTcpSource::configure: gain: " << gain_str << std::endl;
+
+    if (strcasecmp(gain_str.c_str(), "auto") == 0) {
+      tuner_gain = INT_MIN;
+    } else if (strcasecmp(gain_str.c_str(), "list") == 0) {
+      list_gains = true;
+    } else {
+      double tmpgain;
+
+      if (!parse_dbl(gain_str.c_str(), tmpgain) || tmpgain < -100 ||
+          tmpgain > 100) {
+        m_error = "Invalid gain";
+        return false;
+      }
+      // The server selects the nearest gain the tuner supports.
+      tuner_gain = lrint(tmpgain * 10);
+    }
+  }
+
+  if (m.find("ppm") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: ppm: " << m["ppm"] << std::endl;
+    ppm = atoi(m["ppm"].c_str());
+  }
+
+  if (m.find("blklen") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: blklen: " << m["blklen"]
+              << std::endl;
+    block_length = atoi(m["blklen"].c_str());
+  }
+
+  if (m.find("agc") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: agc" << std::endl;
+    agcmode = true;
+  }
+
+  if (!connect_server(host, port)) {
+    return false;
+  }
+
+  if (list_gains) {
+    m_error = "The " + std::string(tuner_names[m_tuner_type]) +
+              " tuner of the server has " +
+              std::to_string(m_tuner_gain_count) +
+              " gain steps (rtl_tcp does not report the values)";
+    return false;
+  }
+
+  // Intentionally tune at a higher frequency to avoid DC offset.
+  m_confFreq = frequency;
+  m_sample_rate = sample_rate;
+  m_frequency = frequency + 0.25 * sample_rate;
+  m_tuner_gain = tuner_gain;
+  m_ppm = ppm;
+  m_agc = agcmode;
+
+  // set block length
+  m_block_length =
+      (block_length < 4096)
+          ? 4096
+          : (block_length > 1024 * 1024) ? 1024 * 1024 : block_length;
+  m_block_length -= m_block_length % 4096;
+
+  if (!send_command(CMD_SET_SAMPLE_RATE, m_sample_rate, m_error) ||
+      !send_command(CMD_SET_FREQ, m_frequency, m_error) ||
+      !send_command(CMD_SET_GAIN_MODE, tuner_gain != INT_MIN, m_error) ||
+      (tuner_gain != INT_MIN &&
+       !send_command(CMD_SET_GAIN, std::uint32_t(tuner_gain), m_error)) ||
+      !send_command(CMD_SET_AGC_MODE, agcmode, m_error) ||
+      (ppm != 0 &&
+       !send_command(CMD_SET_FREQ_CORRECTION, std::uint32_t(ppm),
+                     m_error))) {
+    return false;
+  }
+
+  return true;
+}
+
+// Connect to the server and read the header.
+bool RtlTcpSource::connect_server(const std::string &host,
+                                  const std::string &port) {
+  m_server = host + ":" + port;
+
+  // Reconfiguring replaces the previous connection.
+  if (m_fd >= 0) {
+    close(m_fd);
+    m_fd = -1;
+  }
+
+  struct addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *ai = NULL;
+  int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &ai);
+  if (ret != 0) {
+    m_error = "Can not resolve '" + m_server + "' (" + gai_strerror(ret) + ")";
+    return false;
+  }
+
+  int err = 0;
+  for (struct addrinfo *a = ai; a != NULL; a = a->ai_next) {
+    m_fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+    if (m_fd >= 0 && connect(m_fd, a->ai_addr, a->ai_addrlen) == 0) {
+      break;
+    }
+    err = errno;
+    if (m_fd >= 0) {
+      close(m_fd);
+      m_fd = -1;
+    }
+  }
+  freeaddrinfo(ai);
+  if (m_fd < 0) {
+    m_error = "Can not connect to '" + m_server + "' (" + strerror(err) + ")";
+    return false;
+  }
+
+  // Send commands immediately; buffer up to about a second of samples
+  // against network jitter. Time out receiving so that the receive thread
+  // can check the stop flag.
+  int one = 1;
+  int rcvbuf = 4 * 1024 * 1024;
+  struct timeval tv = {0, 200000};
+  setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  // Read header.
+  std::uint8_t header[12];
+  std::size_t fill = 0;
+  int timeouts = 0;
+  while (fill < sizeof(header)) {
+    ssize_t k = recv(m_fd, header + fill, sizeof(header) - fill, 0);
+    if (k > 0) {
+      fill += k;
+    } else if (k < 0 && (errno == EAGAIN || errno == EINTR) &&
+               ++timeouts < 25) {
+      continue;
+    } else {
+      m_error = "No rtl_tcp header from '" + m_server + "'";
+      return false;
+    }
+  }
+
+  if (std::memcmp(header, "RTL0", 4) != 0) {
+    m_error = "'" + m_server + "' is not an rtl_tcp server";
+    return false;
+  }
+  m_tuner_type = get_be32(header + 4);
+  m_tuner_gain_count = get_be32(header + 8);
+  if (m_tuner_type >= sizeof(tuner_names) / sizeof(tuner_names[0])) {
+    m_tuner_type = 0;
+  }
+
+  return true;
+}
+
+// Send a command.
+bool RtlTcpSource::send_command(Command cmd, std::uint32_t param,
+                                std::string &error) {
+  std::uint8_t buf[5] = {std::uint8_t(cmd), std::uint8_t(param >> 24),
+                         std::uint8_t(param >> 16), std::uint8_t(param >> 8),
+                         std::uint8_t(param)};
+  if (send(m_fd, buf, sizeof(buf), MSG_NOSIGNAL) != ssize_t(sizeof(buf))) {
+    error = "Sending command to '" + m_server + "' failed";
+    return false;
+  }
+  return true;
+}
+
+// Return current sample frequency in Hz.
+uint32_t RtlTcpSource::get_sample_rate() { return m_sample_rate; }
+
+// Return device current center frequency in Hz.
+uint32_t RtlTcpSource::get_frequency() { return m_frequency; }
+
+void RtlTcpSource::print_specific_parms() {
+  fprintf(stderr, "rtl_tcp server:    %s\n", m_server.c_str());
+  fprintf(stderr, "tuner:             %s\n", tuner_names[m_tuner_type]);
+
+  if (m_tuner_gain == INT_MIN) {
+    fprintf(stderr, "LNA gain:          auto\n");
+  } else {
+    fprintf(stderr, "LNA gain:          %.1f dB\n", 0.1 * m_tuner_gain);
+  }
+
+  fprintf(stderr, "RTL AGC mode:      %s\n", m_agc ? "enabled" : "disabled");
+  fprintf(stderr, "PPM correction:    %d\n", m_ppm);
+}
+
+bool RtlTcpSource::start(DataBuffer<IQSample> *buf,
+                         std::atomic_bool *stop_flag) {
+  m_buf = buf;
+  m_stop_flag = stop_flag;
+
+  if (m_fd < 0) {
+    m_error = "Not connected";
+    return false;
+  } else if (m_thread == 0) {
+    m_thread = new std::thread(&RtlTcpSource::run, this);
+    return true;
+  } else {
+    m_error = "Source thread already started";
+    return false;
+  }
+}
+
+bool RtlTcpSource::stop() {
+  if (m_thread) {
+    m_thread->join();
+    delete m_thread;
+    m_thread = 0;
+  }
+
+  return true;
+}
+
+// Retune while streaming by sending a command to the server.
+bool RtlTcpSource::retune(uint32_t frequency, std::string &error) {
+  if ((frequency < 10000000) || (frequency > 2200000000)) {
+    error = "Invalid frequency";
+    return false;
+  }
+
+  uint32_t tuner_freq = frequency + 0.25 * m_sample_rate;
+  if (!send_command(CMD_SET_FREQ, tuner_freq, error)) {
+    return false;
+  }
+
+  m_confFreq = frequency;
+  m_frequency = tuner_freq;
+  return true;
+}
+
+// Change tuner gain while streaming.
+bool RtlTcpSource::set_tuner_gain(int gain, std::string &error) {
+  if (gain != INT_MIN && (gain < -1000 || gain > 1000)) {
+    error = "Invalid gain";
+    return false;
+  }
+
+  if (!send_command(CMD_SET_GAIN_MODE, gain != INT_MIN, error) ||
+      (gain != INT_MIN &&
+       !send_command(CMD_SET_GAIN, std::uint32_t(gain), error))) {
+    return false;
+  }
+
+  m_tuner_gain = gain;
+  return true;
+}
+
+// Receive thread.
+void RtlTcpSource::run() {
+  // One receive buffer for the whole stream; recv() fills it with as much
+  // data as is available, and full blocks are converted into vectors
+  // recycled by the decoder.
+  std::vector<std::uint8_t> raw(2 * m_block_length);
+  std::size_t fill = 0;
+  IQSampleVector iqsamples;
+
+  while (!m_stop_flag->load()) {
+    ssize_t k = recv(m_fd, raw.data() + fill, raw.size() - fill, 0);
+
+    if (k > 0) {
+      fill += k;
+      if (fill == raw.size()) {
+        iqsamples = m_buf->get_spare();
+        iq_samples_from_u8(raw.data(), m_block_length, iqsamples);
+        m_buf->push(move(iqsamples));
+        fill = 0;
+      }
+    } else if (k < 0 && (errno == EAGAIN || errno == EINTR)) {
+      // Receive timeout; check the stop flag.
+    } else {
+      m_error = (k == 0) ? "Connection closed by server"
+                         : "Receive failed (" + std::string(strerror(errno)) +
+                               ")";
+      break;
+    }
+  }
+
+  // Let the decoder finish when the stream ends.
+  m_buf->push_end();
+}
+
+// Return a list of supported devices.
+void RtlTcpSource::get_device_names(std::vector<std::string> &devices) {
+  devices.clear();
+  devices.push_back("rtl_tcp network source (see -c host=,port=)");
+}
+
+/* end */
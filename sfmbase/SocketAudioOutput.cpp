@@ -0,0 +1,248 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "SocketAudioOutput.h"
+
+constexpr std::size_t SocketAudioOutput::default_max_queue_bytes;
+
+// Maximum number of blocks per sendmsg() call.
+static const std::size_t max_send_blocks = 64;
+
+/* ****************  class SocketAudioOutput  **************** */
+
+// Construct socket server and start listening.
+SocketAudioOutput::SocketAudioOutput(const std::string &address,
+                                     SampleFormat format,
+                                     std::size_t max_queue_bytes)
+    : AudioOutput(format), m_max_queue_bytes(max_queue_bytes),
+      m_listen(address), m_evictions(0), m_evictions_reported(0),
+      m_stop(false) {
+  if (!m_listen) {
+    m_error = m_listen.error();
+    m_zombie = true;
+    return;
+  }
+
+  m_thread = std::thread(&SocketAudioOutput::run, this);
+}
+
+// Destructor.
+SocketAudioOutput::~SocketAudioOutput() {
+  if (m_thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_listen.wakeup();
+    m_thread.join();
+  }
+
+  for (std::unique_ptr<Client> &c : m_clients) {
+    close(c->fd);
+  }
+}
+
+// Write audio data.
+bool SocketAudioOutput::write(const SampleVector &samples) {
+  if (m_zombie) {
+    return false;
+  }
+  if (num_clients() == 0) {
+    return true;
+  }
+
+  // Encode directly into the block shared by the clients.
+  std::shared_ptr<std::vector<std::uint8_t>> bytes =
+      std::make_shared<std::vector<std::uint8_t>>();
+  samplesToBytes(samples, *bytes);
+  return enqueue(bytes);
+}
+
+// Write encoded audio data.
+bool SocketAudioOutput::write_bytes(const std::uint8_t *data, std::size_t n) {
+  if (m_zombie) {
+    return false;
+  }
+  if (num_clients() == 0) {
+    return true;
+  }
+
+  return enqueue(std::make_shared<std::vector<std::uint8_t>>(data, data + n));
+}
+
+// Return the number of connected clients.
+std::size_t SocketAudioOutput::num_clients() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return std::count_if(
+      m_clients.begin(), m_clients.end(),
+      [](const std::unique_ptr<Client> &c) { return !c->evicted; });
+}
+
+// Add a block to the queues of all clients.
+bool SocketAudioOutput::enqueue(const Block &block) {
+  std::size_t n = block->size();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (std::unique_ptr<Client> &c : m_clients) {
+      if (c->evicted) {
+        continue;
+      }
+      if (c->queued_bytes + n > m_max_queue_bytes) {
+        // Drop the client rather than wait for it.
+        c->evicted = true;
+        m_evictions++;
+        continue;
+      }
+      c->queue.push_back(block);
+      c->queued_bytes += n;
+    }
+  }
+  m_listen.wakeup();
+
+  if (m_evictions != m_evictions_reported) {
+    m_error = std::to_string(m_evictions - m_evictions_reported) +
+              " slow client(s) disconnected";
+    m_evictions_reported = m_evictions;
+    return false;
+  }
+
+  return true;
+}
+
+// Send queued data to a client.
+bool SocketAudioOutput::send_queued(Client &client) {
+  // Only this thread removes blocks, so the buffers stay valid while
+  // the lock is released.
+  struct iovec iov[max_send_blocks];
+  std::size_t niov = 0;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const Block &b : client.queue) {
+      if (niov == max_send_blocks) {
+        break;
+      }
+      std::size_t skip = (niov == 0) ? client.offset : 0;
+      iov[niov].iov_base = const_cast<std::uint8_t *>(b->data() + skip);
+      iov[niov].iov_len = b->size() - skip;
+      niov++;
+    }
+  }
+  if (niov == 0) {
+    return true;
+  }
+
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = niov;
+  ssize_t k = sendmsg(client.fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+  if (k < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+  }
+
+  // Release the blocks which have been sent completely.
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::size_t sent = k;
+  client.queued_bytes -= sent;
+  while (sent > 0) {
+    std::size_t left = client.queue.front()->size() - client.offset;
+    if (sent < left) {
+      client.offset += sent;
+      break;
+    }
+    sent -= left;
+    client.queue.pop_front();
+    client.offset = 0;
+  }
+
+  return true;
+}
+
+// Server thread.
+void SocketAudioOutput::run() {
+  std::vector<struct pollfd> pfds;
+
+  for (;;) {
+    std::size_t nclients;
+    pfds.clear();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_stop) {
+        break;
+      }
+
+      // Close clients which were evicted or have disconnected.
+      auto it = std::remove_if(m_clients.begin(), m_clients.end(),
+                               [](const std::unique_ptr<Client> &c) {
+                                 if (c->evicted) {
+                                   close(c->fd);
+                                 }
+                                 return c->evicted;
+                               });
+      m_clients.erase(it, m_clients.end());
+
+      nclients = m_clients.size();
+      for (std::unique_ptr<Client> &c : m_clients) {
+        short events = POLLIN | (c->queue.empty() ? 0 : POLLOUT);
+        pfds.push_back({c->fd, events, 0});
+      }
+    }
+
+    if (!m_listen.poll(pfds)) {
+      continue; // EINTR
+    }
+
+    // Clients are only added and removed by this thread.
+    for (std::size_t i = 0; i < nclients; i++) {
+      Client &c = *m_clients[i];
+      short revents = pfds[i].revents;
+      bool ok = !(revents & (POLLERR | POLLHUP | POLLNVAL));
+      if (ok && (revents & POLLIN)) {
+        // Discard anything the client sends; detect disconnection.
+        char buf[256];
+        ok = (recv(c.fd, buf, sizeof(buf), MSG_DONTWAIT) != 0);
+      }
+      if (ok && (revents & POLLOUT)) {
+        ok = send_queued(c);
+      }
+      if (!ok) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        c.evicted = true;
+      }
+    }
+
+    int fd;
+    while ((fd = m_listen.accept()) >= 0) {
+      std::unique_ptr<Client> c(new Client);
+      c->fd = fd;
+      c->offset = 0;
+      c->queued_bytes = 0;
+      c->evicted = false;
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_clients.push_back(std::move(c));
+    }
+  }
+}
+
+/* end */
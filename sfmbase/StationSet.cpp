@@ -0,0 +1,168 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "StationSet.h"
+
+/* ****************  class StationSet  **************** */
+
+// Construct the channelizer and a decoder for each station.
+StationSet::StationSet(double sample_rate_if, double tuner_freq,
+                       const std::vector<double> &station_freqs,
+                       unsigned int sample_rate_pcm, bool stereo,
+                       double deemphasis, double bandwidth_pcm,
+                       bool pilot_shift, bool pipeline,
+                       unsigned int nworkers,
+                       DecoderPool::LagPolicy lag_policy,
+                       const std::vector<int> &cpus)
+    : m_sample_rate_if(sample_rate_if), m_freqs(station_freqs),
+      m_nchannels(0), m_downsample(1) {
+  std::vector<double> offsets;
+  for (double f : m_freqs) {
+    offsets.push_back(f - tuner_freq);
+  }
+
+  m_nchannels = PolyphaseChannelizer::choose_num_channels(
+      sample_rate_if, offsets, FmDecoder::default_bandwidth_if,
+      2 * FmDecoder::default_bandwidth_if);
+  if (m_nchannels == 0) {
+    char buf[120];
+    snprintf(buf, sizeof(buf),
+             "stations must be within %.3f to %.3f MHz and "
+             "away from the band edges",
+             (tuner_freq - 0.5 * sample_rate_if) * 1.0e-6,
+             (tuner_freq + 0.5 * sample_rate_if) * 1.0e-6);
+    m_error = buf;
+    return;
+  }
+
+  // Downsample each channel like the single station decoder.
+  double chanrate = 2 * sample_rate_if / m_nchannels;
+  m_downsample =
+      std::max(1, int(chanrate / (FmDecoder::default_bandwidth_if * 2.2)));
+
+  // Throw away the first 5 blocks like the single station decoder.
+  m_pool.reset(new DecoderPool(5, nworkers, lag_policy));
+  for (unsigned int i = 0; i < nworkers && !cpus.empty(); i++) {
+    if (!m_pool->bind_worker(i, cpus[i % cpus.size()])) {
+      fprintf(stderr, "WARNING: DecoderPool: %s\n", m_pool->error().c_str());
+    }
+  }
+
+  for (double offset : offsets) {
+    m_channels.push_back(PolyphaseChannelizer::channel_index(
+        offset, sample_rate_if, m_nchannels));
+    m_residuals.push_back(PolyphaseChannelizer::channel_residual(
+        offset, sample_rate_if, m_nchannels));
+
+    int cpu = -1;
+    if (!cpus.empty() && nworkers == 0) {
+      cpu = cpus[m_pool->num_stations() % cpus.size()];
+    }
+    FmDecoder *decoder = new FmDecoder(
+        chanrate, m_residuals.back(), sample_rate_pcm, stereo, deemphasis,
+        FmDecoder::default_bandwidth_if, FmDecoder::default_freq_dev,
+        bandwidth_pcm, m_downsample, pilot_shift,
+        FmDecoder::default_audio_gain);
+    if (pipeline) {
+      decoder->start_pipeline();
+    }
+    if (!m_pool->add_station(decoder, cpu)) {
+      fprintf(stderr, "WARNING: DecoderPool: %s\n", m_pool->error().c_str());
+    }
+  }
+
+  m_channelizer.reset(new PolyphaseChannelizer(m_nchannels, m_channels));
+}
+
+// Print the channel of each station.
+void StationSet::print_parms() const {
+  if (m_nchannels == 0) {
+    return;
+  }
+  fprintf(stderr, "channelizer:       %u channels of %.1f kHz\n", m_nchannels,
+          m_sample_rate_if / m_nchannels * 1.0e-3);
+  fprintf(stderr, "channel rate:      %.0f Hz (downsampled by %u)\n",
+          2 * m_sample_rate_if / m_nchannels, m_downsample);
+  for (std::size_t i = 0; i < m_freqs.size(); i++) {
+    fprintf(stderr, "station:           %.6f MHz (channel %u%+.1f kHz)\n",
+            m_freqs[i] * 1.0e-6, m_channels[i], m_residuals[i] * 1.0e-3);
+  }
+}
+
+// Split a block into the station channels and queue it for decoding.
+void StationSet::process(const IQSampleVector &samples_in) {
+  // The station threads share the channelized block.
+  std::shared_ptr<std::vector<IQSampleVector>> channel_samples =
+      std::make_shared<std::vector<IQSampleVector>>();
+  m_channelizer->process(samples_in, *channel_samples);
+  m_pool->process(channel_samples);
+}
+
+// Return a one-line status with the IF level of each station.
+std::string StationSet::status() const {
+  std::string line;
+  for (std::size_t i = 0; i < m_freqs.size(); i++) {
+    double if_level = m_pool->get_if_level(i);
+    char buf[40];
+    snprintf(buf, sizeof(buf), " %.1f%c%+5.1fdB", m_freqs[i] * 1.0e-6,
+             m_pool->stereo_detected(i) ? 'S' : 'M',
+             (if_level > 0) ? 20 * log10(if_level) : -99.9);
+    line += buf;
+  }
+  return line;
+}
+
+// Decode all queued blocks and print the statistics of the pool.
+void StationSet::finish() {
+  if (!m_pool) {
+    return;
+  }
+  m_pool->finish();
+
+  for (std::size_t i = 0; i < m_freqs.size(); i++) {
+    std::uint64_t dropped = m_pool->dropped_blocks(i);
+    if (dropped > 0) {
+      fprintf(stderr, "station %.6f MHz: skipped %llu blocks\n",
+              m_freqs[i] * 1.0e-6, (unsigned long long)dropped);
+    }
+  }
+
+  WorkStealingScheduler *sched = m_pool->scheduler();
+  if (sched != NULL) {
+    for (unsigned int i = 0; i < sched->num_workers(); i++) {
+      WorkStealingScheduler::WorkerStats ws = sched->stats(i);
+      fprintf(stderr,
+              "worker %u: %llu blocks, %llu steals, %llu idle waits, "
+              "queue depth mean %.2f max %zu\n",
+              i, (unsigned long long)ws.tasks,
+              (unsigned long long)ws.steals,
+              (unsigned long long)ws.idle_waits,
+              (ws.tasks > ws.steals)
+                  ? double(ws.depth_sum) / (ws.tasks - ws.steals)
+                  : 0.0,
+              ws.depth_max);
+    }
+    fprintf(stderr, "largest backlog of a station: %zu blocks\n",
+            sched->max_strand_depth());
+  }
+}
+
+/* end */
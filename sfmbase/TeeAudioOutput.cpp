@@ -0,0 +1,169 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstdio>
+
+#include "TeeAudioOutput.h"
+
+constexpr unsigned int TeeAudioOutput::default_queue_blocks;
+constexpr double TeeAudioOutput::drop_report_interval;
+
+/* ****************  class TeeAudioOutput  **************** */
+
+// Construct tee without sinks.
+TeeAudioOutput::TeeAudioOutput(unsigned int queue_blocks)
+    : m_queue_blocks(std::max(1U, queue_blocks)) {}
+
+// Destructor.
+TeeAudioOutput::~TeeAudioOutput() {
+  for (std::unique_ptr<Sink> &s : m_sinks) {
+    {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->stop = true;
+    }
+    s->cond.notify_all();
+  }
+  for (std::unique_ptr<Sink> &s : m_sinks) {
+    s->thread.join();
+    if (s->dropped > 0) {
+      fprintf(stderr, "WARNING: %s: %llu blocks dropped in total\n",
+              s->name.c_str(), (unsigned long long)s->dropped);
+    }
+  }
+}
+
+// Add a sink and start its thread.
+void TeeAudioOutput::add_sink(AudioOutput *sink, const std::string &name) {
+  std::unique_ptr<Sink> s(new Sink);
+  s->output.reset(sink);
+  s->name = name;
+  s->dropped = 0;
+  s->dropped_reported = 0;
+  s->drop_report_time = 0;
+  s->stop = false;
+
+  // The first sink of each sample format encodes for all of them.
+  s->encoder = m_sinks.size();
+  for (std::size_t i = 0; i < m_sinks.size(); i++) {
+    if (m_sinks[i]->output->format() == sink->format()) {
+      s->encoder = i;
+      break;
+    }
+  }
+
+  s->thread = std::thread(run, s.get());
+  m_sinks.push_back(std::move(s));
+  m_blocks.resize(m_sinks.size());
+}
+
+// Write audio data.
+bool TeeAudioOutput::write(const SampleVector &samples) {
+  // Report only the events since the previous call.
+  m_error.clear();
+
+  for (std::size_t i = 0; i < m_sinks.size(); i++) {
+    Sink &s = *m_sinks[i];
+
+    // Encode the block once per format. The sink threads only write
+    // encoded data, so encoding does not conflict with them.
+    if (s.encoder == i) {
+      std::shared_ptr<std::vector<std::uint8_t>> bytes =
+          std::make_shared<std::vector<std::uint8_t>>();
+      s.output->samplesToBytes(samples, *bytes);
+      m_blocks[i] = bytes;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(s.mutex);
+      if (s.queue.size() < m_queue_blocks) {
+        s.queue.push_back(m_blocks[s.encoder]);
+      } else {
+        s.dropped++;
+      }
+    }
+    s.cond.notify_all();
+  }
+
+  // Release the blocks as soon as the sinks are done with them.
+  std::fill(m_blocks.begin(), m_blocks.end(), Block());
+
+  // Collect errors of the sinks. Dropped blocks are the expected
+  // result of a slow sink, so they are only warned about now and then.
+  double now = monotonic_time();
+  for (std::unique_ptr<Sink> &s : m_sinks) {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    if (!s->error.empty()) {
+      if (!m_error.empty()) {
+        m_error += "; ";
+      }
+      m_error += s->name + ": " + s->error;
+      s->error.clear();
+    }
+    if (s->dropped != s->dropped_reported &&
+        now - s->drop_report_time >= drop_report_interval) {
+      fprintf(stderr, "WARNING: %s: %llu blocks dropped (output too slow)\n",
+              s->name.c_str(),
+              (unsigned long long)(s->dropped - s->dropped_reported));
+      s->dropped_reported = s->dropped;
+      s->drop_report_time = now;
+    }
+  }
+
+  return m_error.empty();
+}
+
+// Write encoded audio data.
+bool TeeAudioOutput::write_bytes(const std::uint8_t *, std::size_t) {
+  m_error = "encoded data can not be written to a tee";
+  return false;
+}
+
+// Set dither mode of all sinks.
+void TeeAudioOutput::set_dither(DitherMode mode, unsigned int nchannels) {
+  for (std::unique_ptr<Sink> &s : m_sinks) {
+    s->output->set_dither(mode, nchannels);
+  }
+}
+
+// Sink thread.
+void TeeAudioOutput::run(Sink *sink) {
+  for (;;) {
+    Block block;
+    {
+      std::unique_lock<std::mutex> lock(sink->mutex);
+      sink->cond.wait(lock,
+                      [sink] { return sink->stop || !sink->queue.empty(); });
+      if (sink->queue.empty()) {
+        break;
+      }
+      block = std::move(sink->queue.front());
+      sink->queue.pop_front();
+    }
+
+    AudioOutput &out = *sink->output;
+    if (!out.write_bytes(block->data(), block->size()) || !out) {
+      std::string err = out.error();
+      if (!err.empty()) {
+        std::lock_guard<std::mutex> lock(sink->mutex);
+        sink->error = err;
+      }
+    }
+  }
+}
+
+/* end */
@@ -0,0 +1,622 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <net/if.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "UdpSource.h"
+#include "parsekv.h"
+#include "util.h"
+
+// Size of the sequence number header in bytes.
+static const std::size_t header_size = 4;
+
+// Maximum size of a datagram.
+static const std::size_t max_datagram_size = 65536;
+
+// Number of datagrams received with one recvmmsg() call.
+static const unsigned int recv_batch = 32;
+
+// Construct unbound source.
+UdpSource::UdpSource(int)
+    : m_fd(-1), m_multicast(false), m_rcvbuf(0), m_sample_rate(0),
+      m_frequency(0), m_format(PAYLOAD_S16_LE), m_conceal(CONCEAL_INTERP),
+      m_window(default_reorder_window), m_block_length(default_block_length),
+      m_thread(0), m_started(false), m_next_seq(0), m_datagram_samples(0),
+      m_last_sample(0) {
+  m_devname = "UDP IQ stream";
+  std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+// Close socket.
+UdpSource::~UdpSource() {
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+}
+
+bool UdpSource::configure(std::string configurationStr) {
+  namespace qi = boost::spirit::qi;
+  std::string::iterator begin = configurationStr.begin();
+  std::string::iterator end = configurationStr.end();
+
+  std::string addr("0.0.0.0");
+  std::string port(std::to_string(default_port));
+  std::string iface;
+  uint32_t sample_rate = 1000000;
+  uint32_t frequency = 100000000;
+  uint32_t center = 0;
+  int rcvbuf = 8 * 1024 * 1024;
+  int window = default_reorder_window;
+  int block_length = default_block_length;
+
+  parsekv::key_value_sequence<std::string::iterator> p;
+  parsekv::pairs_type m;
+
+  if (!qi::parse(begin, end, p, m)) {
+    m_error = "Configuration parsing failed\n";
+    return false;
+  }
+
+  if (m.find("addr") != m.end()) {
+    std::cerr << "UdpSource::configure: addr: " << m["addr"] << std::endl;
+    addr = m["addr"];
+  }
+
+  if (m.find("port") != m.end()) {
+    std::cerr << "UdpSource::configure: port: " << m["port"] << std::endl;
+    port = m["port"];
+  }
+
+  if (m.find("iface") != m.end()) {
+    std::cerr << "UdpSource::configure: iface: " << m["iface"] << std::endl;
+    iface = m["iface"];
+  }
+
+  if (m.find("srate") != m.end()) {
+    std::cerr << "UdpSource::configure: srate: " << m["srate"] << std::endl;
+    sample_rate = atoi(m["srate"].c_str());
+
+    if (sample_rate < 10000 || sample_rate > 100000000) {
+      m_error = "Invalid sample rate";
+      return false;
+    }
+  }
+
+  if (m.find("freq") != m.end()) {
+    std::cerr << "UdpSource::configure: freq: " << m["freq"] << std::endl;
+    frequency = atoi(m["freq"].c_str());
+
+    if (frequency < 1000000) {
+      m_error = "Invalid frequency";
+      return false;
+    }
+  }
+
+  if (m.find("center") != m.end()) {
+    std::cerr << "UdpSource::configure: center: " << m["center"]
+              << std::endl;
+    center = atoi(m["center"].c_str());
+
+    if (center < 1000000) {
+      m_error = "Invalid center frequency";
+      return false;
+    }
+  }
+
+  if (m.find("fmt") != m.end()) {
+    std::string fmt_str = m["fmt"];
+    std::cerr << "UdpSource::configure: fmt: " << fmt_str << std::endl;
+
+    if (strcasecmp(fmt_str.c_str(), "u8") == 0) {
+      m_format = PAYLOAD_U8;
+    } else if (strcasecmp(fmt_str.c_str(), "s16") == 0) {
+      m_format = PAYLOAD_S16_LE;
+    } else if (strcasecmp(fmt_str.c_str(), "f32") == 0) {
+      m_format = PAYLOAD_F32_LE;
+    } else {
+      m_error = "Invalid sample format";
+      return false;
+    }
+  }
+
+  if (m.find("conceal") != m.end()) {
+    std::string conceal_str = m["conceal"];
+    std::cerr << "UdpSource::configure: conceal: " << conceal_str
+              << std::endl;
+
+    if (strcasecmp(conceal_str.c_str(), "zero") == 0) {
+      m_conceal = CONCEAL_ZERO;
+    } else if (strcasecmp(conceal_str.c_str(), "interp") == 0) {
+      m_conceal = CONCEAL_INTERP;
+    } else {
+      m_error = "Invalid concealment mode";
+      return false;
+    }
+  }
+
+  if (m.find("window") != m.end()) {
+    std::cerr << "UdpSource::configure: window: " << m["window"]
+              << std::endl;
+    window = atoi(m["window"].c_str());
+
+    if (window < 1 || window > 1024) {
+      m_error = "Invalid reorder window";
+      return false;
+    }
+  }
+
+  if (m.find("rcvbuf") != m.end()) {
+    std::cerr << "UdpSource::configure: rcvbuf: " << m["rcvbuf"]
+              << std::endl;
+    rcvbuf = atoi(m["rcvbuf"].c_str());
+
+    if (rcvbuf < 65536) {
+      m_error = "Invalid receive buffer size";
+      return false;
+    }
+  }
+
+  if (m.find("blklen") != m.end()) {
+    std::cerr << "UdpSource::configure: blklen: " << m["blklen"]
+              << std::endl;
+    block_length = atoi(m["blklen"].c_str());
+  }
+
+  // The stream is centered on the station unless told otherwise.
+  m_confFreq = frequency;
+  m_frequency = (center != 0) ? center : frequency;
+  m_sample_rate = sample_rate;
+  m_window = window;
+
+  // set block length
+  m_block_length =
+      (block_length < 4096)
+          ? 4096
+          : (block_length > 1024 * 1024) ? 1024 * 1024 : block_length;
+
+  return open_socket(addr, port, iface, rcvbuf);
+}
+
+// Open and bind the socket.
+bool UdpSource::open_socket(const std::string &addr, const std::string &port,
+                            const std::string &iface, int rcvbuf) {
+  m_addr = (addr.find(':') != std::string::npos ? "[" + addr + "]" : addr) +
+           ":" + port;
+
+  struct addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+  struct addrinfo *ai = NULL;
+  int ret = getaddrinfo(addr.c_str(), port.c_str(), &hints, &ai);
+  if (ret != 0) {
+    m_error = "Invalid address '" + m_addr + "' (" + gai_strerror(ret) + ")";
+    return false;
+  }
+
+  if (ai->ai_family == AF_INET) {
+    struct sockaddr_in *sa = (struct sockaddr_in *)ai->ai_addr;
+    m_multicast = IN_MULTICAST(ntohl(sa->sin_addr.s_addr));
+  } else if (ai->ai_family == AF_INET6) {
+    struct sockaddr_in6 *sa = (struct sockaddr_in6 *)ai->ai_addr;
+    m_multicast = IN6_IS_ADDR_MULTICAST(&sa->sin6_addr);
+  }
+
+  unsigned int ifindex = 0;
+  if (!iface.empty() && (ifindex = if_nametoindex(iface.c_str())) == 0) {
+    freeaddrinfo(ai);
+    m_error = "Unknown interface '" + iface + "'";
+    return false;
+  }
+
+  // Link-local IPv6 addresses need the interface as scope.
+  if (ai->ai_family == AF_INET6 && ifindex != 0) {
+    ((struct sockaddr_in6 *)ai->ai_addr)->sin6_scope_id = ifindex;
+  }
+
+  // Reconfiguring replaces the previous socket.
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+
+  m_fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, 0);
+  int one = 1;
+  bool ok = m_fd >= 0;
+
+  // Several decoders on one host may receive the same group.
+  if (ok && m_multicast) {
+    ok = setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0;
+  }
+  ok = ok && bind(m_fd, ai->ai_addr, ai->ai_addrlen) == 0;
+
+  if (ok && m_multicast && ai->ai_family == AF_INET) {
+    struct ip_mreqn mreq;
+    std::memset(&mreq, 0, sizeof(mreq));
+    mreq.imr_multiaddr = ((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+    mreq.imr_ifindex = ifindex;
+    ok = setsockopt(m_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                    sizeof(mreq)) == 0;
+  } else if (ok && m_multicast) {
+    struct ipv6_mreq mreq;
+    std::memset(&mreq, 0, sizeof(mreq));
+    mreq.ipv6mr_multiaddr = ((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr;
+    mreq.ipv6mr_interface = ifindex;
+    ok = setsockopt(m_fd, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq,
+                    sizeof(mreq)) == 0;
+  }
+
+  int err = errno;
+  freeaddrinfo(ai);
+  if (!ok) {
+    m_error = "Can not receive on '" + m_addr + "' (" + strerror(err) + ")";
+    return false;
+  }
+
+  // A burst of datagrams must fit into the socket buffer while the receive
+  // thread is not scheduled. SO_RCVBUFFORCE ignores net.core.rmem_max but
+  // needs privileges.
+  if (setsockopt(m_fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) !=
+      0) {
+    setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  }
+  socklen_t optlen = sizeof(m_rcvbuf);
+  getsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &m_rcvbuf, &optlen);
+  m_rcvbuf /= 2; // the kernel doubles the value for its bookkeeping
+
+  // Time out receiving so that the receive thread can check the stop flag.
+  struct timeval tv = {0, 200000};
+  setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  return true;
+}
+
+// Return current sample frequency in Hz.
+uint32_t UdpSource::get_sample_rate() { return m_sample_rate; }
+
+// Return device current center frequency in Hz.
+uint32_t UdpSource::get_frequency() { return m_frequency; }
+
+void UdpSource::print_specific_parms() {
+  static const char *const format_names[] = {"u8", "s16", "f32"};
+
+  fprintf(stderr, "UDP address:       %s%s\n", m_addr.c_str(),
+          m_multicast ? " (multicast)" : "");
+  fprintf(stderr, "sample format:     %s\n", format_names[m_format]);
+  fprintf(stderr, "receive buffer:    %d bytes\n", m_rcvbuf);
+  fprintf(stderr, "reorder window:    %u datagrams\n", m_window);
+  fprintf(stderr, "concealment:       %s\n",
+          m_conceal == CONCEAL_ZERO ? "zero" : "interpolate");
+}
+
+bool UdpSource::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag) {
+  m_buf = buf;
+  m_stop_flag = stop_flag;
+
+  if (m_fd < 0) {
+    m_error = "Socket not open";
+    return false;
+  } else if (m_thread == 0) {
+    m_thread = new std::thread(&UdpSource::run, this);
+    return true;
+  } else {
+    m_error = "Source thread already started";
+    return false;
+  }
+}
+
+// Stop receiving and print statistics.
+bool UdpSource::stop() {
+  if (m_thread) {
+    m_thread->join();
+    delete m_thread;
+    m_thread = 0;
+
+    std::uint64_t total = m_stats.received + m_stats.lost;
+    fprintf(stderr,
+            "UDP datagrams: %llu received, %llu lost (%.3f%%), "
+            "%llu reordered, %llu late, %llu duplicate, %llu invalid, "
+            "%llu resyncs\n",
+            (unsigned long long)m_stats.received,
+            (unsigned long long)m_stats.lost,
+            total ? 100.0 * m_stats.lost / total : 0.0,
+            (unsigned long long)m_stats.reordered,
+            (unsigned long long)m_stats.late,
+            (unsigned long long)m_stats.duplicates,
+            (unsigned long long)m_stats.invalid,
+            (unsigned long long)m_stats.resyncs);
+  }
+
+  return true;
+}
+
+// Tune to another station within the stream.
+bool UdpSource::retune(uint32_t frequency, std::string &error) {
+  double offset = double(frequency) - double(m_frequency);
+  if (2 * std::fabs(offset) >= m_sample_rate) {
+    error = "Frequency outside of the stream";
+    return false;
+  }
+
+  m_confFreq = frequency;
+  return true;
+}
+
+// Return the size of one I/Q pair in the payload in bytes.
+std::size_t UdpSource::sample_bytes() const {
+  switch (m_format) {
+  case PAYLOAD_U8:
+    return 2;
+  case PAYLOAD_S16_LE:
+    return 4;
+  default:
+    return 8;
+  }
+}
+
+// Handle one datagram.
+void UdpSource::receive_datagram(const std::uint8_t *data, std::size_t len) {
+  std::size_t nbytes = sample_bytes();
+  if (len <= header_size || (len - header_size) % nbytes != 0) {
+    m_stats.invalid++;
+    return;
+  }
+  std::size_t nsample = (len - header_size) / nbytes;
+  std::uint32_t seq = (std::uint32_t(data[0]) << 24) |
+                      (std::uint32_t(data[1]) << 16) |
+                      (std::uint32_t(data[2]) << 8) | std::uint32_t(data[3]);
+
+  if (!m_started) {
+    m_started = true;
+    m_next_seq = seq;
+    m_datagram_samples = nsample;
+  }
+
+  // Datagrams can not be later than the window. A jump back beyond it, or
+  // ahead by more than about a second, means that the sender restarted;
+  // start over instead of discarding or concealing that much.
+  std::int32_t dist = std::int32_t(seq - m_next_seq);
+  std::int32_t max_dist =
+      std::max<std::int32_t>(4 * m_window, m_sample_rate / m_datagram_samples);
+  if (dist > max_dist || dist < -4 * std::int32_t(m_window)) {
+    for (auto &p : m_pending) {
+      append_payload(p.second.data(), p.second.size() / nbytes);
+    }
+    m_stats.received += m_pending.size();
+    m_pending.clear();
+    m_stats.resyncs++;
+    m_next_seq = seq;
+    dist = 0;
+  }
+
+  if (dist < 0) {
+    m_stats.late++;
+    return;
+  }
+
+  if (dist == 0) {
+    // In-order datagrams are converted in place.
+    append_payload(data + header_size, nsample);
+    m_datagram_samples = nsample;
+    m_stats.received++;
+    m_next_seq++;
+  } else if (m_pending.count(seq) != 0) {
+    m_stats.duplicates++;
+    return;
+  } else {
+    m_pending[seq].assign(data + header_size, data + len);
+    m_stats.reordered++;
+
+    // Give up on the oldest missing datagrams if the window is full.
+    if (std::uint32_t(dist) >= m_window) {
+      deliver_until(seq - m_window + 1);
+    }
+  }
+
+  deliver_until(m_next_seq);
+}
+
+// Deliver queued datagrams up to sequence number end.
+void UdpSource::deliver_until(std::uint32_t end) {
+  for (;;) {
+    auto it = m_pending.find(m_next_seq);
+    if (it != m_pending.end()) {
+      std::size_t nsample = it->second.size() / sample_bytes();
+      append_payload(it->second.data(), nsample);
+      m_datagram_samples = nsample;
+      m_stats.received++;
+      m_pending.erase(it);
+      m_next_seq++;
+      continue;
+    }
+
+    if (std::int32_t(end - m_next_seq) <= 0) {
+      break;
+    }
+
+    // Conceal the gap up to the next queued datagram or to end.
+    std::uint32_t gap = 0;
+    while (std::int32_t(end - (m_next_seq + gap)) > 0 &&
+           m_pending.count(m_next_seq + gap) == 0) {
+      gap++;
+    }
+    it = m_pending.find(m_next_seq + gap);
+    if (it != m_pending.end()) {
+      IQSample next = first_sample(it->second);
+      append_concealment(gap, &next);
+    } else {
+      append_concealment(gap, NULL);
+    }
+    m_next_seq += gap;
+  }
+}
+
+// Append the payload of a datagram to the output block.
+void UdpSource::append_payload(const std::uint8_t *data, std::size_t nsample) {
+  std::size_t pos = m_output.size();
+  m_output.resize(pos + nsample);
+
+  // Convert the interleaved values as a flat float array, so that the
+  // loops are vectorized.
+  IQSample::value_type *p =
+      reinterpret_cast<IQSample::value_type *>(m_output.data() + pos);
+  std::size_t nvalue = 2 * nsample;
+
+  switch (m_format) {
+  case PAYLOAD_U8: {
+    const IQSample::value_type scale = 1 / IQSample::value_type(128);
+    for (std::size_t i = 0; i < nvalue; i++) {
+      p[i] = (int(data[i]) - 128) * scale;
+    }
+    break;
+  }
+  case PAYLOAD_S16_LE: {
+    const IQSample::value_type scale = 1 / IQSample::value_type(32768);
+    for (std::size_t i = 0; i < nvalue; i++) {
+      p[i] = std::int16_t(data[2 * i] | (data[2 * i + 1] << 8)) * scale;
+    }
+    break;
+  }
+  case PAYLOAD_F32_LE:
+    std::memcpy(p, data, nvalue * sizeof(float));
+    break;
+  }
+
+  if (nsample > 0) {
+    m_last_sample = m_output.back();
+  }
+  if (m_output.size() >= std::size_t(m_block_length)) {
+    flush_output();
+  }
+}
+
+// Append concealment for missing datagrams.
+void UdpSource::append_concealment(std::uint32_t ndatagram,
+                                   const IQSample *next) {
+  std::size_t n = std::size_t(ndatagram) * m_datagram_samples;
+  std::size_t pos = m_output.size();
+  m_output.resize(pos + n, IQSample(0));
+
+  // Bridge the gap with a straight line between the samples around it;
+  // the phase keeps moving roughly as before and the click is smaller
+  // than with silence.
+  if (m_conceal == CONCEAL_INTERP && next != NULL) {
+    IQSample step = (*next - m_last_sample) / IQSample::value_type(n + 1);
+    for (std::size_t i = 0; i < n; i++) {
+      m_output[pos + i] = m_last_sample + step * IQSample::value_type(i + 1);
+    }
+  }
+
+  if (n > 0) {
+    m_last_sample = m_output.back();
+  }
+  m_stats.lost += ndatagram;
+  if (m_output.size() >= std::size_t(m_block_length)) {
+    flush_output();
+  }
+}
+
+// Return the first sample of a queued datagram.
+IQSample
+UdpSource::first_sample(const std::vector<std::uint8_t> &payload) const {
+  switch (m_format) {
+  case PAYLOAD_U8:
+    return IQSample((int(payload[0]) - 128) / 128.0f,
+                    (int(payload[1]) - 128) / 128.0f);
+  case PAYLOAD_S16_LE:
+    return IQSample(std::int16_t(payload[0] | (payload[1] << 8)) / 32768.0f,
+                    std::int16_t(payload[2] | (payload[3] << 8)) / 32768.0f);
+  default:
+    float v[2];
+    std::memcpy(v, payload.data(), sizeof(v));
+    return IQSample(v[0], v[1]);
+  }
+}
+
+// Push the output block to the buffer.
+void UdpSource::flush_output() {
+  if (!m_output.empty()) {
+    m_buf->push(move(m_output));
+    m_output = m_buf->get_spare();
+    m_output.reserve(m_block_length);
+  }
+}
+
+// Receive thread.
+void UdpSource::run() {
+  // Receive buffers are allocated once and reused for every batch.
+  std::vector<std::uint8_t> buffers(recv_batch * max_datagram_size);
+  struct iovec iov[recv_batch];
+  struct mmsghdr msgs[recv_batch];
+  std::memset(msgs, 0, sizeof(msgs));
+  for (unsigned int i = 0; i < recv_batch; i++) {
+    iov[i].iov_base = buffers.data() + i * max_datagram_size;
+    iov[i].iov_len = max_datagram_size;
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  m_output.reserve(m_block_length);
+
+  while (!m_stop_flag->load()) {
+    int n = recvmmsg(m_fd, msgs, recv_batch, MSG_WAITFORONE, NULL);
+
+    if (n > 0) {
+      for (int i = 0; i < n; i++) {
+        receive_datagram((const std::uint8_t *)iov[i].iov_base,
+                         msgs[i].msg_len);
+      }
+    } else if (errno == EAGAIN || errno == EINTR) {
+      // The stream stalled; conceal what is still missing and pass on
+      // what has been received so far.
+      if (!m_pending.empty()) {
+        std::uint32_t end = m_next_seq;
+        for (auto &p : m_pending) {
+          if (std::int32_t(p.first + 1 - end) > 0) {
+            end = p.first + 1;
+          }
+        }
+        deliver_until(end);
+      }
+      flush_output();
+    } else {
+      m_error = "Receive failed (" + std::string(strerror(errno)) + ")";
+      break;
+    }
+  }
+
+  // Let the decoder finish when the stream ends.
+  flush_output();
+  m_buf->push_end();
+}
+
+// Return a list of supported devices.
+void UdpSource::get_device_names(std::vector<std::string> &devices) {
+  devices.clear();
+  devices.push_back("UDP IQ stream (see -c addr=,port=)");
+}
+
+/* end */
@@ -0,0 +1,236 @@
+// NGSoftFM - Software decoder for FM broadcast radio with RTL-SDR
+//
+// Copyright (C) 2019 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
+#include "WorkStealingScheduler.h"
+
+/* ****************  class WorkStealingScheduler  **************** */
+
+// Construct scheduler and start the workers.
+WorkStealingScheduler::WorkStealingScheduler(unsigned int nworkers,
+                                             unsigned int strand_limit)
+    : m_strand_limit(std::max(1U, strand_limit)), m_queued(0),
+      m_stop(false) {
+  nworkers = std::max(1U, nworkers);
+  for (unsigned int i = 0; i < nworkers; i++) {
+    std::unique_ptr<Worker> w(new Worker);
+    w->stats = WorkerStats();
+    m_workers.push_back(std::move(w));
+  }
+
+  // Start the threads once all deques exist, since they steal from each
+  // other.
+  for (unsigned int i = 0; i < nworkers; i++) {
+    m_workers[i]->thread = std::thread(&WorkStealingScheduler::run, this, i);
+  }
+}
+
+// Destructor.
+WorkStealingScheduler::~WorkStealingScheduler() { finish(); }
+
+// Bind a worker thread to a CPU.
+bool WorkStealingScheduler::bind_worker(unsigned int worker, int cpu) {
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+  int rc = pthread_setaffinity_np(m_workers[worker]->thread.native_handle(),
+                                  sizeof(cpuset), &cpuset);
+  if (rc != 0) {
+    m_error = "can not bind worker " + std::to_string(worker) + " to CPU " +
+              std::to_string(cpu) + ": " + strerror(rc);
+    return false;
+  }
+  return true;
+}
+
+// Add a strand.
+std::size_t WorkStealingScheduler::add_strand() {
+  std::unique_ptr<Strand> st(new Strand);
+  st->home = m_strands.size() % m_workers.size();
+  st->queued = false;
+  st->depth_max = 0;
+  m_strands.push_back(std::move(st));
+  return m_strands.size() - 1;
+}
+
+// Queue a task on a strand.
+void WorkStealingScheduler::submit(std::size_t strand, Task &&task) {
+  Strand *st = m_strands[strand].get();
+
+  std::unique_lock<std::mutex> lock(st->mutex);
+  while (st->tasks.size() >= m_strand_limit) {
+    st->space.wait(lock);
+  }
+  st->tasks.push_back(std::move(task));
+  st->depth_max = std::max(st->depth_max, st->tasks.size());
+
+  // A strand is on at most one deque; a running strand is queued again
+  // by its worker.
+  bool idle = !st->queued;
+  st->queued = true;
+  lock.unlock();
+
+  if (idle) {
+    push_strand(st->home, st);
+  }
+}
+
+// Run all pending tasks and stop the workers.
+void WorkStealingScheduler::finish() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_cond.notify_all();
+
+  for (std::unique_ptr<Worker> &w : m_workers) {
+    if (w->thread.joinable()) {
+      w->thread.join();
+    }
+  }
+}
+
+// Return statistics of a worker.
+WorkStealingScheduler::WorkerStats
+WorkStealingScheduler::stats(unsigned int worker) {
+  std::lock_guard<std::mutex> lock(m_workers[worker]->mutex);
+  return m_workers[worker]->stats;
+}
+
+// Return the largest number of pending tasks seen on any strand.
+std::size_t WorkStealingScheduler::max_strand_depth() {
+  std::size_t depth = 0;
+  for (std::unique_ptr<Strand> &st : m_strands) {
+    std::lock_guard<std::mutex> lock(st->mutex);
+    depth = std::max(depth, st->depth_max);
+  }
+  return depth;
+}
+
+// Queue a strand on a worker deque and wake up an idle worker.
+void WorkStealingScheduler::push_strand(unsigned int worker, Strand *strand) {
+  Worker &w = *m_workers[worker];
+
+  // Count the strand first, so that m_queued never drops below the
+  // number of strands which can be taken.
+  m_queued.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> lock(w.mutex);
+    w.deque.push_back(strand);
+  }
+
+  // Taking the lock orders the wake-up after a worker which saw no
+  // queued strand has gone to sleep.
+  { std::lock_guard<std::mutex> lock(m_mutex); }
+  m_cond.notify_one();
+}
+
+// Take a strand from the own deque or steal one.
+WorkStealingScheduler::Strand *
+WorkStealingScheduler::take_strand(unsigned int self) {
+  Worker &own = *m_workers[self];
+  {
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.deque.empty()) {
+      Strand *st = own.deque.front();
+      own.stats.depth_sum += own.deque.size();
+      own.stats.depth_max = std::max(own.stats.depth_max, own.deque.size());
+      own.deque.pop_front();
+      m_queued.fetch_sub(1);
+      return st;
+    }
+  }
+
+  // Steal from the back of the other deques, starting with the next
+  // worker so that the victims are spread.
+  for (unsigned int i = 1; i < m_workers.size(); i++) {
+    Worker &victim = *m_workers[(self + i) % m_workers.size()];
+    Strand *st = NULL;
+    {
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.deque.empty()) {
+        st = victim.deque.back();
+        victim.deque.pop_back();
+        m_queued.fetch_sub(1);
+      }
+    }
+    if (st != NULL) {
+      std::lock_guard<std::mutex> lock(own.mutex);
+      own.stats.steals++;
+      return st;
+    }
+  }
+
+  return NULL;
+}
+
+// Worker thread.
+void WorkStealingScheduler::run(unsigned int self) {
+  Worker &w = *m_workers[self];
+
+  for (;;) {
+    Strand *st = take_strand(self);
+
+    if (st == NULL) {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (m_queued.load() == 0) {
+        if (m_stop) {
+          break;
+        }
+        {
+          std::lock_guard<std::mutex> wlock(w.mutex);
+          w.stats.idle_waits++;
+        }
+        m_cond.wait(lock);
+      }
+      continue;
+    }
+
+    // Run the oldest task of the strand.
+    Task task;
+    {
+      std::lock_guard<std::mutex> lock(st->mutex);
+      task = std::move(st->tasks.front());
+      st->tasks.pop_front();
+    }
+    st->space.notify_all();
+
+    task();
+
+    {
+      std::lock_guard<std::mutex> lock(w.mutex);
+      w.stats.tasks++;
+    }
+
+    // Keep the strand on this worker while it has tasks.
+    bool more;
+    {
+      std::lock_guard<std::mutex> lock(st->mutex);
+      more = !st->tasks.empty();
+      st->queued = more;
+    }
+    if (more) {
+      push_strand(self, st);
+    }
+  }
+}
+
+/* end */